@@ -8,7 +8,9 @@
 #include <sys/stat.h>
 #endif
 
+#include <algorithm>
 #include <array>
+#include <deque>
 
 std::array<std::wstring, 4> const matchTypeXmlNames =
 	{ L"All", L"Any", L"None", L"Not all" };
@@ -92,76 +94,239 @@ bool filter_manager::FilenameFiltered(std::vector<CFilter> const& filters, std::
 	return false;
 }
 
-static bool StringMatch(std::wstring const& subject, CFilterCondition const& condition, bool matchCase)
+bool filter_manager::FilenameFiltered(compiled_filters const& filters, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date)
 {
-	bool match = false;
+	for (auto const& filter : filters) {
+		if (filter.filtered(name, path, dir, size, attributes, date)) {
+			return true;
+		}
+	}
 
-	switch (condition.condition)
+	return false;
+}
+
+namespace {
+// Subjects of name and path conditions, lower-cased at most once per
+// evaluation and only if a condition asks for it.
+class subject final
+{
+public:
+	explicit subject(std::wstring const& s)
+		: s_(s)
+	{}
+
+	std::wstring const& get(bool matchCase)
 	{
-	case 0:
 		if (matchCase) {
-			if (subject.find(condition.strValue) != std::wstring::npos) {
-				match = true;
-			}
+			return s_;
 		}
-		else {
-			if (fz::str_tolower(subject).find(condition.lowerValue) != std::wstring::npos) {
-				match = true;
-			}
+		if (!lowered_) {
+			lower_ = fz::str_tolower(s_);
+			lowered_ = true;
 		}
-		break;
+		return lower_;
+	}
+
+private:
+	std::wstring const& s_;
+	std::wstring lower_;
+	bool lowered_{};
+};
+
+bool StringMatch(subject & s, CFilterCondition const& condition, bool matchCase)
+{
+	if (condition.condition == 4) {
+		return condition.pRegEx && std::regex_search(s.get(true), *condition.pRegEx);
+	}
+
+	std::wstring const& v = s.get(matchCase);
+	std::wstring const& value = matchCase ? condition.strValue : condition.lowerValue;
+
+	switch (condition.condition)
+	{
+	case 0:
+		return v.find(value) != std::wstring::npos;
 	case 1:
-		if (matchCase) {
-			if (subject == condition.strValue) {
-				match = true;
-			}
-		}
-		else {
-			if (fz::str_tolower(subject) == condition.lowerValue) {
-				match = true;
-			}
-		}
-		break;
+		return v == value;
 	case 2:
+		return fz::starts_with(v, value);
+	case 3:
+		return fz::ends_with(v, value);
+	case 5:
+		return v.find(value) == std::wstring::npos;
+	}
+
+	return false;
+}
+
+// Size, attribute, permission and date conditions. Returns false if the
+// condition does not apply as the entry lacks the property in question.
+bool ValueMatch(CFilterCondition const& condition, int64_t size, int attributes, fz::datetime const& date, bool & match)
+{
+	match = false;
+
+	switch (condition.type)
+	{
+	case filter_size:
+		if (size == -1) {
+			return false;
+		}
+		switch (condition.condition)
 		{
-			if (matchCase) {
-				match = fz::starts_with(subject, condition.strValue);
-			}
-			else {
-				match = fz::starts_with(fz::str_tolower(subject), condition.lowerValue);
-			}
+		case 0:
+			match = size > condition.value;
+			break;
+		case 1:
+			match = size == condition.value;
+			break;
+		case 2:
+			match = size != condition.value;
+			break;
+		case 3:
+			match = size < condition.value;
+			break;
 		}
 		break;
-	case 3:
+	case filter_attributes:
+#ifndef FZ_WINDOWS
+		return false;
+#else
+		if (!attributes) {
+			return false;
+		}
+
 		{
-			if (matchCase) {
-				match = fz::ends_with(subject, condition.strValue);
-			}
-			else {
-				match = fz::ends_with(fz::str_tolower(subject), condition.lowerValue);
+			int flag = 0;
+			switch (condition.condition)
+			{
+			case 0:
+				flag = FILE_ATTRIBUTE_ARCHIVE;
+				break;
+			case 1:
+				flag = FILE_ATTRIBUTE_COMPRESSED;
+				break;
+			case 2:
+				flag = FILE_ATTRIBUTE_ENCRYPTED;
+				break;
+			case 3:
+				flag = FILE_ATTRIBUTE_HIDDEN;
+				break;
+			case 4:
+				flag = FILE_ATTRIBUTE_READONLY;
+				break;
+			case 5:
+				flag = FILE_ATTRIBUTE_SYSTEM;
+				break;
 			}
+
+			int set = (flag & attributes) ? 1 : 0;
+			match = set == condition.value;
 		}
+#endif //FZ_WINDOWS
 		break;
-	case 4:
-		if (condition.pRegEx && std::regex_search(subject, *condition.pRegEx)) {
-			match = true;
+	case filter_permissions:
+#ifdef FZ_WINDOWS
+		return false;
+#else
+		if (attributes == -1) {
+			return false;
 		}
-		break;
-	case 5:
-		if (matchCase) {
-			if (subject.find(condition.strValue) == std::wstring::npos) {
-				match = true;
+
+		{
+			int flag = 0;
+			switch (condition.condition)
+			{
+			case 0:
+				flag = S_IRUSR;
+				break;
+			case 1:
+				flag = S_IWUSR;
+				break;
+			case 2:
+				flag = S_IXUSR;
+				break;
+			case 3:
+				flag = S_IRGRP;
+				break;
+			case 4:
+				flag = S_IWGRP;
+				break;
+			case 5:
+				flag = S_IXGRP;
+				break;
+			case 6:
+				flag = S_IROTH;
+				break;
+			case 7:
+				flag = S_IWOTH;
+				break;
+			case 8:
+				flag = S_IXOTH;
+				break;
 			}
+
+			int set = (flag & attributes) ? 1 : 0;
+			match = set == condition.value;
 		}
-		else {
-			if (fz::str_tolower(subject).find(condition.lowerValue) == std::wstring::npos) {
-				match = true;
+#endif //FZ_WINDOWS
+		break;
+	case filter_date:
+		if (!date.empty()) {
+			int cmp = date.compare(condition.date);
+			switch (condition.condition)
+			{
+			case 0: // Before
+				match = cmp < 0;
+				break;
+			case 1: // Equals
+				match = cmp == 0;
+				break;
+			case 2: // Not equals
+				match = cmp != 0;
+				break;
+			case 3: // After
+				match = cmp > 0;
+				break;
 			}
 		}
 		break;
+	default:
+		break;
 	}
 
-	return match;
+	return true;
+}
+
+// Returns true if the result of a single condition decides the outcome of
+// the filter as a whole, with the outcome in result.
+bool Decisive(CFilter::t_matchType matchType, bool match, bool & result)
+{
+	switch (matchType) {
+	case CFilter::all:
+		result = false;
+		return !match;
+	case CFilter::any:
+		result = true;
+		return match;
+	case CFilter::none:
+		result = false;
+		return match;
+	case CFilter::not_all:
+		result = true;
+		return !match;
+	}
+	return false;
+}
+
+// Outcome if no condition was decisive
+bool Undecided(CFilter::t_matchType matchType, bool empty)
+{
+	if (matchType == CFilter::not_all) {
+		return false;
+	}
+
+	return matchType != CFilter::any || empty;
+}
 }
 
 bool filter_manager::FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date)
@@ -173,182 +338,379 @@ bool filter_manager::FilenameFilteredByFilter(CFilter const& filter, std::wstrin
 		return false;
 	}
 
+	subject nameSubject(name);
+	subject pathSubject(path);
+
 	for (auto const& condition : filter.filters) {
 		bool match = false;
 
 		switch (condition.type)
 		{
 		case filter_name:
-			match = StringMatch(name, condition, filter.matchCase);
+			match = StringMatch(nameSubject, condition, filter.matchCase);
 			break;
 		case filter_path:
-			match = StringMatch(path, condition, filter.matchCase);
+			match = StringMatch(pathSubject, condition, filter.matchCase);
 			break;
-		case filter_size:
-			if (size == -1) {
+		default:
+			if (!ValueMatch(condition, size, attributes, date, match)) {
 				continue;
 			}
-			switch (condition.condition)
-			{
-			case 0:
-				if (size > condition.value) {
-					match = true;
-				}
-				break;
-			case 1:
-				if (size == condition.value) {
-					match = true;
+			break;
+		}
+
+		bool result{};
+		if (Decisive(filter.matchType, match, result)) {
+			return result;
+		}
+	}
+
+	return Undecided(filter.matchType, filter.filters.empty());
+}
+
+namespace {
+// Aho-Corasick automaton, finds all of a set of patterns in a single pass
+// over the subject.
+class multi_pattern_matcher final
+{
+public:
+	// Returns the index of the pattern
+	size_t add(std::wstring const& pattern)
+	{
+		uint32_t n = 0;
+		for (auto const c : pattern) {
+			uint32_t next = child(n, c);
+			if (next == none) {
+				next = static_cast<uint32_t>(nodes_.size());
+				auto & edges = nodes_[n].next;
+				auto it = std::lower_bound(edges.begin(), edges.end(), c, [](auto const& edge, wchar_t c) { return edge.first < c; });
+				edges.emplace(it, c, next);
+				nodes_.emplace_back();
+			}
+			n = next;
+		}
+		nodes_[n].out.push_back(static_cast<uint32_t>(patterns_));
+		return patterns_++;
+	}
+
+	// Computes the failure links, call once all patterns are added
+	void build()
+	{
+		std::deque<uint32_t> queue;
+		for (auto const& edge : nodes_[0].next) {
+			nodes_[edge.second].fail = 0;
+			queue.push_back(edge.second);
+		}
+		while (!queue.empty()) {
+			uint32_t const n = queue.front();
+			queue.pop_front();
+			for (auto const& edge : nodes_[n].next) {
+				uint32_t f = nodes_[n].fail;
+				uint32_t target = child(f, edge.first);
+				while (target == none && f) {
+					f = nodes_[f].fail;
+					target = child(f, edge.first);
 				}
-				break;
-			case 2:
-				if (size != condition.value) {
-					match = true;
+				node & v = nodes_[edge.second];
+				v.fail = (target == none) ? 0 : target;
+				auto const& inherited = nodes_[v.fail].out;
+				v.out.insert(v.out.end(), inherited.begin(), inherited.end());
+				queue.push_back(edge.second);
+			}
+		}
+	}
+
+	// Sets found[i] for every pattern i occurring in s
+	void search(std::wstring const& s, std::vector<uint8_t> & found) const
+	{
+		found.assign(patterns_, 0);
+		size_t remaining = patterns_;
+
+		uint32_t n = 0;
+		for (auto const c : s) {
+			uint32_t next = child(n, c);
+			while (next == none && n) {
+				n = nodes_[n].fail;
+				next = child(n, c);
+			}
+			n = (next == none) ? 0 : next;
+			for (auto const o : nodes_[n].out) {
+				if (!found[o]) {
+					found[o] = 1;
+					if (!--remaining) {
+						return;
+					}
 				}
-				break;
-			case 3:
-				if (size < condition.value) {
-					match = true;
+			}
+		}
+	}
+
+private:
+	static uint32_t constexpr none = static_cast<uint32_t>(-1);
+
+	uint32_t child(uint32_t n, wchar_t c) const
+	{
+		auto const& edges = nodes_[n].next;
+		auto it = std::lower_bound(edges.begin(), edges.end(), c, [](auto const& edge, wchar_t c) { return edge.first < c; });
+		return (it != edges.end() && it->first == c) ? it->second : none;
+	}
+
+	struct node final
+	{
+		std::vector<std::pair<wchar_t, uint32_t>> next; // Sorted by character
+		uint32_t fail{};
+		std::vector<uint32_t> out;
+	};
+
+	std::vector<node> nodes_{1};
+	size_t patterns_{};
+};
+
+// Recognizes regular expressions that are nothing but a literal, optionally
+// anchored, and turns them into the equivalent string condition.
+bool LiteralRegex(std::wstring const& re, int & condition, std::wstring & literal)
+{
+	size_t begin = 0;
+	size_t end = re.size();
+	bool const anchorStart = end && re[0] == '^';
+	if (anchorStart) {
+		++begin;
+	}
+	bool const anchorEnd = end > begin && re[end - 1] == '$';
+	if (anchorEnd) {
+		--end;
+	}
+	if (begin >= end) {
+		return false;
+	}
+
+	literal = re.substr(begin, end - begin);
+	if (literal.find_first_of(L"^$\\.*+?()[]{}|") != std::wstring::npos) {
+		return false;
+	}
+
+	if (anchorStart && anchorEnd) {
+		condition = 1;
+	}
+	else if (anchorStart) {
+		condition = 2;
+	}
+	else if (anchorEnd) {
+		condition = 3;
+	}
+	else {
+		condition = 0;
+	}
+	return true;
+}
+}
+
+struct compiled_filter::data final
+{
+	struct literal final
+	{
+		int condition{};
+		std::wstring value;
+		size_t pattern{};
+	};
+
+	// All string conditions on either the name or the path
+	struct subject_conditions final
+	{
+		std::vector<literal> compares; // Equals, begins with, ends with
+		std::vector<literal> contains; // Contains, does not contain
+		std::vector<std::shared_ptr<std::wregex>> regexes;
+
+		multi_pattern_matcher matcher;
+		bool useMatcher{};
+		bool matchCase{};
+
+		bool empty() const { return compares.empty() && contains.empty() && regexes.empty(); }
+
+		void add(CFilterCondition const& condition)
+		{
+			literal l;
+			l.condition = condition.condition;
+			if (condition.condition == 4) {
+				if (!LiteralRegex(condition.strValue, l.condition, l.value)) {
+					regexes.push_back(condition.pRegEx);
+					return;
 				}
-				break;
 			}
-			break;
-		case filter_attributes:
-#ifndef FZ_WINDOWS
-			continue;
-#else
-			if (!attributes) {
-				continue;
+			else {
+				l.value = condition.strValue;
+			}
+			if (!matchCase) {
+				l.value = fz::str_tolower(l.value);
 			}
 
-			{
-				int flag = 0;
-				switch (condition.condition)
-				{
-				case 0:
-					flag = FILE_ATTRIBUTE_ARCHIVE;
-					break;
-				case 1:
-					flag = FILE_ATTRIBUTE_COMPRESSED;
-					break;
-				case 2:
-					flag = FILE_ATTRIBUTE_ENCRYPTED;
-					break;
-				case 3:
-					flag = FILE_ATTRIBUTE_HIDDEN;
-					break;
-				case 4:
-					flag = FILE_ATTRIBUTE_READONLY;
-					break;
-				case 5:
-					flag = FILE_ATTRIBUTE_SYSTEM;
-					break;
-				}
+			if (l.condition == 0 || l.condition == 5) {
+				contains.push_back(std::move(l));
+			}
+			else {
+				compares.push_back(std::move(l));
+			}
+		}
 
-				int set = (flag & attributes) ? 1 : 0;
-				if (set == condition.value) {
-					match = true;
+		void build()
+		{
+			// A single substring is faster found on its own
+			useMatcher = contains.size() > 1;
+			if (useMatcher) {
+				for (auto & l : contains) {
+					l.pattern = matcher.add(l.value);
 				}
+				matcher.build();
 			}
-#endif //FZ_WINDOWS
-			break;
-		case filter_permissions:
-#ifdef FZ_WINDOWS
-			continue;
-#else
-			if (attributes == -1) {
-				continue;
+		}
+
+		// Feeds the result of each condition to decide, stops once it returns true
+		template<typename Decide>
+		bool evaluate_literals(subject & s, Decide const& decide) const
+		{
+			if (empty()) {
+				return false;
 			}
 
-			{
-				int flag = 0;
-				switch (condition.condition)
-				{
-				case 0:
-					flag = S_IRUSR;
-					break;
+			std::wstring const& v = s.get(matchCase);
+			for (auto const& l : compares) {
+				bool match{};
+				switch (l.condition) {
 				case 1:
-					flag = S_IWUSR;
+					match = v == l.value;
 					break;
 				case 2:
-					flag = S_IXUSR;
+					match = fz::starts_with(v, l.value);
 					break;
 				case 3:
-					flag = S_IRGRP;
-					break;
-				case 4:
-					flag = S_IWGRP;
-					break;
-				case 5:
-					flag = S_IXGRP;
-					break;
-				case 6:
-					flag = S_IROTH;
-					break;
-				case 7:
-					flag = S_IWOTH;
-					break;
-				case 8:
-					flag = S_IXOTH;
+					match = fz::ends_with(v, l.value);
 					break;
 				}
+				if (decide(match)) {
+					return true;
+				}
+			}
+
+			if (contains.empty()) {
+				return false;
+			}
 
-				int set = (flag & attributes) ? 1 : 0;
-				if (set == condition.value) {
-					match = true;
+			thread_local std::vector<uint8_t> found;
+			if (useMatcher) {
+				matcher.search(v, found);
+			}
+			for (auto const& l : contains) {
+				bool const present = useMatcher ? found[l.pattern] != 0 : v.find(l.value) != std::wstring::npos;
+				if (decide(l.condition == 0 ? present : !present)) {
+					return true;
 				}
 			}
-#endif //FZ_WINDOWS
-			break;
-		case filter_date:
-			if (!date.empty()) {
-				int cmp = date.compare(condition.date);
-				switch (condition.condition)
-				{
-				case 0: // Before
-					match = cmp < 0;
-					break;
-				case 1: // Equals
-					match = cmp == 0;
-					break;
-				case 2: // Not equals
-					match = cmp != 0;
-					break;
-				case 3: // After
-					match = cmp > 0;
-					break;
+
+			return false;
+		}
+
+		template<typename Decide>
+		bool evaluate_regexes(subject & s, Decide const& decide) const
+		{
+			for (auto const& re : regexes) {
+				if (decide(re && std::regex_search(s.get(true), *re))) {
+					return true;
 				}
 			}
+			return false;
+		}
+	};
+
+	CFilter::t_matchType matchType{CFilter::all};
+	bool filterFiles{};
+	bool filterDirs{};
+	bool empty{};
+
+	std::vector<CFilterCondition> values; // Size, attributes, permissions and date
+	subject_conditions name;
+	subject_conditions path;
+};
+
+compiled_filter::compiled_filter(CFilter const& filter)
+{
+	auto d = std::make_shared<data>();
+	d->matchType = filter.matchType;
+	d->filterFiles = filter.filterFiles;
+	d->filterDirs = filter.filterDirs;
+	d->empty = filter.filters.empty();
+	d->name.matchCase = filter.matchCase;
+	d->path.matchCase = filter.matchCase;
+
+	for (auto const& condition : filter.filters) {
+		switch (condition.type) {
+		case filter_name:
+			d->name.add(condition);
+			break;
+		case filter_path:
+			d->path.add(condition);
 			break;
 		default:
+			d->values.push_back(condition);
 			break;
 		}
-		if (match) {
-			if (filter.matchType == CFilter::any) {
-				return true;
-			}
-			else if (filter.matchType == CFilter::none) {
-				return false;
-			}
-		}
-		else {
-			if (filter.matchType == CFilter::all) {
-				return false;
-			}
-			else if (filter.matchType == CFilter::not_all) {
-				return true;
-			}
-		}
 	}
 
-	if (filter.matchType == CFilter::not_all) {
+	// Cheapest first
+	std::stable_sort(d->values.begin(), d->values.end(), [](CFilterCondition const& lhs, CFilterCondition const& rhs) {
+		return (lhs.type == filter_date) < (rhs.type == filter_date);
+	});
+
+	d->name.build();
+	d->path.build();
+
+	data_ = std::move(d);
+}
+
+bool compiled_filter::filtered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const
+{
+	if (!data_) {
 		return false;
 	}
+	auto const& d = *data_;
 
-	if (filter.matchType != CFilter::any || filter.filters.empty()) {
-		return true;
+	if (dir && !d.filterDirs) {
+		return false;
+	}
+	else if (!dir && !d.filterFiles) {
+		return false;
 	}
 
-	return false;
+	bool result{};
+	auto const decide = [&](bool match) {
+		return Decisive(d.matchType, match, result);
+	};
+
+	for (auto const& condition : d.values) {
+		bool match{};
+		if (ValueMatch(condition, size, attributes, date, match) && decide(match)) {
+			return result;
+		}
+	}
+
+	subject nameSubject(name);
+	subject pathSubject(path);
+	if (d.name.evaluate_literals(nameSubject, decide) || d.path.evaluate_literals(pathSubject, decide) ||
+		d.name.evaluate_regexes(nameSubject, decide) || d.path.evaluate_regexes(pathSubject, decide))
+	{
+		return result;
+	}
+
+	return Undecided(d.matchType, d.empty);
+}
+
+compiled_filters compile_filters(std::vector<CFilter> const& filters)
+{
+	compiled_filters ret;
+	ret.reserve(filters.size());
+	for (auto const& filter : filters) {
+		ret.emplace_back(filter);
+	}
+	return ret;
 }
 
 bool load_filter(pugi::xml_node& element, CFilter& filter)
@@ -75,6 +75,33 @@ public:
 	bool IsLocalFilter() const;
 };
 
+// A filter prepared for evaluation against many entries, e.g. in
+// recursive operations. Size, attribute and date conditions are checked
+// before the string conditions, names and paths are lower-cased at most
+// once per evaluation, substring conditions on the same subject share a
+// single Aho-Corasick pass and regular expressions that are merely literals
+// become plain string comparisons.
+//
+// Evaluation is const and may take place on several threads at once.
+class FZCUI_PUBLIC_SYMBOL compiled_filter final
+{
+public:
+	compiled_filter() = default;
+	explicit compiled_filter(CFilter const& filter);
+
+	// Same result as filter_manager::FilenameFilteredByFilter on the original filter
+	bool filtered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const;
+
+	struct data;
+
+private:
+	std::shared_ptr<data const> data_;
+};
+
+typedef std::vector<compiled_filter> compiled_filters;
+
+compiled_filters FZCUI_PUBLIC_SYMBOL compile_filters(std::vector<CFilter> const& filters);
+
 class FZCUI_PUBLIC_SYMBOL CFilterSet final
 {
 public:
@@ -91,6 +118,7 @@ public:
 	virtual bool FilenameFiltered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, bool local, int attributes, fz::datetime const& date) const = 0;
 
 	static bool FilenameFiltered(std::vector<CFilter> const& filters, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date);
+	static bool FilenameFiltered(compiled_filters const& filters, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date);
 	static bool FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date);
 };
 
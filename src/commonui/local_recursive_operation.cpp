@@ -2,6 +2,14 @@
 
 #include <libfilezilla/local_filesys.hpp>
 
+struct local_recursive_operation::worker final
+{
+	fz::mutex mutex_{false};
+	std::deque<local_recursion_root::new_dir> dirs_;
+	fz::async_task task_;
+	fz::condition cond_;
+};
+
 local_recursive_operation::local_recursive_operation()
 {}
 
@@ -76,6 +84,12 @@ bool local_recursive_operation::do_start_recursive_operation(OperationMode mode,
 	return true;
 }
 
+void local_recursive_operation::set_thread_count(size_t threads)
+{
+	fz::scoped_lock l(mutex_);
+	threads_ = threads ? threads : 1;
+}
+
 void local_recursive_operation::StopRecursiveOperation()
 {
 	{
@@ -90,6 +104,8 @@ void local_recursive_operation::StopRecursiveOperation()
 		m_processedFiles = 0;
 		m_processedDirectories = 0;
 
+		// Idle workers notice the cancellation
+		WakeWorkers(l, idle_.size());
 	}
 
 	thread_.join();
@@ -97,6 +113,11 @@ void local_recursive_operation::StopRecursiveOperation()
 }
 
 void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, bool recurse)
+{
+	EnqueueEnumeratedListing(l, std::move(d), recurse, nullptr);
+}
+
+void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, bool recurse, worker* w)
 {
 	if (recursion_roots_.empty()) {
 		return;
@@ -104,26 +125,45 @@ void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, lis
 
 	auto& root = recursion_roots_.front();
 
+	std::vector<local_recursion_root::new_dir> subdirs;
 	if (recurse) {
 		// Queue for recursion
 		for (auto const& entry : d.dirs) {
 			local_recursion_root::new_dir dir;
-			CLocalPath localSub = d.localPath;
-			localSub.AddSegment(entry.name);
+			dir.localPath = d.localPath;
+			dir.localPath.AddSegment(entry.name);
 
-			CServerPath remoteSub = d.remotePath;
-			if (!remoteSub.empty()) {
+			dir.remotePath = d.remotePath;
+			if (!dir.remotePath.empty()) {
 				if (m_operationMode == recursive_transfer) {
 					// Non-flatten case
-					remoteSub.AddSegment(entry.name);
+					dir.remotePath.AddSegment(entry.name);
 				}
 			}
-			root.add_dir_to_visit(localSub, remoteSub);
+			if (w) {
+				subdirs.emplace_back(std::move(dir));
+			}
+			else {
+				root.m_dirsToVisit.emplace_back(std::move(dir));
+			}
 		}
 	}
 
 	m_listedDirectories.emplace_back(std::move(d));
 
+	// Only hand out the subdirectories to the workers once the listing
+	// containing them has been queued, so that they cannot overtake it.
+	if (!subdirs.empty()) {
+		outstanding_ += subdirs.size();
+		{
+			fz::scoped_lock wl(w->mutex_);
+			for (auto & dir : subdirs) {
+				w->dirs_.emplace_back(std::move(dir));
+			}
+		}
+		WakeWorkers(l, subdirs.size());
+	}
+
 	// Hand off to GUI thread
 	if (m_listedDirectories.size() == 1) {
 		l.unlock();
@@ -132,12 +172,80 @@ void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, lis
 	}
 }
 
+bool local_recursive_operation::ListDirectory(fz::scoped_lock& l, listing&& d, bool recurse, compiled_filters const& filters, worker* w)
+{
+	// Do the slow part without holding mutex
+	l.unlock();
+
+	bool sentPartial = false;
+	fz::local_filesys fs;
+	fz::native_string localPath = fz::to_native(d.localPath.GetPath());
+
+	if (fs.begin_find_files(localPath)) {
+		listing::entry entry;
+		bool isLink{};
+		fz::native_string name;
+		fz::local_filesys::type t{};
+		while (fs.get_next_file(name, isLink, t, &entry.size, &entry.time, &entry.attributes)) {
+			if (isLink && m_ignoreLinks) {
+				continue;
+			}
+			entry.name = fz::to_wstring(name);
+
+			if (!filter_manager::FilenameFiltered(filters, entry.name, d.localPath.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
+				if (t == fz::local_filesys::dir) {
+					d.dirs.emplace_back(std::move(entry));
+				}
+				else {
+					d.files.emplace_back(std::move(entry));
+				}
+
+				// If having queued 5k items, hand off to main thread.
+				if (d.files.size() + d.dirs.size() >= 5000) {
+					sentPartial = true;
+
+					listing next;
+					next.localPath = d.localPath;
+					next.remotePath = d.remotePath;
+
+					l.lock();
+					// Check for cancellation
+					if (recursion_roots_.empty()) {
+						l.unlock();
+						break;
+					}
+					EnqueueEnumeratedListing(l, std::move(d), recurse, w);
+					l.unlock();
+					d = next;
+				}
+			}
+		}
+	}
+
+	l.lock();
+	// Check for cancellation
+	if (recursion_roots_.empty()) {
+		return false;
+	}
+	if (!sentPartial || !d.files.empty() || !d.dirs.empty()) {
+		EnqueueEnumeratedListing(l, std::move(d), recurse, w);
+	}
+
+	return true;
+}
+
 void local_recursive_operation::thread_entry()
 {
 	{
 		fz::scoped_lock l(mutex_);
 
-		auto filters = m_filters.first;
+		if (threads_ > 1 && pool_) {
+			l.unlock();
+			parallel_entry();
+			return;
+		}
+
+		auto const filters = compile_filters(m_filters.first);
 
 		while (!recursion_roots_.empty()) {
 			listing d;
@@ -158,64 +266,59 @@ void local_recursive_operation::thread_entry()
 				root.m_dirsToVisit.pop_front();
 			}
 
-			// Do the slow part without holding mutex
-			l.unlock();
-
-			bool sentPartial = false;
-			fz::local_filesys fs;
-			fz::native_string localPath = fz::to_native(d.localPath.GetPath());
-
-			if (fs.begin_find_files(localPath)) {
-				listing::entry entry;
-				bool isLink{};
-				fz::native_string name;
-				fz::local_filesys::type t{};
-				while (fs.get_next_file(name, isLink, t, &entry.size, &entry.time, &entry.attributes)) {
-					if (isLink && m_ignoreLinks) {
-						continue;
-					}
-					entry.name = fz::to_wstring(name);
-
-					if (!filter_manager::FilenameFiltered(filters, entry.name, d.localPath.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
-						if (t == fz::local_filesys::dir) {
-							d.dirs.emplace_back(std::move(entry));
-						}
-						else {
-							d.files.emplace_back(std::move(entry));
-						}
-
-						// If having queued 5k items, hand off to main thread.
-						if (d.files.size() + d.dirs.size() >= 5000) {
-							sentPartial = true;
-
-							listing next;
-							next.localPath = d.localPath;
-							next.remotePath = d.remotePath;
-
-							l.lock();
-							// Check for cancellation
-							if (recursion_roots_.empty()) {
-								l.unlock();
-								break;
-							}
-							EnqueueEnumeratedListing(l, std::move(d), recurse);
-							l.unlock();
-							d = next;
-						}
-					}
-				}
-			}
-
-			l.lock();
-			// Check for cancellation
-			if (recursion_roots_.empty()) {
+			if (!ListDirectory(l, std::move(d), recurse, filters, nullptr)) {
 				break;
 			}
-			if (!sentPartial || !d.files.empty() || !d.dirs.empty()) {
-				EnqueueEnumeratedListing(l, std::move(d), recurse);
+		}
+
+		listing d;
+		m_listedDirectories.emplace_back(std::move(d));
+	}
+
+	on_listed_directory();
+}
+
+void local_recursive_operation::parallel_entry()
+{
+	{
+		fz::scoped_lock l(mutex_);
+
+		workers_.clear();
+		idle_.clear();
+		for (size_t i = 0; i < threads_; ++i) {
+			workers_.push_back(std::make_unique<worker>());
+		}
+
+		// Spread the roots over the workers. The roots all stay in place
+		// until the operation gets stopped, the workers use the very first
+		// one only to check for cancellation.
+		outstanding_ = 0;
+		size_t i{};
+		for (auto & root : recursion_roots_) {
+			for (auto & dir : root.m_dirsToVisit) {
+				workers_[i++ % workers_.size()]->dirs_.emplace_back(std::move(dir));
+				++outstanding_;
 			}
+			root.m_dirsToVisit.clear();
 		}
 
+		// If spawning fails, the remaining workers take over the queue.
+		for (i = 1; i < workers_.size(); ++i) {
+			workers_[i]->task_ = pool_->spawn([this, i] { worker_entry(i); });
+		}
+	}
+
+	worker_entry(0);
+
+	for (auto & w : workers_) {
+		w->task_.join();
+	}
+
+	{
+		fz::scoped_lock l(mutex_);
+		idle_.clear();
+		workers_.clear();
+
 		listing d;
 		m_listedDirectories.emplace_back(std::move(d));
 	}
@@ -223,3 +326,73 @@ void local_recursive_operation::thread_entry()
 	on_listed_directory();
 }
 
+bool local_recursive_operation::TakeDirectory(size_t index, local_recursion_root::new_dir& dir)
+{
+	// Own queue is processed depth-first, others get robbed of their oldest
+	// entries which usually are the roots of the largest remaining subtrees.
+	{
+		auto & self = *workers_[index];
+		fz::scoped_lock wl(self.mutex_);
+		if (!self.dirs_.empty()) {
+			dir = std::move(self.dirs_.back());
+			self.dirs_.pop_back();
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < workers_.size(); ++i) {
+		auto & victim = *workers_[(index + i) % workers_.size()];
+		fz::scoped_lock wl(victim.mutex_);
+		if (!victim.dirs_.empty()) {
+			dir = std::move(victim.dirs_.front());
+			victim.dirs_.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void local_recursive_operation::worker_entry(size_t index)
+{
+	fz::scoped_lock l(mutex_);
+
+	// Each worker evaluates the filters on its own copy
+	auto const filters = compile_filters(m_filters.first);
+
+	auto & self = *workers_[index];
+	while (!recursion_roots_.empty()) {
+		local_recursion_root::new_dir dir;
+		if (!TakeDirectory(index, dir)) {
+			if (!outstanding_) {
+				break;
+			}
+
+			// Some other worker is still busy and might come up with new
+			// directories.
+			idle_.push_back(&self);
+			self.cond_.wait(l);
+			continue;
+		}
+
+		listing d;
+		d.localPath = dir.localPath;
+		d.remotePath = dir.remotePath;
+
+		bool const ok = ListDirectory(l, std::move(d), dir.recurse, filters, &self);
+		if (!--outstanding_ || !ok) {
+			break;
+		}
+	}
+
+	// Wake up the others so that they notice being done
+	WakeWorkers(l, idle_.size());
+}
+
+void local_recursive_operation::WakeWorkers(fz::scoped_lock& l, size_t count)
+{
+	while (count-- && !idle_.empty()) {
+		idle_.back()->cond_.signal(l);
+		idle_.pop_back();
+	}
+}
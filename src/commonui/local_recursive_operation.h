@@ -12,8 +12,10 @@
 #include <libfilezilla/time.hpp>
 
 #include <deque>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 class FZCUI_PUBLIC_SYMBOL local_recursion_root final
 {
@@ -71,6 +73,13 @@ public:
 
 	virtual void StopRecursiveOperation() override;
 
+	// Number of threads enumerating directories at the same time. Only takes
+	// effect if constructed with a thread pool. Each thread has its own queue of
+	// directories and takes work from the others once its own queue runs dry.
+	// The entries of any given directory are still passed on in order and after
+	// the entry of the directory itself.
+	void set_thread_count(size_t threads);
+
 	// thread entry point for processing files
 	void thread_entry();
 
@@ -93,6 +102,30 @@ protected:
 	bool m_ignoreLinks{};
 
 	fz::async_task thread_;
+
+private:
+	struct worker;
+
+	void FZCUI_PRIVATE_SYMBOL EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, bool recurse, worker* w);
+	bool FZCUI_PRIVATE_SYMBOL ListDirectory(fz::scoped_lock& l, listing&& d, bool recurse, compiled_filters const& filters, worker* w);
+
+	void FZCUI_PRIVATE_SYMBOL parallel_entry();
+	void FZCUI_PRIVATE_SYMBOL worker_entry(size_t index);
+	bool FZCUI_PRIVATE_SYMBOL TakeDirectory(size_t index, local_recursion_root::new_dir& dir);
+
+	// Wakes up to count idle workers
+	void FZCUI_PRIVATE_SYMBOL WakeWorkers(fz::scoped_lock& l, size_t count);
+
+	size_t threads_{1};
+
+	std::vector<std::unique_ptr<worker>> workers_;
+
+	// Directories queued or being enumerated by the workers
+	size_t outstanding_{};
+
+	// Workers waiting for directories. Each waits on its own condition, so
+	// that waking one per queued directory wakes distinct workers.
+	std::vector<worker*> idle_;
 };
 
 #endif
@@ -4,6 +4,8 @@
 #include "ipcmutex.h"
 #include "xml_file.h"
 
+#include "../include/engine_options.h"
+
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/translate.hpp>
 #include <libfilezilla/util.hpp>
@@ -332,6 +334,11 @@ CLocalPath XmlOptions::InitSettingsDir()
 	set(OPTION_DEFAULT_SETTINGSDIR, p.GetPath(), true);
 	set_ipcmutex_lockfile_path(p.GetPath());
 
+	if (!p.empty()) {
+		set(OPTION_CACHE_DIRECTORY, p.GetPath() + L"dircache");
+		set(OPTION_TLS_SESSION_CACHE_FILE, p.GetPath() + L"tlssessions.dat");
+	}
+
 	return p;
 }
 
@@ -0,0 +1,217 @@
+#include "parallel_lister.h"
+
+#include "../include/engine_context.h"
+#include "../include/FileZillaEngine.h"
+#include "../include/misc.h"
+
+#include <libfilezilla/invoker.hpp>
+
+#include <tuple>
+
+namespace {
+struct prefetch_event_type{};
+using prefetch_event = fz::simple_event<prefetch_event_type>;
+}
+
+struct parallel_lister::connection final
+{
+	enum class step
+	{
+		connect,
+		idle,
+		list,
+		failed
+	};
+
+	std::unique_ptr<CFileZillaEngine> engine_;
+	step step_{step::connect};
+	int retries_{};
+};
+
+bool parallel_lister::directory::operator<(directory const& op) const
+{
+	return std::tie(path, subdir, link) < std::tie(op.path, op.subdir, op.link);
+}
+
+parallel_lister::parallel_lister(CFileZillaEngineContext& engine_context)
+	: fz::event_handler(engine_context.GetEventLoop())
+	, engine_context_(engine_context)
+{
+}
+
+parallel_lister::~parallel_lister()
+{
+	remove_handler();
+	connections_.clear();
+}
+
+bool parallel_lister::start(Site const& site, size_t connections)
+{
+	if (!site || !connections) {
+		return false;
+	}
+
+	fz::scoped_lock l(mtx_);
+	if (!connections_.empty()) {
+		return false;
+	}
+
+	site_ = site;
+	for (size_t i = 0; i < connections; ++i) {
+		auto c = std::make_unique<connection>();
+		c->engine_ = std::make_unique<CFileZillaEngine>(engine_context_, fz::make_invoker(*this, [this](CFileZillaEngine* engine){ OnEngineEvent(engine); }));
+		connections_.push_back(std::move(c));
+	}
+
+	send_event<prefetch_event>();
+
+	return true;
+}
+
+void parallel_lister::set_trusted(std::vector<uint8_t> const& certificate, std::wstring const& hostkey_fingerprint)
+{
+	fz::scoped_lock l(mtx_);
+	trusted_certificate_ = certificate;
+	trusted_hostkey_ = hostkey_fingerprint;
+}
+
+size_t parallel_lister::window() const
+{
+	return connections_.size() * 4;
+}
+
+void parallel_lister::prefetch(std::vector<directory> const& dirs)
+{
+	fz::scoped_lock l(mtx_);
+
+	auto pos = pending_.begin();
+	for (auto const& dir : dirs) {
+		if (!requested_.insert(dir).second) {
+			continue;
+		}
+		pos = pending_.insert(pos, dir);
+		++pos;
+	}
+
+	while (pending_.size() > max_pending) {
+		requested_.erase(pending_.back());
+		pending_.pop_back();
+	}
+
+	if (!pending_.empty()) {
+		send_event<prefetch_event>();
+	}
+}
+
+void parallel_lister::operator()(fz::event_base const& ev)
+{
+	if (fz::same_type<prefetch_event>(ev)) {
+		fz::scoped_lock l(mtx_);
+		Dispatch();
+	}
+}
+
+void parallel_lister::Dispatch()
+{
+	for (auto & c : connections_) {
+		if (c->step_ == connection::step::connect && !c->engine_->IsBusy() && !c->engine_->IsConnected()) {
+			Continue(*c);
+		}
+		else if (c->step_ == connection::step::idle) {
+			Continue(*c);
+		}
+	}
+}
+
+void parallel_lister::OnEngineEvent(CFileZillaEngine* engine)
+{
+	fz::scoped_lock l(mtx_);
+
+	for (auto & c : connections_) {
+		if (c->engine_.get() != engine) {
+			continue;
+		}
+
+		std::unique_ptr<CNotification> notification;
+		while ((notification = engine->GetNextNotification())) {
+			switch (notification->GetID())
+			{
+			case nId_asyncrequest:
+				{
+					auto request = unique_static_cast<CAsyncRequestNotification>(std::move(notification));
+					if (request->GetRequestID() == reqId_certificate) {
+						auto & certNotification = static_cast<CCertificateNotification&>(*request);
+						auto const& certs = certNotification.info_.get_certificates();
+						certNotification.trusted_ = !certs.empty() && !trusted_certificate_.empty() && certs.front().get_raw_data() == trusted_certificate_;
+					}
+					else if (request->GetRequestID() == reqId_hostkey || request->GetRequestID() == reqId_hostkeyChanged) {
+						auto & hostKeyNotification = static_cast<CHostKeyNotification&>(*request);
+						hostKeyNotification.m_trust = !trusted_hostkey_.empty() && hostKeyNotification.hostKeyFingerprint == trusted_hostkey_;
+						hostKeyNotification.m_alwaysTrust = false;
+					}
+					engine->SetAsyncRequestReply(std::move(request));
+				}
+				break;
+			case nId_operation:
+				OnResult(*c, static_cast<COperationNotification const&>(*notification.get()).replyCode_);
+				break;
+			default:
+				break;
+			}
+		}
+		break;
+	}
+}
+
+void parallel_lister::Continue(connection & c)
+{
+	int res{};
+	switch (c.step_) {
+	case connection::step::connect:
+		res = c.engine_->Execute(CConnectCommand(site_.server, site_.Handle(), site_.credentials));
+		break;
+	case connection::step::idle:
+		{
+			if (pending_.empty()) {
+				return;
+			}
+			directory const dir = pending_.front();
+			pending_.pop_front();
+
+			c.step_ = connection::step::list;
+			res = c.engine_->Execute(CListCommand(dir.path, dir.subdir, dir.link ? LIST_FLAG_LINK : 0));
+		}
+		break;
+	default:
+		return;
+	}
+
+	if (res != FZ_REPLY_WOULDBLOCK) {
+		OnResult(c, res);
+	}
+}
+
+void parallel_lister::OnResult(connection & c, int result)
+{
+	switch (c.step_) {
+	case connection::step::connect:
+		if (result == FZ_REPLY_OK) {
+			c.step_ = connection::step::idle;
+		}
+		else if ((result & FZ_REPLY_CRITICALERROR) == FZ_REPLY_CRITICALERROR || ++c.retries_ > 1) {
+			// Not worth insisting, the primary connection lists whatever is left.
+			c.step_ = connection::step::failed;
+			return;
+		}
+		break;
+	case connection::step::list:
+		// A failed listing is of no concern here, the primary connection
+		// reports and handles it once it gets there.
+		c.step_ = c.engine_->IsConnected() ? connection::step::idle : connection::step::connect;
+		break;
+	default:
+		return;
+	}
+
+	Continue(c);
+}
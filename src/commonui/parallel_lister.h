@@ -0,0 +1,92 @@
+#ifndef FILEZILLA_COMMONUI_PARALLEL_LISTER_HEADER
+#define FILEZILLA_COMMONUI_PARALLEL_LISTER_HEADER
+
+#include "site.h"
+#include "visibility.h"
+
+#include "../include/serverpath.h"
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/mutex.hpp>
+
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+class CFileZillaEngine;
+class CFileZillaEngineContext;
+
+// Lists directories ahead of time over additional connections to a site.
+//
+// The listings are not handed out, they end up in the directory cache of the
+// engine context. A recursive operation still lists every directory in order
+// on its own engine, which then gets served from the cache instead of waiting
+// for a round-trip to the server. Listings of the same directory are
+// serialized by the engines' operation locks, so a directory that is still
+// being fetched is waited for instead of being listed twice.
+//
+// All engine interaction takes place on the event loop of the engine context,
+// the public functions can be called from any thread.
+class FZCUI_PUBLIC_SYMBOL parallel_lister final : protected fz::event_handler
+{
+public:
+	struct directory final
+	{
+		CServerPath path;
+		std::wstring subdir;
+		bool link{};
+
+		bool operator<(directory const& op) const;
+	};
+
+	parallel_lister(CFileZillaEngineContext& engine_context);
+	virtual ~parallel_lister();
+
+	parallel_lister(parallel_lister const&) = delete;
+	parallel_lister& operator=(parallel_lister const&) = delete;
+
+	// Opens up to the given number of additional connections. Returns false if
+	// the site is unsuitable or connections is zero.
+	bool start(Site const& site, size_t connections);
+
+	// The extra connections cannot prompt the user. Certificates and host keys
+	// identical to the ones accepted on the primary connection get trusted,
+	// anything else makes the connection in question drop out.
+	void set_trusted(std::vector<uint8_t> const& certificate, std::wstring const& hostkey_fingerprint);
+
+	// Queues the directories in the order they will be needed, ahead of any
+	// directories queued earlier. Directories queued before are skipped.
+	void prefetch(std::vector<directory> const& dirs);
+
+	// Number of directories worth queueing ahead of the current one
+	size_t window() const;
+
+	// Upper limit of directories waiting to be listed, older ones are dropped.
+	static size_t constexpr max_pending = 1000;
+
+private:
+	struct connection;
+
+	void FZCUI_PRIVATE_SYMBOL operator()(fz::event_base const& ev) override;
+	void FZCUI_PRIVATE_SYMBOL OnEngineEvent(CFileZillaEngine* engine);
+	void FZCUI_PRIVATE_SYMBOL OnResult(connection & c, int result);
+	void FZCUI_PRIVATE_SYMBOL Continue(connection & c);
+	void FZCUI_PRIVATE_SYMBOL Dispatch();
+
+	CFileZillaEngineContext& engine_context_;
+
+	fz::mutex mtx_;
+
+	Site site_;
+	std::vector<uint8_t> trusted_certificate_;
+	std::wstring trusted_hostkey_;
+
+	std::vector<std::unique_ptr<connection>> connections_;
+
+	std::deque<directory> pending_;
+	std::set<directory> requested_;
+};
+
+#endif
@@ -73,6 +73,7 @@ void remote_recursive_operation::start_recursive_operation(OperationMode mode, A
 void remote_recursive_operation::do_start_recursive_operation(OperationMode, ActiveFilters const& filters)
 {
 	m_filters = filters;
+	remoteFilters_ = compile_filters(m_filters.second);
 	NextOperation();
 }
 
@@ -93,6 +94,7 @@ bool remote_recursive_operation::NextOperation()
 				continue;
 			}
 
+			Prefetch(root);
 			process_command(std::make_unique<CListCommand>(dirToVisit.parent, dirToVisit.subdir, dirToVisit.link ? LIST_FLAG_LINK : 0));
 			return true;
 		}
@@ -106,6 +108,28 @@ bool remote_recursive_operation::NextOperation()
 	return false;
 }
 
+void remote_recursive_operation::Prefetch(recursion_root const& root)
+{
+	if (!lister_) {
+		return;
+	}
+
+	// The front entry is about to be listed by the primary connection. Pass
+	// on the ones after it in the order they are going to be visited.
+	std::vector<parallel_lister::directory> dirs;
+	size_t const window = lister_->window();
+	for (auto it = root.m_dirsToVisit.cbegin() + 1; it != root.m_dirsToVisit.cend() && dirs.size() < window; ++it) {
+		if (!it->doVisit) {
+			continue;
+		}
+		dirs.push_back({it->parent, it->subdir, it->link != 0});
+	}
+
+	if (!dirs.empty()) {
+		lister_->prefetch(dirs);
+	}
+}
+
 bool remote_recursive_operation::BelowRecursionRoot(CServerPath const& path, recursion_root::new_dir &dir)
 {
 	if (!dir.start_dir.empty()) {
@@ -150,7 +174,7 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 				continue;
 			}
 		}
-		else if (filter_manager::FilenameFiltered(m_filters.second, entry.name, remotePath, entry.is_dir(), entry.size, 0, entry.time)) {
+		else if (filter_manager::FilenameFiltered(remoteFilters_, entry.name, remotePath, entry.is_dir(), entry.size, 0, entry.time)) {
 			continue;
 		}
 
@@ -282,6 +306,11 @@ void remote_recursive_operation::SetChmodData(std::unique_ptr<ChmodData>&& chmod
 	chmodData_ = std::move(chmodData);
 }
 
+void remote_recursive_operation::SetParallelLister(std::unique_ptr<parallel_lister>&& lister)
+{
+	lister_ = std::move(lister);
+}
+
 void remote_recursive_operation::StopRecursiveOperation()
 {
 	if (m_operationMode != recursive_none) {
@@ -289,6 +318,7 @@ void remote_recursive_operation::StopRecursiveOperation()
 	}
 	recursion_roots_.clear();
 	chmodData_.reset();
+	lister_.reset();
 }
 
 void remote_recursive_operation::ListingFailed(int error)
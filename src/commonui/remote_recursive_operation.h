@@ -7,6 +7,7 @@
 #include "../include/directorylisting.h"
 
 #include "filter.h"
+#include "parallel_lister.h"
 #include "recursive_operation.h"
 #include "visibility.h"
 
@@ -73,6 +74,10 @@ public:
 	// Needed for recursive_chmod
 	void SetChmodData(std::unique_ptr<ChmodData>&& chmodData);
 
+	// Optional, lists upcoming directories over additional connections.
+	// Reset once the operation stops.
+	void SetParallelLister(std::unique_ptr<parallel_lister>&& lister);
+
 	virtual void StopRecursiveOperation();
 
 protected:
@@ -114,12 +119,18 @@ protected:
 		, recursion_root::new_dir const& dir, std::wstring const& remotePath);
 
 	bool NextOperation();
+	void Prefetch(recursion_root const& root);
 	bool BelowRecursionRoot(CServerPath const& path, recursion_root::new_dir &dir);
 
 	std::deque<recursion_root> recursion_roots_;
 
 	// Needed for recursive_chmod
 	std::unique_ptr<ChmodData> chmodData_;
+
+	std::unique_ptr<parallel_lister> lister_;
+
+	// Compiled form of the remote filters, evaluated for every entry
+	compiled_filters remoteFilters_;
 };
 
 #endif
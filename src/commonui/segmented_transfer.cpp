@@ -0,0 +1,547 @@
+#include "segmented_transfer.h"
+
+#include "../include/directorylisting.h"
+#include "../include/engine_context.h"
+#include "../include/engine_options.h"
+#include "../include/FileZillaEngine.h"
+#include "../include/local_path.h"
+#include "../include/misc.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/invoker.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <algorithm>
+
+namespace {
+struct done_event_type{};
+using done_event = fz::simple_event<done_event_type, uint64_t, int>;
+}
+
+struct segmented_transfer::segment_state final
+{
+	enum class step
+	{
+		connect,
+		prepare,
+		wait,
+		transfer,
+		done,
+
+		// Could not connect, waits for another session to take it over
+		orphaned
+	};
+
+	std::unique_ptr<CFileZillaEngine> engine_;
+	transfer_segment segment_;
+
+	// Bytes of the segment transferred so far, including segment_.done
+	uint64_t current_{};
+
+	step step_{step::connect};
+	int retries_{};
+};
+
+segmented_transfer::segmented_transfer(CFileZillaEngineContext& engine_context, segmented_transfer_handler& handler)
+	: fz::event_handler(engine_context.GetEventLoop())
+	, engine_context_(engine_context)
+	, handler_(handler)
+{
+}
+
+segmented_transfer::~segmented_transfer()
+{
+	remove_handler();
+	segments_.clear();
+}
+
+std::vector<transfer_segment> segmented_transfer::split(uint64_t size, size_t count, uint64_t min_segment_size)
+{
+	std::vector<transfer_segment> ret;
+	if (!size) {
+		return ret;
+	}
+
+	if (!count) {
+		count = 1;
+	}
+	if (min_segment_size && size / min_segment_size < count) {
+		count = static_cast<size_t>(size / min_segment_size);
+		if (!count) {
+			count = 1;
+		}
+	}
+
+	uint64_t const length = size / count;
+	uint64_t offset{};
+	for (size_t i = 0; i < count; ++i) {
+		transfer_segment s;
+		s.offset = offset;
+		s.length = (i + 1 == count) ? size - offset : length;
+		offset += s.length;
+		ret.push_back(s);
+	}
+
+	return ret;
+}
+
+uint64_t segmented_transfer::contiguous(std::vector<transfer_segment> segments)
+{
+	std::sort(segments.begin(), segments.end(), [](transfer_segment const& lhs, transfer_segment const& rhs) {
+		return lhs.offset < rhs.offset;
+	});
+
+	uint64_t ret{};
+	for (auto const& segment : segments) {
+		if (segment.offset != ret) {
+			break;
+		}
+		ret += std::min(segment.done, segment.length);
+		if (segment.done < segment.length) {
+			break;
+		}
+	}
+	return ret;
+}
+
+bool segmented_transfer::start(Site const& site, CServerPath const& remotePath, std::wstring const& remoteFile, std::wstring const& localFile, bool download, std::vector<transfer_segment> const& segments)
+{
+	fz::scoped_lock l(mtx_);
+
+	if (busy_ || !site || remotePath.empty() || remoteFile.empty() || localFile.empty() || segments.empty()) {
+		return false;
+	}
+
+	if (!site.server.HasFeature(download ? ProtocolFeature::SegmentedDownload : ProtocolFeature::SegmentedUpload)) {
+		return false;
+	}
+
+	site_ = site;
+	remotePath_ = remotePath;
+	remoteFile_ = remoteFile;
+	localFile_ = localFile;
+	download_ = download;
+
+	segments_.clear();
+	initial_done_ = 0;
+	uint64_t size{};
+	for (auto const& segment : segments) {
+		if (!segment || segment.done > segment.length) {
+			segments_.clear();
+			return false;
+		}
+		auto s = std::make_unique<segment_state>();
+		s->segment_ = segment;
+		s->current_ = segment.done;
+		initial_done_ += segment.done;
+		size = std::max(size, segment.offset + segment.length);
+		segments_.push_back(std::move(s));
+	}
+
+	started_ = fz::datetime::now();
+	++run_;
+
+	// A fresh upload first removes the existing remote file, segments only
+	// ever write their own range and never truncate.
+	prepared_ = download || initial_done_ != 0;
+
+	if (download && !prepare_local_file(localFile_, size, !initial_done_)) {
+		segments_.clear();
+		return false;
+	}
+
+	busy_ = true;
+	progress_notified_ = false;
+
+	for (auto & s : segments_) {
+		s->engine_ = std::make_unique<CFileZillaEngine>(engine_context_, fz::make_invoker(*this, [this](CFileZillaEngine* engine){ OnEngineEvent(engine); }));
+	}
+	for (auto & s : segments_) {
+		if (!busy_) {
+			break;
+		}
+		Continue(*s);
+	}
+
+	return true;
+}
+
+bool segmented_transfer::prepare_local_file(std::wstring const& localFile, uint64_t size, bool fresh)
+{
+	std::wstring name;
+	CLocalPath path(localFile, &name);
+	if (path.HasParent()) {
+		fz::mkdir(fz::to_native(path.GetPath()), true);
+	}
+
+	fz::file f;
+	if (!f.open(fz::to_native(localFile), fz::file::writing, fresh ? fz::file::empty : fz::file::existing)) {
+		return false;
+	}
+
+	if (fresh) {
+		if (f.seek(static_cast<int64_t>(size), fz::file::begin) != static_cast<int64_t>(size) || !f.truncate()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void segmented_transfer::cancel()
+{
+	fz::scoped_lock l(mtx_);
+
+	if (!busy_) {
+		return;
+	}
+
+	Finish(FZ_REPLY_CANCELED);
+}
+
+bool segmented_transfer::busy() const
+{
+	fz::scoped_lock l(mtx_);
+	return busy_;
+}
+
+std::vector<transfer_segment> segmented_transfer::segments() const
+{
+	fz::scoped_lock l(mtx_);
+
+	std::vector<transfer_segment> ret;
+	ret.reserve(segments_.size());
+	for (auto const& s : segments_) {
+		transfer_segment segment = s->segment_;
+		segment.done = s->current_;
+		ret.push_back(segment);
+	}
+	return ret;
+}
+
+CTransferStatus segmented_transfer::status(bool & changed)
+{
+	fz::scoped_lock l(mtx_);
+
+	changed = false;
+	if (segments_.empty()) {
+		progress_notified_ = false;
+		return CTransferStatus();
+	}
+
+	int64_t total{};
+	int64_t current{};
+	for (auto & s : segments_) {
+		if (s->step_ == segment_state::step::transfer && s->engine_) {
+			// Polling the engines also re-arms their transfer status notifications
+			bool engineChanged{};
+			CTransferStatus const engineStatus = s->engine_->GetTransferStatus(engineChanged);
+			if (engineChanged) {
+				UpdateProgress(*s, engineStatus);
+				changed = true;
+			}
+		}
+		total += static_cast<int64_t>(s->segment_.length);
+		current += static_cast<int64_t>(s->current_);
+	}
+	if (!changed) {
+		progress_notified_ = false;
+	}
+
+	CTransferStatus status(total, static_cast<int64_t>(initial_done_), false);
+	status.started = started_;
+	status.currentOffset = current;
+	status.madeProgress = current > static_cast<int64_t>(initial_done_);
+	return status;
+}
+
+void segmented_transfer::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<done_event>(ev, this, &segmented_transfer::OnDone);
+}
+
+void segmented_transfer::OnDone(uint64_t run, int result)
+{
+	{
+		fz::scoped_lock l(mtx_);
+		// Completion of a run cancelled before the transfer got restarted
+		if (run != run_) {
+			return;
+		}
+	}
+	handler_.on_segmented_transfer_done(result);
+}
+
+void segmented_transfer::OnEngineEvent(CFileZillaEngine* engine)
+{
+	fz::scoped_lock l(mtx_);
+
+	for (auto & s : segments_) {
+		if (s->engine_.get() != engine) {
+			continue;
+		}
+
+		std::unique_ptr<CNotification> notification;
+		while ((notification = engine->GetNextNotification())) {
+			ProcessNotification(*s, std::move(notification));
+		}
+		break;
+	}
+}
+
+void segmented_transfer::ProcessNotification(segment_state & s, std::unique_ptr<CNotification> && notification)
+{
+	if (!busy_) {
+		return;
+	}
+
+	switch (notification->GetID())
+	{
+	case nId_asyncrequest:
+		{
+			auto request = unique_static_cast<CAsyncRequestNotification>(std::move(notification));
+			handler_.on_segment_async_request(*request);
+			s.engine_->SetAsyncRequestReply(std::move(request));
+		}
+		break;
+	case nId_operation:
+		ProcessOperation(s, static_cast<COperationNotification const&>(*notification.get()));
+		break;
+	case nId_transferstatus:
+		if (UpdateProgress(s, static_cast<CTransferStatusNotification const&>(*notification.get()).GetStatus()) && !progress_notified_) {
+			progress_notified_ = true;
+			handler_.on_segmented_transfer_progress();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+bool segmented_transfer::UpdateProgress(segment_state & s, CTransferStatus const& status)
+{
+	if (s.step_ != segment_state::step::transfer || !status || status.list) {
+		return false;
+	}
+
+	// Status offsets are relative to the start of the segment
+	if (status.currentOffset > 0) {
+		uint64_t const current = std::min(static_cast<uint64_t>(status.currentOffset), s.segment_.length);
+		if (current > s.current_) {
+			s.current_ = current;
+			return true;
+		}
+	}
+	return false;
+}
+
+void segmented_transfer::ProcessOperation(segment_state & s, COperationNotification const& operation)
+{
+	OnSegmentResult(s, operation.replyCode_);
+}
+
+void segmented_transfer::Execute(segment_state & s, CCommand const& cmd)
+{
+	int res = s.engine_->Execute(cmd);
+	if (res != FZ_REPLY_WOULDBLOCK) {
+		OnSegmentResult(s, res);
+	}
+}
+
+void segmented_transfer::Continue(segment_state & s)
+{
+	switch (s.step_) {
+	case segment_state::step::connect:
+		Execute(s, CConnectCommand(site_.server, site_.Handle(), site_.credentials));
+		break;
+	case segment_state::step::prepare:
+		Execute(s, CDeleteCommand(remotePath_, std::vector<std::wstring>{remoteFile_}));
+		break;
+	case segment_state::step::transfer:
+		{
+			transfer_segment segment = s.segment_;
+			segment.done = s.current_;
+			if (download_) {
+				Execute(s, CFileTransferCommand(fz::file_writer_factory(localFile_, engine_context_.GetThreadPool()),
+					remotePath_, remoteFile_, transfer_flags::download, std::wstring(), segment));
+			}
+			else {
+				Execute(s, CFileTransferCommand(fz::file_reader_factory(localFile_, engine_context_.GetThreadPool()),
+					remotePath_, remoteFile_, transfer_flags::none, std::wstring(), segment));
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void segmented_transfer::OnSegmentResult(segment_state & s, int result)
+{
+	if (!busy_) {
+		return;
+	}
+
+	switch (s.step_) {
+	case segment_state::step::connect:
+		if (result == FZ_REPLY_OK) {
+			if (prepared_) {
+				s.step_ = segment_state::step::transfer;
+			}
+			else if (&s == segments_.front().get()) {
+				s.step_ = segment_state::step::prepare;
+			}
+			else {
+				s.step_ = segment_state::step::wait;
+				return;
+			}
+			Continue(s);
+			return;
+		}
+		break;
+	case segment_state::step::prepare:
+		// Failure is fine, most likely the file did not exist.
+		prepared_ = true;
+		s.step_ = segment_state::step::transfer;
+		for (auto & other : segments_) {
+			if (other->step_ == segment_state::step::wait) {
+				other->step_ = segment_state::step::transfer;
+				Continue(*other);
+				if (!busy_) {
+					return;
+				}
+			}
+		}
+		Continue(s);
+		return;
+	case segment_state::step::transfer:
+		if (result == FZ_REPLY_OK) {
+			s.current_ = s.segment_.length;
+			s.step_ = segment_state::step::done;
+			if (TakeOverOrphan(s)) {
+				return;
+			}
+			for (auto const& other : segments_) {
+				if (other->step_ != segment_state::step::done) {
+					return;
+				}
+			}
+			Finish(FZ_REPLY_OK);
+			return;
+		}
+		break;
+	default:
+		return;
+	}
+
+	if ((result & FZ_REPLY_CANCELED) == FZ_REPLY_CANCELED || (result & FZ_REPLY_CRITICALERROR) == FZ_REPLY_CRITICALERROR) {
+		Finish(result);
+		return;
+	}
+
+	if (s.step_ == segment_state::step::connect && download_) {
+		// Servers limiting the number of connections per client refuse the
+		// additional logins. Leave the segment to one of the sessions that
+		// did get in once it is done with its own.
+		bool connected{};
+		for (auto const& other : segments_) {
+			if (other->step_ == segment_state::step::transfer ||
+				(other->step_ == segment_state::step::done && other->engine_->IsConnected()))
+			{
+				connected = true;
+				break;
+			}
+		}
+		if (connected || s.retries_ >= max_retries) {
+			s.step_ = segment_state::step::orphaned;
+			CheckOrphans(result);
+			return;
+		}
+	}
+
+	if (++s.retries_ > max_retries) {
+		Finish(result);
+		return;
+	}
+
+	// Resume the segment, reconnecting if needed
+	s.step_ = s.engine_->IsConnected() ? segment_state::step::transfer : segment_state::step::connect;
+	Continue(s);
+}
+
+bool segmented_transfer::TakeOverOrphan(segment_state & s)
+{
+	for (auto & other : segments_) {
+		if (other->step_ != segment_state::step::orphaned) {
+			continue;
+		}
+
+		// The finished segment moves to the orphan, so that segments() keeps
+		// reporting each range exactly once.
+		std::swap(s.segment_, other->segment_);
+		std::swap(s.current_, other->current_);
+		other->step_ = segment_state::step::done;
+		s.step_ = segment_state::step::transfer;
+		s.retries_ = 0;
+		Continue(s);
+		return true;
+	}
+	return false;
+}
+
+void segmented_transfer::CheckOrphans(int result)
+{
+	// Fails the transfer if no session is left to take over the orphans
+	for (auto const& s : segments_) {
+		if (s->step_ != segment_state::step::done && s->step_ != segment_state::step::orphaned) {
+			return;
+		}
+	}
+
+	for (auto & s : segments_) {
+		if (s->step_ == segment_state::step::done && s->engine_ && s->engine_->IsConnected()) {
+			if (TakeOverOrphan(*s)) {
+				return;
+			}
+		}
+	}
+
+	Finish(result);
+}
+
+void segmented_transfer::ApplyRemoteTime()
+{
+	// The segments leave the modification time alone, otherwise segments
+	// still writing would change it again. Use the time from the listing of
+	// the remote directory the segments have looked up the file in.
+	for (auto const& s : segments_) {
+		CDirectoryListing listing;
+		if (!s->engine_ || s->engine_->CacheLookup(remotePath_, listing) != FZ_REPLY_OK) {
+			continue;
+		}
+
+		size_t const i = listing.FindFile_CmpCase(remoteFile_);
+		if (i != std::wstring::npos && listing[i].has_date()) {
+			fz::local_filesys::set_modification_time(fz::to_native(localFile_), listing[i].time);
+		}
+		return;
+	}
+}
+
+void segmented_transfer::Finish(int result)
+{
+	busy_ = false;
+
+	for (auto & s : segments_) {
+		if (s->engine_ && s->engine_->IsBusy()) {
+			s->engine_->Cancel();
+		}
+	}
+
+	if (result == FZ_REPLY_OK && download_ && engine_context_.GetOptions().get_int(OPTION_PRESERVE_TIMESTAMPS)) {
+		ApplyRemoteTime();
+	}
+
+	// Also reached from cancel() on the thread of the caller
+	send_event<done_event>(run_, result);
+}
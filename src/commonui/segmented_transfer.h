@@ -0,0 +1,138 @@
+#ifndef FILEZILLA_COMMONUI_SEGMENTED_TRANSFER_HEADER
+#define FILEZILLA_COMMONUI_SEGMENTED_TRANSFER_HEADER
+
+#include "site.h"
+#include "visibility.h"
+
+#include "../include/notification.h"
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/mutex.hpp>
+
+#include <memory>
+#include <vector>
+
+class CFileZillaEngine;
+class CFileZillaEngineContext;
+
+class FZCUI_PUBLIC_SYMBOL segmented_transfer_handler
+{
+public:
+	virtual ~segmented_transfer_handler() = default;
+
+	// Called once all segments have finished or one of them has failed for good.
+	virtual void on_segmented_transfer_done(int result) = 0;
+
+	// Called when a segment makes progress. It is not called again until
+	// segmented_transfer::status has reported no further change, same as
+	// with the transfer status notifications of the engine.
+	virtual void on_segmented_transfer_progress() {}
+
+	// The engines of the segments cannot prompt the user. Fill in the reply to
+	// the request, if left untouched it gets rejected.
+	virtual void on_segment_async_request(CAsyncRequestNotification &) {}
+};
+
+// Transfers a single file over multiple connections at once, each of which
+// transfers a byte range of the file.
+//
+// The progress of each segment can be queried at any time and passed to
+// a later start() call to resume the transfer.
+//
+// The engines of the segments run on the event loop of the engine context,
+// the public functions can be called from any thread. The handler gets
+// called on the event loop.
+class FZCUI_PUBLIC_SYMBOL segmented_transfer final : protected fz::event_handler
+{
+public:
+	segmented_transfer(CFileZillaEngineContext& engine_context, segmented_transfer_handler& handler);
+	virtual ~segmented_transfer();
+
+	segmented_transfer(segmented_transfer const&) = delete;
+	segmented_transfer& operator=(segmented_transfer const&) = delete;
+
+	static uint64_t constexpr default_min_segment_size = 16 * 1024 * 1024;
+
+	// Splits a file of the given size into up to count segments. Segments are
+	// never smaller than min_segment_size, except for the last one.
+	static std::vector<transfer_segment> split(uint64_t size, size_t count, uint64_t min_segment_size = default_min_segment_size);
+
+	// Number of bytes at the start of the file that have been transferred
+	// without a gap. Truncating a partial download to this size leaves a
+	// file that can be resumed the usual way.
+	static uint64_t contiguous(std::vector<transfer_segment> segments);
+
+	// Creates or reopens the local file of a download. A fresh file gets
+	// allocated to the given size so that each segment can be written at
+	// its offset, an existing one is left as it is.
+	static bool prepare_local_file(std::wstring const& localFile, uint64_t size, bool fresh);
+
+	// Returns false if the site or the segments are unsuitable.
+	bool start(Site const& site, CServerPath const& remotePath, std::wstring const& remoteFile, std::wstring const& localFile, bool download, std::vector<transfer_segment> const& segments);
+
+	// The handler gets told about the cancellation on the event loop, not
+	// from within this call.
+	void cancel();
+
+	bool busy() const;
+
+	// Current state of each segment, with done set to the number of bytes that
+	// have safely been transferred.
+	std::vector<transfer_segment> segments() const;
+
+	// Progress of all segments combined. Like CFileZillaEngine::GetTransferStatus,
+	// changed tells whether there has been progress since the previous call.
+	CTransferStatus status(bool & changed);
+
+	// Number of retries after which a failing segment fails the whole transfer
+	static int constexpr max_retries = 5;
+
+private:
+	struct segment_state;
+
+	void FZCUI_PRIVATE_SYMBOL operator()(fz::event_base const& ev) override;
+	void FZCUI_PRIVATE_SYMBOL OnDone(uint64_t run, int result);
+	void FZCUI_PRIVATE_SYMBOL OnEngineEvent(CFileZillaEngine* engine);
+	void FZCUI_PRIVATE_SYMBOL ProcessNotification(segment_state & s, std::unique_ptr<CNotification> && notification);
+	void FZCUI_PRIVATE_SYMBOL ProcessOperation(segment_state & s, COperationNotification const& operation);
+	bool FZCUI_PRIVATE_SYMBOL UpdateProgress(segment_state & s, CTransferStatus const& status);
+
+	void FZCUI_PRIVATE_SYMBOL Continue(segment_state & s);
+	void FZCUI_PRIVATE_SYMBOL Execute(segment_state & s, CCommand const& cmd);
+	void FZCUI_PRIVATE_SYMBOL OnSegmentResult(segment_state & s, int result);
+	bool FZCUI_PRIVATE_SYMBOL TakeOverOrphan(segment_state & s);
+	void FZCUI_PRIVATE_SYMBOL CheckOrphans(int result);
+	void FZCUI_PRIVATE_SYMBOL ApplyRemoteTime();
+	void FZCUI_PRIVATE_SYMBOL Finish(int result);
+
+	CFileZillaEngineContext& engine_context_;
+	segmented_transfer_handler& handler_;
+
+	// Guards all of the below
+	mutable fz::mutex mtx_;
+
+	Site site_;
+	CServerPath remotePath_;
+	std::wstring remoteFile_;
+	std::wstring localFile_;
+	bool download_{};
+
+	// Uploads start by deleting the remote file so that no stale data remains
+	// beyond the end of the new file. The other segments wait until that's done.
+	bool prepared_{};
+
+	std::vector<std::unique_ptr<segment_state>> segments_;
+	fz::datetime started_;
+	uint64_t initial_done_{};
+
+	bool busy_{};
+
+	// Incremented by start(), tells completions of earlier runs apart
+	uint64_t run_{};
+
+	// Set once the handler has been told about progress, reset once status
+	// has reported no further change.
+	bool progress_notified_{};
+};
+
+#endif
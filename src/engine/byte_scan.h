@@ -0,0 +1,109 @@
+#ifndef FILEZILLA_ENGINE_BYTE_SCAN_HEADER
+#define FILEZILLA_ENGINE_BYTE_SCAN_HEADER
+
+// Helpers to quickly scan raw received data, e.g. directory listings,
+// 16 bytes at a time where SSE2 is available.
+
+#include <stddef.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FZ_BYTE_SCAN_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace byte_scan {
+
+#if FZ_BYTE_SCAN_SSE2
+inline int first_set_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Returns the offset of the first \r, \n or \0, or size if there is none.
+inline size_t find_line_end(unsigned char const* p, size_t size)
+{
+	size_t i = 0;
+#if FZ_BYTE_SCAN_SSE2
+	__m128i const cr = _mm_set1_epi8('\r');
+	__m128i const lf = _mm_set1_epi8('\n');
+	__m128i const nul = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16) {
+		__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+		__m128i const m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)), _mm_cmpeq_epi8(v, nul));
+		unsigned int const mask = static_cast<unsigned int>(_mm_movemask_epi8(m));
+		if (mask) {
+			return i + first_set_bit(mask);
+		}
+	}
+#endif
+	for (; i < size; ++i) {
+		if (p[i] == '\r' || p[i] == '\n' || !p[i]) {
+			break;
+		}
+	}
+	return i;
+}
+
+// Returns the offset of the first byte that is neither a line break, a space,
+// a tab nor \0, or size if there is none.
+inline size_t skip_blank(unsigned char const* p, size_t size)
+{
+	size_t i = 0;
+#if FZ_BYTE_SCAN_SSE2
+	__m128i const cr = _mm_set1_epi8('\r');
+	__m128i const lf = _mm_set1_epi8('\n');
+	__m128i const space = _mm_set1_epi8(' ');
+	__m128i const tab = _mm_set1_epi8('\t');
+	__m128i const nul = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16) {
+		__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf));
+		m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, nul));
+		unsigned int const mask = static_cast<unsigned int>(_mm_movemask_epi8(m)) ^ 0xffffu;
+		if (mask) {
+			return i + first_set_bit(mask);
+		}
+	}
+#endif
+	for (; i < size; ++i) {
+		if (p[i] != '\r' && p[i] != '\n' && p[i] != ' ' && p[i] != '\t' && p[i]) {
+			break;
+		}
+	}
+	return i;
+}
+
+// True if all bytes are 7-bit ASCII
+inline bool is_ascii(unsigned char const* p, size_t size)
+{
+	size_t i = 0;
+#if FZ_BYTE_SCAN_SSE2
+	for (; i + 16 <= size; i += 16) {
+		__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+		if (_mm_movemask_epi8(v)) {
+			return false;
+		}
+	}
+#endif
+	for (; i < size; ++i) {
+		if (p[i] & 0x80) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+#endif
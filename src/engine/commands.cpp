@@ -56,14 +56,14 @@ bool CListCommand::valid() const
 }
 
 CFileTransferCommand::CFileTransferCommand(fz::reader_factory_holder const& reader,
-	CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags)
-	: reader_(reader), m_remotePath(remotePath), m_remoteFile(remoteFile), flags_(flags), extraFlags_(extraFlags)
+	CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags, transfer_segment const& segment)
+	: reader_(reader), m_remotePath(remotePath), m_remoteFile(remoteFile), flags_(flags), extraFlags_(extraFlags), segment_(segment)
 {
 }
 
 CFileTransferCommand::CFileTransferCommand(fz::writer_factory_holder const& writer,
-	CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags)
-	: writer_(writer), m_remotePath(remotePath), m_remoteFile(remoteFile), flags_(flags), extraFlags_(extraFlags)
+	CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags, transfer_segment const& segment)
+	: writer_(writer), m_remotePath(remotePath), m_remoteFile(remoteFile), flags_(flags), extraFlags_(extraFlags), segment_(segment)
 {
 }
 
@@ -87,6 +87,10 @@ bool CFileTransferCommand::valid() const
 		return false;
 	}
 
+	if (segment_ && segment_.done > segment_.length) {
+		return false;
+	}
+
 	return true;
 }
 
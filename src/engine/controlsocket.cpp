@@ -1,7 +1,9 @@
 #include "filezilla.h"
 #include "activity_logger_layer.h"
+#include "byte_scan.h"
 #include "controlsocket.h"
 #include "directorycache.h"
+#include "directorylistingparser.h"
 #include "engineprivate.h"
 #include "lookup.h"
 #include "logging_private.h"
@@ -13,6 +15,7 @@
 #include "../include/sizeformatting_base.h"
 
 #include <libfilezilla/event_loop.hpp>
+#include <libfilezilla/file.hpp>
 #include <libfilezilla/iputils.hpp>
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/rate_limited_layer.hpp>
@@ -371,6 +374,11 @@ int CControlSocket::CheckOverwriteFile()
 	}
 
 	auto & data = static_cast<CFileTransferOpData &>(*operations_.back());
+	if (data.segment_) {
+		// Whoever split the file into segments has already dealt with existing files
+		return FZ_REPLY_OK;
+	}
+
 	data.localFileSize_ = data.download() ? data.writer_factory_.size() : data.reader_factory_.size();
 	data.localFileTime_ = data.download() ? data.writer_factory_.mtime() : data.reader_factory_.mtime();
 
@@ -463,6 +471,7 @@ CFileTransferOpData::CFileTransferOpData(wchar_t const* name, CFileTransferComma
 	, localName_(reader_factory_ ? reader_factory_.name() : writer_factory_.name())
 	, remoteFile_(cmd.GetRemoteFile())
 	, remotePath_(cmd.GetRemotePath())
+	, segment_(cmd.GetSegment())
 {
 	localFileSize_ = download() ? writer_factory_.size() : reader_factory_.size();
 	localFileTime_ = download() ? writer_factory_.mtime() : reader_factory_.mtime();
@@ -476,6 +485,14 @@ std::wstring CControlSocket::ConvToLocal(char const* buffer, size_t len)
 		return ret;
 	}
 
+	// Plain ASCII is the same in all supported encodings except custom ones
+	if ((m_useUTF8 || currentServer_.GetEncodingType() != ENCODING_CUSTOM) &&
+		byte_scan::is_ascii(reinterpret_cast<unsigned char const*>(buffer), len))
+	{
+		ret.assign(buffer, buffer + len);
+		return ret;
+	}
+
 	if (m_useUTF8) {
 		ret = fz::to_wstring_from_utf8(buffer, len);
 		if (!ret.empty()) {
@@ -1154,6 +1171,17 @@ void CControlSocket::SendDirectoryListingNotification(CServerPath const& path, b
 	engine_.AddNotification(std::make_unique<CDirectoryListingNotification>(path, operations_.size() == 1 && operations_.back()->opId == Command::list, failed));
 }
 
+void CControlSocket::SetupPartialListingNotifications(CDirectoryListingParser & parser, CServerPath const& path)
+{
+	if (operations_.size() != 1 || operations_.back()->opId != Command::list) {
+		return;
+	}
+
+	parser.SetPartialListingCallback([this, path](std::vector<fz::shared_value<CDirentry>> && entries, bool first) {
+		engine_.AddNotification(std::make_unique<CDirectoryListingPartNotification>(path, std::move(entries), first));
+	});
+}
+
 void CControlSocket::CallSetAsyncRequestReply(CAsyncRequestNotification *pNotification)
 {
 	if (operations_.empty() || !operations_.back()->waitForAsyncRequest) {
@@ -1213,6 +1241,42 @@ std::unique_ptr<fz::writer_base> CControlSocket::OpenWriter(fz::writer_factory_h
 	return factory->open(*buffer_pool_, resumeOffset, status_update, max_buffer_count());
 }
 
+std::unique_ptr<fz::writer_base> CControlSocket::OpenSegmentWriter(fz::writer_factory_holder & factory, transfer_segment const& segment, bool withProgress)
+{
+	if (!factory || !buffer_pool_) {
+		return {};
+	}
+
+	// Segments need random access to the target, only local files qualify
+	auto file_writer = dynamic_cast<fz::file_writer_factory*>(&*factory);
+	if (!file_writer) {
+		log(logmsg::debug_warning, L"Segmented transfer to something other than a local file");
+		return {};
+	}
+
+	fz::file f;
+	fz::result r = f.open(fz::to_native(file_writer->name()), fz::file::writing, fz::file::existing);
+	if (!r) {
+		log(logmsg::error, _("Could not open \"%s\" for writing"), file_writer->name());
+		return {};
+	}
+
+	int64_t const offset = static_cast<int64_t>(segment.offset + segment.done);
+	if (f.seek(offset, fz::file::begin) != offset) {
+		log(logmsg::error, _("Could not seek to offset %d within file \"%s\""), offset, file_writer->name());
+		return {};
+	}
+
+	fz::writer_base::progress_cb_t status_update;
+	if (withProgress) {
+		status_update = [&s = engine_.transfer_status_](fz::writer_base const*, uint64_t written) {
+			s.SetMadeProgress();
+			s.Update(written);
+		};
+	}
+	return std::make_unique<fz::file_writer>(file_writer->name(), *buffer_pool_, std::move(f), engine_.GetThreadPool(), false, std::move(status_update), max_buffer_count());
+}
+
 int64_t CalculateNextChunkSize(int64_t remaining, int64_t lastChunkSize, fz::duration const& lastChunkDuration, int64_t minChunkSize, int64_t multiple, int64_t partCount, int64_t maxPartCount, int64_t maxChunkSize)
 {
 	if (remaining <= 0) {
@@ -148,6 +148,8 @@ public:
 	uint64_t localFileSize_{fz::aio_base::nosize};
 	fz::datetime localFileTime_;
 
+	transfer_segment segment_;
+
 	int64_t remoteFileSize_{-1};
 	fz::datetime remoteFileTime_;
 };
@@ -186,6 +188,7 @@ public:
 namespace fz {
 class socket_layer;
 }
+class CDirectoryListingParser;
 class CFileExistsNotification;
 class CTransferStatus;
 class CControlSocket : public fz::event_handler
@@ -280,6 +283,10 @@ protected:
 	virtual bool SetAsyncRequestReply(CAsyncRequestNotification *pNotification) = 0;
 	void SendDirectoryListingNotification(CServerPath const& path, bool failed);
 
+	// For primary listings, makes the parser send the entries to the
+	// application while the listing is being received.
+	void SetupPartialListingNotifications(CDirectoryListingParser & parser, CServerPath const& path);
+
 	fz::duration GetInferredTimezoneOffset() const;
 
 	virtual int DoClose(int nErrorCode = FZ_REPLY_DISCONNECTED | FZ_REPLY_ERROR);
@@ -306,6 +313,10 @@ protected:
 
 	std::unique_ptr<fz::writer_base> OpenWriter(fz::writer_factory_holder & h, uint64_t resumeOffset, bool withProgress);
 
+	// Opens the local file for writing the given segment. Unlike OpenWriter,
+	// the file is never truncated so that the other segments are left intact.
+	std::unique_ptr<fz::writer_base> OpenSegmentWriter(fz::writer_factory_holder & h, transfer_segment const& segment, bool withProgress);
+
 	std::optional<fz::aio_buffer_pool> buffer_pool_;
 	std::vector<std::unique_ptr<COpData>> operations_;
 	CFileZillaEnginePrivate & engine_;
@@ -0,0 +1,205 @@
+#include "deflate_layer.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <errno.h>
+
+namespace {
+size_t const chunk_size = 64 * 1024;
+}
+
+deflate_layer::deflate_layer(fz::event_handler* handler, fz::socket_interface& next_layer, bool compress, int level)
+	: fz::socket_layer(handler, next_layer, true)
+	, compress_(compress)
+	, level_(level)
+{
+	next_layer.set_event_handler(handler);
+}
+
+deflate_layer::~deflate_layer()
+{
+	if (stream_) {
+		if (compress_) {
+			deflateEnd(stream_.get());
+		}
+		else {
+			inflateEnd(stream_.get());
+		}
+	}
+	next_layer_.set_event_handler(nullptr);
+}
+
+bool deflate_layer::init(int& error)
+{
+	if (stream_) {
+		return true;
+	}
+
+	auto stream = std::make_unique<z_stream_s>();
+	int const res = compress_ ? deflateInit(stream.get(), level_) : inflateInit(stream.get());
+	if (res != Z_OK) {
+		error = (res == Z_MEM_ERROR) ? ENOMEM : EINVAL;
+		return false;
+	}
+
+	stream_ = std::move(stream);
+	return true;
+}
+
+int deflate_layer::read(void* buffer, unsigned int size, int& error)
+{
+	if (compress_) {
+		return next_layer_.read(buffer, size, error);
+	}
+
+	if (!init(error)) {
+		return -1;
+	}
+
+	for (;;) {
+		if (stream_end_) {
+			// Nothing may follow the end of the compressed stream
+			unsigned char tmp[1024];
+			int const r = next_layer_.read(tmp, sizeof(tmp), error);
+			if (r > 0) {
+				error = EPROTO;
+				return -1;
+			}
+			return r;
+		}
+
+		if (buffer_.empty()) {
+			int const r = next_layer_.read(buffer_.get(chunk_size), static_cast<unsigned int>(chunk_size), error);
+			if (r < 0) {
+				return r;
+			}
+			if (!r) {
+				if (!wire_bytes_) {
+					// Some servers send nothing at all for empty files
+					return 0;
+				}
+				error = ECONNABORTED;
+				return -1;
+			}
+			buffer_.add(static_cast<size_t>(r));
+			wire_bytes_ += r;
+		}
+
+		stream_->next_in = buffer_.get();
+		stream_->avail_in = static_cast<unsigned int>(buffer_.size());
+		stream_->next_out = static_cast<unsigned char*>(buffer);
+		stream_->avail_out = size;
+
+		int const res = inflate(stream_.get(), Z_NO_FLUSH);
+		buffer_.consume(buffer_.size() - stream_->avail_in);
+
+		if (res == Z_STREAM_END) {
+			stream_end_ = true;
+		}
+		else if (res != Z_OK && (res != Z_BUF_ERROR || !buffer_.empty())) {
+			error = EPROTO;
+			return -1;
+		}
+
+		unsigned int const produced = size - stream_->avail_out;
+		if (produced) {
+			data_bytes_ += produced;
+			return static_cast<int>(produced);
+		}
+	}
+}
+
+int deflate_layer::write(void const* buffer, unsigned int size, int& error)
+{
+	if (!compress_) {
+		return next_layer_.write(buffer, size, error);
+	}
+
+	if (stream_end_) {
+		error = EINVAL;
+		return -1;
+	}
+
+	if (!init(error)) {
+		return -1;
+	}
+
+	error = flush();
+	if (error) {
+		return -1;
+	}
+
+	stream_->next_in = static_cast<unsigned char*>(const_cast<void*>(buffer));
+	stream_->avail_in = size;
+	while (stream_->avail_in) {
+		stream_->next_out = buffer_.get(chunk_size);
+		stream_->avail_out = static_cast<unsigned int>(chunk_size);
+		if (deflate(stream_.get(), Z_NO_FLUSH) != Z_OK) {
+			error = EINVAL;
+			return -1;
+		}
+		buffer_.add(chunk_size - stream_->avail_out);
+	}
+	data_bytes_ += size;
+
+	// What cannot be sent now goes out with the next write or on shutdown
+	int const res = flush();
+	if (res && res != EAGAIN) {
+		error = res;
+		return -1;
+	}
+
+	return static_cast<int>(size);
+}
+
+int deflate_layer::shutdown()
+{
+	if (compress_ && !stream_end_) {
+		int error{};
+		if (!init(error)) {
+			return error;
+		}
+
+		stream_->next_in = nullptr;
+		stream_->avail_in = 0;
+		int res;
+		do {
+			stream_->next_out = buffer_.get(chunk_size);
+			stream_->avail_out = static_cast<unsigned int>(chunk_size);
+			res = deflate(stream_.get(), Z_FINISH);
+			if (res != Z_OK && res != Z_STREAM_END) {
+				return EINVAL;
+			}
+			buffer_.add(chunk_size - stream_->avail_out);
+		} while (res != Z_STREAM_END);
+		stream_end_ = true;
+	}
+
+	if (compress_) {
+		int const res = flush();
+		if (res) {
+			return res;
+		}
+	}
+
+	return next_layer_.shutdown();
+}
+
+int deflate_layer::flush()
+{
+	while (!buffer_.empty()) {
+		int error{};
+		size_t const to_write = std::min(buffer_.size(), static_cast<size_t>(std::numeric_limits<int>::max()));
+		int const written = next_layer_.write(buffer_.get(), static_cast<unsigned int>(to_write), error);
+		if (written <= 0) {
+			return written < 0 ? error : EAGAIN;
+		}
+		buffer_.consume(static_cast<size_t>(written));
+		wire_bytes_ += written;
+	}
+
+	return 0;
+}
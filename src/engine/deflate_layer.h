@@ -0,0 +1,49 @@
+#ifndef FILEZILLA_ENGINE_DEFLATE_LAYER_HEADER
+#define FILEZILLA_ENGINE_DEFLATE_LAYER_HEADER
+
+#include <libfilezilla/buffer.hpp>
+#include <libfilezilla/socket.hpp>
+
+#include <memory>
+
+struct z_stream_s;
+
+// Compresses or decompresses a zlib stream, as used by the MODE Z transfer
+// mode of FTP. Data connections only ever go into one direction, the layer
+// thus either compresses what gets written or decompresses what gets read.
+//
+// Compressed data that cannot be passed on right away is kept until the next
+// call to write or shutdown.
+class deflate_layer final : public fz::socket_layer
+{
+public:
+	// Level 1 to 9 or -1 for the zlib default, only used when compressing.
+	deflate_layer(fz::event_handler* handler, fz::socket_interface& next_layer, bool compress, int level = -1);
+	virtual ~deflate_layer();
+
+	virtual int read(void* buffer, unsigned int size, int& error) override;
+	virtual int write(void const* buffer, unsigned int size, int& error) override;
+
+	// Ends the compressed stream before shutting down the next layer
+	virtual int shutdown() override;
+
+	// Amount of uncompressed data and of compressed data on the wire
+	int64_t data_bytes() const { return data_bytes_; }
+	int64_t wire_bytes() const { return wire_bytes_; }
+
+private:
+	bool init(int& error);
+	int flush();
+
+	std::unique_ptr<z_stream_s> stream_;
+	bool const compress_;
+	int const level_;
+	bool stream_end_{};
+
+	fz::buffer buffer_;
+
+	int64_t data_bytes_{};
+	int64_t wire_bytes_{};
+};
+
+#endif
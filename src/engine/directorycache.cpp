@@ -1,18 +1,91 @@
 #include "filezilla.h"
 #include "directorycache.h"
+#include "directorycachefile.h"
+
+#include <libfilezilla/local_filesys.hpp>
 
 #include <assert.h>
 
+#include <unordered_set>
+
+namespace {
+// Heap memory used by a string, short strings are stored inline
+int64_t heap_size(std::wstring const& s)
+{
+	auto const data = reinterpret_cast<char const*>(s.data());
+	auto const self = reinterpret_cast<char const*>(&s);
+	if (data >= self && data < self + sizeof(s)) {
+		return 0;
+	}
+	return static_cast<int64_t>((s.capacity() + 1) * sizeof(wchar_t));
+}
+
+// Size of a shared_value, the control block and the value are allocated together
+template<typename T>
+int64_t shared_size(T const& v)
+{
+	return static_cast<int64_t>(2 * sizeof(void*) + sizeof(v)) + heap_size(v);
+}
+
+std::wstring index_key(CServerPath const& path)
+{
+	return fz::str_tolower(path.GetSafePath());
+}
+
+size_t hash_server(CServer const& server)
+{
+	// Only covers fields SameContent compares
+	size_t hash = std::hash<std::wstring>()(server.GetHost());
+	hash ^= std::hash<std::wstring>()(server.GetUser()) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	hash ^= (static_cast<size_t>(server.GetPort()) << 8 | static_cast<size_t>(server.GetProtocol())) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	return hash;
+}
+
+// Size of a single entry, without the strings it may share with other entries
+int64_t EntrySize(CDirentry const& entry)
+{
+	int64_t size = static_cast<int64_t>(sizeof(fz::shared_value<CDirentry>) + 2 * sizeof(void*) + sizeof(CDirentry)) + heap_size(entry.name);
+	if (entry.target) {
+		size += static_cast<int64_t>(sizeof(std::wstring)) + heap_size(*entry.target);
+	}
+	return size;
+}
+
+int64_t EstimateSize(CDirectoryListing const& listing)
+{
+	int64_t size = static_cast<int64_t>(listing.path.GetPath().size() * sizeof(wchar_t));
+
+	// The parser shares identical permission and owner strings between
+	// entries, count each of them only once.
+	std::unordered_set<std::wstring const*> seen;
+	for (size_t i = 0; i < listing.size(); ++i) {
+		CDirentry const& entry = listing[i];
+		size += EntrySize(entry);
+		if (seen.insert(&*entry.permissions).second) {
+			size += shared_size(*entry.permissions);
+		}
+		if (seen.insert(&*entry.ownerGroup).second) {
+			size += shared_size(*entry.ownerGroup);
+		}
+	}
+
+	return size;
+}
+}
+
 CDirectoryCache::CDirectoryCache()
 {
 }
 
 CDirectoryCache::~CDirectoryCache()
 {
+	SavePersisted();
+
 	for (auto & serverEntry : m_serverList) {
 		for (auto & cacheEntry : serverEntry.cacheList) {
 #ifndef NDEBUG
 			m_totalFileCount -= cacheEntry.listing.size();
+			m_totalSize -= cacheEntry.size;
 #endif
 			tLruList::iterator* lruIt = (tLruList::iterator*)cacheEntry.lruIt;
 			if (lruIt) {
@@ -23,12 +96,15 @@ CDirectoryCache::~CDirectoryCache()
 	}
 #ifndef NDEBUG
 	assert(m_totalFileCount == 0);
+	assert(m_totalSize == 0);
 #endif
 }
 
 void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& server)
 {
-	fz::scoped_lock lock(mutex_);
+	LoadPersisted(server);
+
+	fz::scoped_write_lock lock(mutex_);
 
 	tServerIter sit = CreateServerEntry(server);
 	assert(sit != m_serverList.end());
@@ -43,11 +119,16 @@ void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& ser
 
 		m_totalFileCount -= cit->listing.size();
 		entry.listing = listing;
+		entry.persisted = false;
+		UpdateSize(entry);
 
+		Prune();
 		return;
 	}
 
 	cit = sit->cacheList.emplace_hint(cit, listing);
+	sit->pathIndex.emplace(index_key(listing.path), cit);
+	UpdateSize(const_cast<CCacheEntry&>(*cit));
 
 	UpdateLru(sit, cit);
 
@@ -56,19 +137,25 @@ void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& ser
 
 bool CDirectoryCache::Lookup(CDirectoryListing &listing, CServer const& server, const CServerPath &path, bool allowUnsureEntries, bool& is_outdated)
 {
-	fz::scoped_lock lock(mutex_);
+	LoadPersisted(server);
+
+	fz::scoped_read_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
+		CountMiss();
 		return false;
 	}
 
 	tCacheIter iter;
 	if (Lookup(iter, sit, path, allowUnsureEntries, is_outdated)) {
+		fz::scoped_lock l(lru_mutex_);
+		CountHit(*iter, is_outdated);
 		listing = iter->listing;
 		return true;
 	}
 
+	CountMiss();
 	return false;
 }
 
@@ -88,7 +175,7 @@ bool CDirectoryCache::Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPat
 				return false;
 			}
 
-			is_outdated = (fz::monotonic_clock::now() - entry.listing.m_firstListTime) > ttl_;
+			is_outdated = entry.persisted || (fz::monotonic_clock::now() - entry.listing.m_firstListTime) > ttl_;
 			return true;
 		}
 	}
@@ -96,21 +183,76 @@ bool CDirectoryCache::Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPat
 	return false;
 }
 
+std::vector<CDirectoryCache::tCacheIter> CDirectoryCache::FindNoCase(tServerIter const& sit, CServerPath const& path)
+{
+	std::vector<tCacheIter> ret;
+
+	auto range = sit->pathIndex.equal_range(index_key(path));
+	for (auto it = range.first; it != range.second; ++it) {
+		if (!path.CmpNoCase(it->second->listing.path)) {
+			ret.push_back(it->second);
+		}
+	}
+
+	return ret;
+}
+
+std::vector<CDirectoryCache::tCacheIter> CDirectoryCache::FindSubdirs(tServerIter const& sit, CServerPath const& path, bool cmpNoCase, bool allowEqual)
+{
+	std::vector<tCacheIter> ret;
+
+	// On MVS the prefix is a suffix and may differ between a directory and
+	// its subdirectories.
+	if (path.GetType() == MVS) {
+		for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+			if (path.IsParentOf(iter->listing.path, cmpNoCase, allowEqual)) {
+				ret.push_back(iter);
+			}
+		}
+		return ret;
+	}
+
+	std::wstring const key = index_key(path);
+	if (allowEqual) {
+		auto range = sit->pathIndex.equal_range(key);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (path.IsParentOf(it->second->listing.path, cmpNoCase, true)) {
+				ret.push_back(it->second);
+			}
+		}
+	}
+
+	std::wstring const prefix = key + L" ";
+	for (auto it = sit->pathIndex.lower_bound(prefix); it != sit->pathIndex.end() && !it->first.compare(0, prefix.size(), prefix); ++it) {
+		if (path.IsParentOf(it->second->listing.path, cmpNoCase)) {
+			ret.push_back(it->second);
+		}
+	}
+
+	return ret;
+}
+
 bool CDirectoryCache::DoesExist(CServer const& server, CServerPath const& path, int &hasUnsureEntries, bool &is_outdated)
 {
-	fz::scoped_lock lock(mutex_);
+	LoadPersisted(server);
+
+	fz::scoped_read_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
+		CountMiss();
 		return false;
 	}
 
 	tCacheIter iter;
 	if (Lookup(iter, sit, path, true, is_outdated)) {
+		fz::scoped_lock l(lru_mutex_);
+		CountHit(*iter, is_outdated);
 		hasUnsureEntries = iter->listing.get_unsure_flags();
 		return true;
 	}
 
+	CountMiss();
 	return false;
 }
 
@@ -119,19 +261,26 @@ std::tuple<LookupResults, CDirentry> CDirectoryCache::LookupFile(CServer const&
 	LookupResults results{};
 	CDirentry entry;
 
-	fz::scoped_lock lock(mutex_);
+	LoadPersisted(server);
+
+	fz::scoped_read_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
+		CountMiss();
 		return {results, entry};
 	}
 
 	tCacheIter iter;
 	bool outdated{};
 	if (!Lookup(iter, sit, path, true, outdated)) {
+		CountMiss();
 		return {results, entry};
 	}
 
+	fz::scoped_lock l(lru_mutex_);
+	CountHit(*iter, outdated);
+
 	if (outdated) {
 		results |= LookupResults::outdated;
 		if (!(flags & LookupFlags::allow_outdated)) {
@@ -164,19 +313,26 @@ std::vector<std::tuple<LookupResults, CDirentry>> CDirectoryCache::LookupFiles(C
 {
 	std::vector<std::tuple<LookupResults, CDirentry>> ret;
 
-	fz::scoped_lock lock(mutex_);
+	LoadPersisted(server);
+
+	fz::scoped_read_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
+		CountMiss();
 		return ret;
 	}
 
 	tCacheIter iter;
 	bool outdated{};
 	if (!Lookup(iter, sit, path, true, outdated)) {
+		CountMiss();
 		return ret;
 	}
 
+	fz::scoped_lock l(lru_mutex_);
+	CountHit(*iter, outdated);
+
 	LookupResults results{};
 	if (outdated) {
 		results |= LookupResults::outdated;
@@ -216,7 +372,9 @@ std::vector<std::tuple<LookupResults, CDirentry>> CDirectoryCache::LookupFiles(C
 
 bool CDirectoryCache::LookupFile(CDirentry &entry, CServer const& server, CServerPath const& path, std::wstring const& filename, bool &dirDidExist, bool &matchedCase)
 {
-	fz::scoped_lock lock(mutex_);
+	LoadPersisted(server);
+
+	fz::scoped_read_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -232,6 +390,8 @@ bool CDirectoryCache::LookupFile(CDirentry &entry, CServer const& server, CServe
 	}
 	dirDidExist = true;
 
+	fz::scoped_lock l(lru_mutex_);
+
 	const CCacheEntry &cacheEntry = *iter;
 	const CDirectoryListing &listing = cacheEntry.listing;
 
@@ -253,7 +413,7 @@ bool CDirectoryCache::LookupFile(CDirentry &entry, CServer const& server, CServe
 
 bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
 {
-	fz::scoped_lock lock(mutex_);
+	fz::scoped_write_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -264,18 +424,11 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 	bool dir{};
 
 	auto const now = fz::monotonic_clock::now();
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+	for (auto const& iter : FindNoCase(sit, path)) {
 		auto & entry = const_cast<CCacheEntry&>(*iter);
 
-		if (cmpCase) {
-			if (path != entry.listing.path) {
-				continue;
-			}
-		}
-		else {
-			if (path.CmpNoCase(entry.listing.path)) {
-				continue;
-			}
+		if (cmpCase && path != entry.listing.path) {
+			continue;
 		}
 
 		UpdateLru(sit, iter);
@@ -302,12 +455,10 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 	if (dir) {
 		CServerPath child = path;
 		if (child.ChangePath(filename)) {
-			for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+			for (auto const& iter : FindSubdirs(sit, path, !cmpCase, true)) {
 				auto & entry = const_cast<CCacheEntry&>(*iter);
-				if (path.IsParentOf(entry.listing.path, !cmpCase, true)) {
-					entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
-					entry.modificationTime = now;
-				}
+				entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
+				entry.modificationTime = now;
 			}
 		}
 	}
@@ -317,8 +468,13 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 
 bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size, std::wstring const& ownerGroup)
 {
-	fz::scoped_lock lock(mutex_);
+	fz::scoped_write_lock lock(mutex_);
 
+	return DoUpdateFile(server, path, filename, mayCreate, type, size, ownerGroup);
+}
+
+bool CDirectoryCache::DoUpdateFile(CServer const& server, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size, std::wstring const& ownerGroup)
+{
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
 		return false;
@@ -326,11 +482,8 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 
 	bool updated = false;
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+	for (auto const& iter : FindNoCase(sit, path)) {
 		auto & entry = const_cast<CCacheEntry&>(*iter);
-		if (path.CmpNoCase(entry.listing.path)) {
-			continue;
-		}
 
 		UpdateLru(sit, iter);
 
@@ -384,7 +537,10 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 			}
 			entry.listing.Append(std::move(direntry));
 
+			// The new entry does not share its strings with any other
+			CDirentry const& added = entry.listing[entry.listing.size() - 1];
 			++m_totalFileCount;
+			AdjustSize(entry, EntrySize(added) + shared_size(*added.permissions) + shared_size(*added.ownerGroup));
 		}
 		else {
 			entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
@@ -399,18 +555,20 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 
 bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
 {
-	fz::scoped_lock lock(mutex_);
+	fz::scoped_write_lock lock(mutex_);
 
+	return DoRemoveFile(server, path, filename);
+}
+
+bool CDirectoryCache::DoRemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
+{
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
 		return false;
 	}
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+	for (auto const& iter : FindNoCase(sit, path)) {
 		auto & entry = const_cast<CCacheEntry&>(*iter);
-		if (path.CmpNoCase(entry.listing.path)) {
-			continue;
-		}
 
 		UpdateLru(sit, iter);
 
@@ -430,8 +588,10 @@ bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path,
 			}
 			assert(i != entry.listing.size());
 
+			int64_t const removed = EntrySize(entry.listing[i]);
 			entry.listing.RemoveEntry(i); // This does set m_hasUnsureEntries
 			--m_totalFileCount;
+			AdjustSize(entry, -removed);
 		}
 		else {
 			for (size_t i = 0; i < entry.listing.size(); ++i) {
@@ -449,31 +609,35 @@ bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path,
 
 void CDirectoryCache::InvalidateServer(CServer const& server)
 {
-	fz::scoped_lock lock(mutex_);
+	fz::scoped_write_lock lock(mutex_);
 
-	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (!iter->server.SameContent(server)) {
-			continue;
-		}
+	DoInvalidateServer(server);
+}
 
-		for (tCacheIter cit = iter->cacheList.begin(); cit != iter->cacheList.end(); ++cit) {
-			tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
-			if (lruIt) {
-				m_leastRecentlyUsedList.erase(*lruIt);
-				delete lruIt;
-			}
+void CDirectoryCache::DoInvalidateServer(CServer const& server)
+{
+	tServerIter sit = GetServerEntry(server);
+	if (sit == m_serverList.end()) {
+		return;
+	}
 
-			m_totalFileCount -= cit->listing.size();
+	for (tCacheIter cit = sit->cacheList.begin(); cit != sit->cacheList.end(); ++cit) {
+		tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
+		if (lruIt) {
+			m_leastRecentlyUsedList.erase(*lruIt);
+			delete lruIt;
 		}
 
-		m_serverList.erase(iter);
-		break;
+		m_totalFileCount -= cit->listing.size();
+		m_totalSize -= cit->size;
 	}
+
+	RemoveServerEntry(sit);
 }
 
 bool CDirectoryCache::GetChangeTime(fz::monotonic_clock& time, CServer const& server, CServerPath const& path)
 {
-	fz::scoped_lock lock(mutex_);
+	fz::scoped_read_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -492,8 +656,13 @@ bool CDirectoryCache::GetChangeTime(fz::monotonic_clock& time, CServer const& se
 
 void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path, std::wstring const& filename, CServerPath const&)
 {
-	fz::scoped_lock lock(mutex_);
+	fz::scoped_write_lock lock(mutex_);
 
+	DoRemoveDir(server, path, filename);
+}
+
+void CDirectoryCache::DoRemoveDir(CServer const& server, CServerPath const& path, std::wstring const& filename)
+{
 	// TODO: This is not 100% foolproof and may not work properly
 	// Perhaps just throw away the complete cache?
 
@@ -507,29 +676,24 @@ void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path,
 		absolutePath.clear();
 	}
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ) {
-		auto & entry = const_cast<CCacheEntry&>(*iter);
-		// Delete exact matches and subdirs
-		if (!absolutePath.empty() && (entry.listing.path == absolutePath || absolutePath.IsParentOf(entry.listing.path, true))) {
-			m_totalFileCount -= entry.listing.size();
-			tLruList::iterator* lruIt = (tLruList::iterator*)iter->lruIt;
-			if (lruIt) {
-				m_leastRecentlyUsedList.erase(*lruIt);
-				delete lruIt;
-			}
-			sit->cacheList.erase(iter++);
+	// Delete exact matches and subdirs
+	if (!absolutePath.empty()) {
+		for (auto const& iter : FindSubdirs(sit, absolutePath, true, false)) {
+			RemoveCacheEntry(sit, iter);
 		}
-		else {
-			++iter;
+		for (auto const& iter : FindNoCase(sit, absolutePath)) {
+			if (iter->listing.path == absolutePath) {
+				RemoveCacheEntry(sit, iter);
+			}
 		}
 	}
 
-	RemoveFile(server, path, filename);
+	DoRemoveFile(server, path, filename);
 }
 
 void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom, std::wstring const& fileFrom, CServerPath const& pathTo, std::wstring const& fileTo)
 {
-	fz::scoped_lock lock(mutex_);
+	fz::scoped_write_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -542,7 +706,7 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 	if (found) {
 		auto & listing = const_cast<CDirectoryListing&>(iter->listing);
 		if (pathFrom == pathTo) {
-			RemoveFile(server, pathFrom, fileTo);
+			DoRemoveFile(server, pathFrom, fileTo);
 			size_t i;
 			for (i = 0; i < listing.size(); ++i) {
 				if (listing[i].name == fileFrom) {
@@ -551,15 +715,17 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 			}
 			if (i != listing.size()) {
 				if (listing[i].is_dir()) {
-					RemoveDir(server, pathFrom, fileFrom, CServerPath());
-					RemoveDir(server, pathFrom, fileTo, CServerPath());
-					UpdateFile(server, pathFrom, fileTo, true, dir);
+					DoRemoveDir(server, pathFrom, fileFrom);
+					DoRemoveDir(server, pathFrom, fileTo);
+					DoUpdateFile(server, pathFrom, fileTo, true, dir, -1, std::wstring());
 				}
 				else {
+					int64_t const oldSize = heap_size(listing[i].name);
 					listing.get(i).name = fileTo;
 					listing.get(i).flags |= CDirentry::flag_unsure;
 					listing.m_flags |= CDirectoryListing::unsure_unknown;
 					listing.ClearFindMap();
+					AdjustSize(const_cast<CCacheEntry&>(*iter), heap_size(listing[i].name) - oldSize);
 				}
 			}
 			return;
@@ -573,12 +739,12 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 			}
 			if (i != listing.size()) {
 				if (listing[i].is_dir()) {
-					RemoveDir(server, pathFrom, fileFrom, CServerPath());
-					UpdateFile(server, pathTo, fileTo, true, dir);
+					DoRemoveDir(server, pathFrom, fileFrom);
+					DoUpdateFile(server, pathTo, fileTo, true, dir, -1, std::wstring());
 				}
 				else {
-					RemoveFile(server, pathFrom, fileFrom);
-					UpdateFile(server, pathTo, fileTo, true, file);
+					DoRemoveFile(server, pathFrom, fileFrom);
+					DoUpdateFile(server, pathTo, fileTo, true, file, -1, std::wstring());
 				}
 			}
 			return;
@@ -586,12 +752,12 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 	}
 
 	// We know nothing, be on the safe side and invalidate everything.
-	InvalidateServer(server);
+	DoInvalidateServer(server);
 }
 
 void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const& path, std::wstring const& filename, std::wstring& ownerGroup)
 {
-	fz::scoped_lock lock(mutex_);
+	fz::scoped_write_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -611,44 +777,83 @@ void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const&
 		}
 		if (i != listing.size()) {
 			if (!listing[i].is_dir()) {
+				int64_t const oldSize = shared_size(*listing[i].ownerGroup);
 				listing.get(i).ownerGroup.get() = ownerGroup;
 				listing.ClearFindMap();
+				AdjustSize(const_cast<CCacheEntry&>(*iter), shared_size(*listing[i].ownerGroup) - oldSize);
 			}
 			return;
 		}
 	}
 
 	// We know nothing, be on the safe side and invalidate everything.
-	InvalidateServer(server);
+	DoInvalidateServer(server);
 }
 
 
 CDirectoryCache::tServerIter CDirectoryCache::CreateServerEntry(CServer const& server)
 {
-	for (tServerIter iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (iter->server.SameContent(server)) {
-			return iter;
-		}
+	tServerIter iter = GetServerEntry(server);
+	if (iter != m_serverList.end()) {
+		return iter;
 	}
+
 	m_serverList.emplace_back(server);
+	iter = --m_serverList.end();
+	m_serverIndex.emplace(hash_server(server), iter);
 
-	return --m_serverList.end();
+	return iter;
 }
 
 CDirectoryCache::tServerIter CDirectoryCache::GetServerEntry(CServer const& server)
 {
-	tServerIter iter;
-	for (iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (iter->server.SameContent(server)) {
+	auto range = m_serverIndex.equal_range(hash_server(server));
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second->server.SameContent(server)) {
+			return it->second;
+		}
+	}
+
+	return m_serverList.end();
+}
+
+void CDirectoryCache::RemoveServerEntry(tServerIter const& sit)
+{
+	auto range = m_serverIndex.equal_range(hash_server(sit->server));
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == sit) {
+			m_serverIndex.erase(it);
 			break;
 		}
 	}
+	m_serverList.erase(sit);
+}
 
-	return iter;
+void CDirectoryCache::RemoveCacheEntry(tServerIter const& sit, tCacheIter const& cit)
+{
+	m_totalFileCount -= cit->listing.size();
+	m_totalSize -= cit->size;
+
+	tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
+	if (lruIt) {
+		m_leastRecentlyUsedList.erase(*lruIt);
+		delete lruIt;
+	}
+
+	auto range = sit->pathIndex.equal_range(index_key(cit->listing.path));
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == cit) {
+			sit->pathIndex.erase(it);
+			break;
+		}
+	}
+	sit->cacheList.erase(cit);
 }
 
 void CDirectoryCache::UpdateLru(tServerIter const& sit, tCacheIter const& cit)
 {
+	fz::scoped_lock l(lru_mutex_);
+
 	tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
 	if (lruIt) {
 		m_leastRecentlyUsedList.splice(m_leastRecentlyUsedList.end(), m_leastRecentlyUsedList, *lruIt);
@@ -660,30 +865,92 @@ void CDirectoryCache::UpdateLru(tServerIter const& sit, tCacheIter const& cit)
 	}
 }
 
+void CDirectoryCache::CountHit(CCacheEntry const& entry, bool outdated)
+{
+	fz::scoped_lock l(lru_mutex_);
+
+	++hits_;
+	if (outdated) {
+		++outdated_;
+	}
+	++const_cast<CCacheEntry&>(entry).uses;
+}
+
+void CDirectoryCache::CountMiss()
+{
+	fz::scoped_lock l(lru_mutex_);
+
+	++misses_;
+}
+
+void CDirectoryCache::UpdateSize(CCacheEntry & entry)
+{
+	m_totalSize -= entry.size;
+	entry.size = static_cast<int64_t>(sizeof(CCacheEntry) + sizeof(tFullEntryPosition) + 8 * sizeof(void*)) + EstimateSize(entry.listing);
+	m_totalSize += entry.size;
+}
+
+void CDirectoryCache::AdjustSize(CCacheEntry & entry, int64_t delta)
+{
+	entry.size += delta;
+	m_totalSize += delta;
+}
+
 void CDirectoryCache::Prune()
 {
+	// The most recently used listing is never evicted, even if it alone
+	// exceeds the memory limit.
 	while ((m_leastRecentlyUsedList.size() > 50000) ||
 		(m_totalFileCount > 1000000 && m_leastRecentlyUsedList.size() > 1000) ||
-		(m_totalFileCount > 5000000 && m_leastRecentlyUsedList.size() > 100))
+		(m_totalFileCount > 5000000 && m_leastRecentlyUsedList.size() > 100) ||
+		(memoryLimit_ && m_totalSize > memoryLimit_ && m_leastRecentlyUsedList.size() > 1))
 	{
-		tFullEntryPosition pos = m_leastRecentlyUsedList.front();
-		tLruList::iterator* lruIt = (tLruList::iterator*)pos.second->lruIt;
-		delete lruIt;
+		Evict(SelectVictim());
+	}
+}
 
-		m_totalFileCount -= pos.second->listing.size();
+CDirectoryCache::tLruList::iterator CDirectoryCache::SelectVictim()
+{
+	auto victim = m_leastRecentlyUsedList.begin();
+	if (policy_ == eviction_policy::lru) {
+		return victim;
+	}
 
-		pos.first->cacheList.erase(pos.second);
-		if (pos.first->cacheList.empty()) {
-			m_serverList.erase(pos.first);
+	// Only look at a few of the least recently used listings, anything else
+	// was used too recently to be a good candidate.
+	auto const last = std::prev(m_leastRecentlyUsedList.end());
+	auto it = std::next(victim);
+	for (int i = 1; i < 8 && it != last; ++i, ++it) {
+		CCacheEntry const& candidate = *it->second;
+		CCacheEntry const& current = *victim->second;
+		if (policy_ == eviction_policy::size_aware) {
+			if (candidate.size > current.size) {
+				victim = it;
+			}
+		}
+		else if (candidate.uses < current.uses) {
+			victim = it;
 		}
+	}
+
+	return victim;
+}
 
-		m_leastRecentlyUsedList.pop_front();
+void CDirectoryCache::Evict(tLruList::iterator const& it)
+{
+	tFullEntryPosition pos = *it;
+
+	RemoveCacheEntry(pos.first, pos.second);
+	if (pos.first->cacheList.empty()) {
+		RemoveServerEntry(pos.first);
 	}
+
+	++evictions_;
 }
 
 void CDirectoryCache::SetTtl(fz::duration const& ttl)
 {
-	fz::scoped_lock lock(mutex_);
+	fz::scoped_write_lock lock(mutex_);
 
 	if (ttl < fz::duration::from_seconds(30)) {
 		ttl_ = fz::duration::from_seconds(30);
@@ -695,3 +962,138 @@ void CDirectoryCache::SetTtl(fz::duration const& ttl)
 		ttl_ = ttl;
 	}
 }
+
+void CDirectoryCache::SetMemoryLimit(int64_t limit)
+{
+	fz::scoped_write_lock lock(mutex_);
+
+	memoryLimit_ = (limit > 0) ? limit : 0;
+	Prune();
+}
+
+void CDirectoryCache::SetEvictionPolicy(eviction_policy policy)
+{
+	fz::scoped_write_lock lock(mutex_);
+
+	policy_ = policy;
+}
+
+directory_cache_stats CDirectoryCache::GetStats()
+{
+	fz::scoped_read_lock lock(mutex_);
+	fz::scoped_lock l(lru_mutex_);
+
+	directory_cache_stats stats;
+	stats.hits = hits_;
+	stats.misses = misses_;
+	stats.outdated = outdated_;
+	stats.evictions = evictions_;
+	stats.listings = m_leastRecentlyUsedList.size();
+	stats.files = m_totalFileCount;
+	stats.size = m_totalSize;
+	return stats;
+}
+
+void CDirectoryCache::SetPersistentDirectory(std::wstring const& dir)
+{
+	fz::scoped_write_lock lock(mutex_);
+
+	if (dir == persistDir_) {
+		return;
+	}
+
+	SavePersisted();
+	persistDir_ = dir;
+	m_persistChecked.clear();
+}
+
+bool CDirectoryCache::IsPersistChecked(size_t hash, CServer const& server) const
+{
+	auto range = m_persistChecked.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second.SameContent(server)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void CDirectoryCache::LoadPersisted(CServer const& server)
+{
+	size_t const hash = hash_server(server);
+	std::wstring dir;
+	{
+		fz::scoped_read_lock lock(mutex_);
+		if (persistDir_.empty() || IsPersistChecked(hash, server)) {
+			return;
+		}
+		dir = persistDir_;
+	}
+
+	// Read the file without holding the lock, other engines keep using the
+	// cache meanwhile.
+	std::vector<CDirectoryListing> listings;
+	bool const loaded = LoadDirectoryCacheFile(GetDirectoryCacheFileName(dir, server), server, listings);
+
+	fz::scoped_write_lock lock(mutex_);
+	if (persistDir_ != dir || IsPersistChecked(hash, server)) {
+		return;
+	}
+	m_persistChecked.emplace(hash, server);
+
+	if (!loaded || listings.empty()) {
+		return;
+	}
+
+	tServerIter sit = CreateServerEntry(server);
+	for (auto const& listing : listings) {
+		// Never replace what got listed in the meantime
+		CCacheEntry dummy;
+		dummy.listing.path = listing.path;
+		tCacheIter cit = sit->cacheList.lower_bound(dummy);
+		if (cit != sit->cacheList.end() && cit->listing.path == listing.path) {
+			continue;
+		}
+
+		cit = sit->cacheList.emplace_hint(cit, listing);
+		sit->pathIndex.emplace(index_key(listing.path), cit);
+
+		auto & entry = const_cast<CCacheEntry&>(*cit);
+		entry.persisted = true;
+		m_totalFileCount += listing.size();
+		UpdateSize(entry);
+		UpdateLru(sit, cit);
+	}
+
+	Prune();
+}
+
+void CDirectoryCache::SavePersisted()
+{
+	if (persistDir_.empty()) {
+		return;
+	}
+
+	for (auto const& checked : m_persistChecked) {
+		CServer const& server = checked.second;
+		std::wstring const file = GetDirectoryCacheFileName(persistDir_, server);
+
+		std::vector<CDirectoryListing const*> listings;
+		tServerIter sit = GetServerEntry(server);
+		if (sit != m_serverList.end()) {
+			for (auto const& entry : sit->cacheList) {
+				// Listings changed by our own operations may not match the server
+				if (!entry.listing.get_unsure_flags()) {
+					listings.push_back(&entry.listing);
+				}
+			}
+		}
+
+		if (listings.empty()) {
+			fz::remove_file(fz::to_native(file));
+		}
+		else {
+			SaveDirectoryCacheFile(file, server, listings);
+		}
+	}
+}
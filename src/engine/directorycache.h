@@ -6,6 +6,11 @@ This class is the directory cache used to store retrieved directory listings
 for further use.
 Directory get either purged from the cache if the maximum cache time exceeds,
 or on possible data inconsistencies.
+Once the estimated memory used by all cached listings exceeds the configured
+budget, listings get evicted according to the eviction policy.
+Optionally the cache is kept on disk across restarts. The listings of a
+server get loaded on its first lookup and are always reported as outdated
+until they have been listed again.
 For example since some servers are case sensitive and others aren't, a
 directory is removed from cache once an operation effects a file which matches
 multiple entries in a cache directory using a case insensitive search
@@ -15,11 +20,15 @@ version.
 */
 
 #include "../include/directorylisting.h"
+#include "../include/engine_context.h"
 
 #include <libfilezilla/mutex.hpp>
+#include <libfilezilla/rwmutex.hpp>
 
 #include <list>
+#include <map>
 #include <set>
+#include <unordered_map>
 
 enum class LookupFlags
 {
@@ -77,6 +86,18 @@ public:
 		dir
 	};
 
+	enum class eviction_policy
+	{
+		// Evicts the least recently used listing
+		lru,
+
+		// Of the least recently used listings, evicts the largest one
+		size_aware,
+
+		// Of the least recently used listings, evicts the least often used one
+		frequency_aware
+	};
+
 	CDirectoryCache();
 	~CDirectoryCache();
 
@@ -102,6 +123,15 @@ public:
 
 	void SetTtl(fz::duration const& ttl);
 
+	// Memory budget in bytes, 0 for no limit
+	void SetMemoryLimit(int64_t limit);
+	void SetEvictionPolicy(eviction_policy policy);
+
+	directory_cache_stats GetStats();
+
+	// Directory for the persistent cache, empty to disable it
+	void SetPersistentDirectory(std::wstring const& dir);
+
 protected:
 
 	class CCacheEntry final
@@ -119,6 +149,15 @@ protected:
 		CDirectoryListing listing;
 		fz::monotonic_clock modificationTime;
 
+		// Estimated memory footprint of the listing
+		int64_t size{};
+
+		// Number of times the listing got used
+		int64_t uses{};
+
+		// Loaded from the persistent cache
+		bool persisted{};
+
 		CCacheEntry& operator=(CCacheEntry const& a) = default;
 		CCacheEntry& operator=(CCacheEntry && a) noexcept = default;
 
@@ -139,33 +178,91 @@ protected:
 
 		CServer server;
 		std::set<CCacheEntry> cacheList;
+
+		// Keyed by the lowercase safe path. The safe path of a directory is a
+		// prefix of the safe paths of its subdirectories, so each subtree is a
+		// contiguous range.
+		std::multimap<std::wstring, std::set<CCacheEntry>::iterator> pathIndex;
 	};
 
 	typedef std::list<CServerEntry>::iterator tServerIter;
 
 	tServerIter CreateServerEntry(const CServer& server);
 	tServerIter GetServerEntry(const CServer& server);
+	void RemoveServerEntry(tServerIter const& sit);
 
 	typedef std::set<CCacheEntry>::iterator tCacheIter;
 	typedef std::set<CCacheEntry>::const_iterator tCacheConstIter;
 
 	bool Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated);
 
-	fz::mutex mutex_;
+	// Listings matching the path, ignoring case
+	std::vector<tCacheIter> FindNoCase(tServerIter const& sit, CServerPath const& path);
+
+	// Listings of subdirectories of the path
+	std::vector<tCacheIter> FindSubdirs(tServerIter const& sit, CServerPath const& path, bool cmpNoCase, bool allowEqual);
+
+	void RemoveCacheEntry(tServerIter const& sit, tCacheIter const& cit);
+
+	// Implementations of the public functions, the caller has to hold the write lock
+	void DoInvalidateServer(CServer const& server);
+	bool DoUpdateFile(CServer const& server, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size, std::wstring const& ownerGroup);
+	bool DoRemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename);
+	void DoRemoveDir(CServer const& server, CServerPath const& path, std::wstring const& filename);
+
+	// Lookups only need a read lock. Everything lookups still modify, such as
+	// the LRU list, the counters and the lazily built search maps of the
+	// listings, is guarded by lru_mutex_.
+	fz::rwmutex mutex_;
+	fz::mutex lru_mutex_;
 
 	std::list<CServerEntry> m_serverList;
 
-	void UpdateLru(tServerIter const& sit, tCacheIter const& cit);
+	// Hash of the server's address and user to the server entries
+	std::unordered_multimap<size_t, tServerIter> m_serverIndex;
 
-	void Prune();
+	void UpdateLru(tServerIter const& sit, tCacheIter const& cit);
 
 	typedef std::pair<tServerIter, tCacheIter> tFullEntryPosition;
 	typedef std::list<tFullEntryPosition> tLruList;
 	tLruList m_leastRecentlyUsedList;
 
+	void Prune();
+	tLruList::iterator SelectVictim();
+	void Evict(tLruList::iterator const& it);
+
+	// Recomputes the size of the entry after its listing has been replaced
+	void UpdateSize(CCacheEntry & entry);
+
+	// Adjusts the size of the entry after a change to a single file. The
+	// estimate may drift slightly until the listing gets stored again.
+	void AdjustSize(CCacheEntry & entry, int64_t delta);
+
+	void CountHit(CCacheEntry const& entry, bool outdated);
+	void CountMiss();
+
+	// Loads the persisted listings of the server unless already done. Must not
+	// be called with the lock held.
+	void LoadPersisted(CServer const& server);
+	bool IsPersistChecked(size_t hash, CServer const& server) const;
+	void SavePersisted();
+
 	int64_t m_totalFileCount{};
+	int64_t m_totalSize{};
 
 	fz::duration ttl_{fz::duration::from_seconds(600)};
+	int64_t memoryLimit_{256 * 1024 * 1024};
+	eviction_policy policy_{eviction_policy::lru};
+
+	int64_t hits_{};
+	int64_t misses_{};
+	int64_t outdated_{};
+	int64_t evictions_{};
+
+	std::wstring persistDir_;
+
+	// Servers whose persisted listings have already been loaded
+	std::unordered_multimap<size_t, CServer> m_persistChecked;
 };
 
 #endif
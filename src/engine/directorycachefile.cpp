@@ -0,0 +1,280 @@
+#include "filezilla.h"
+#include "directorycachefile.h"
+
+#include "../include/local_path.h"
+
+#include <libfilezilla/buffer.hpp>
+#include <libfilezilla/encode.hpp>
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/hash.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <algorithm>
+#include <limits>
+
+#include <string.h>
+
+namespace {
+unsigned char const magic[] = {'F', 'Z', 'D', 'C'};
+uint32_t const version = 1;
+
+std::wstring identity(CServer const& server)
+{
+	std::wstring ret = fz::sprintf(L"%d|%s|%u|%s|%d|%d|%s", static_cast<int>(server.GetProtocol()), server.GetHost(), server.GetPort(), server.GetUser(),
+		server.GetTimezoneOffset(), static_cast<int>(server.GetEncodingType()), server.GetCustomEncoding());
+	for (auto const& command : server.GetPostLoginCommands()) {
+		ret += L"|" + command;
+	}
+	for (auto const& param : server.GetExtraParameters()) {
+		ret += L"|" + fz::to_wstring(param.first) + L"=" + param.second;
+	}
+	return ret;
+}
+
+void put_u64(fz::buffer & buf, uint64_t v, size_t bytes = 8)
+{
+	unsigned char* p = buf.get(bytes);
+	for (size_t i = 0; i < bytes; ++i) {
+		p[i] = static_cast<unsigned char>(v >> (i * 8));
+	}
+	buf.add(bytes);
+}
+
+void put_u32(fz::buffer & buf, uint32_t v)
+{
+	put_u64(buf, v, 4);
+}
+
+void put_u8(fz::buffer & buf, uint8_t v)
+{
+	put_u64(buf, v, 1);
+}
+
+void put_string(fz::buffer & buf, std::wstring const& s)
+{
+	std::string const utf8 = fz::to_utf8(s);
+	put_u32(buf, static_cast<uint32_t>(utf8.size()));
+	buf.append(utf8);
+}
+
+struct reader final
+{
+	uint64_t u64(size_t bytes = 8)
+	{
+		if (left_ < bytes) {
+			ok_ = false;
+			return 0;
+		}
+		uint64_t v{};
+		for (size_t i = 0; i < bytes; ++i) {
+			v |= static_cast<uint64_t>(p_[i]) << (i * 8);
+		}
+		p_ += bytes;
+		left_ -= bytes;
+		return v;
+	}
+
+	uint32_t u32()
+	{
+		return static_cast<uint32_t>(u64(4));
+	}
+
+	uint8_t u8()
+	{
+		return static_cast<uint8_t>(u64(1));
+	}
+
+	std::wstring string()
+	{
+		size_t const size = u32();
+		if (left_ < size) {
+			ok_ = false;
+			return std::wstring();
+		}
+		std::wstring ret = fz::to_wstring_from_utf8(reinterpret_cast<char const*>(p_), size);
+		p_ += size;
+		left_ -= size;
+		return ret;
+	}
+
+	unsigned char const* p_{};
+	size_t left_{};
+	bool ok_{true};
+};
+
+// Shares identical permission and owner strings between loaded entries
+struct string_cache final
+{
+	fz::shared_value<std::wstring> const& get(std::wstring && v)
+	{
+		auto it = std::lower_bound(cache_.begin(), cache_.end(), v);
+		if (it == cache_.end() || !(*it == v)) {
+			it = cache_.emplace(it, std::move(v));
+		}
+		return *it;
+	}
+
+	std::vector<fz::shared_value<std::wstring>> cache_;
+};
+}
+
+std::wstring GetDirectoryCacheFileName(std::wstring const& dir, CServer const& server)
+{
+	CLocalPath path(dir);
+	if (path.empty()) {
+		return std::wstring();
+	}
+
+	auto const hash = fz::sha256(fz::to_utf8(identity(server)));
+	return path.GetPath() + fz::to_wstring(fz::hex_encode<std::string>(hash)) + L".dat";
+}
+
+bool SaveDirectoryCacheFile(std::wstring const& file, CServer const& server, std::vector<CDirectoryListing const*> const& listings)
+{
+	std::wstring name;
+	CLocalPath dir(file, &name);
+	if (dir.empty() || name.empty()) {
+		return false;
+	}
+	fz::mkdir(fz::to_native(dir.GetPath()), true, fz::mkdir_permissions::cur_user_and_admins);
+
+	fz::buffer buf;
+	buf.append(magic, sizeof(magic));
+	put_u32(buf, version);
+	put_string(buf, identity(server));
+
+	put_u32(buf, static_cast<uint32_t>(listings.size()));
+	for (auto const* listing : listings) {
+		put_string(buf, listing->path.GetSafePath());
+		put_u32(buf, static_cast<uint32_t>(listing->size()));
+		for (size_t i = 0; i < listing->size(); ++i) {
+			CDirentry const& entry = (*listing)[i];
+			put_string(buf, entry.name);
+			put_u64(buf, static_cast<uint64_t>(entry.size));
+			put_string(buf, *entry.permissions);
+			put_string(buf, *entry.ownerGroup);
+			put_u32(buf, static_cast<uint32_t>(entry.flags & ~CDirentry::flag_unsure));
+			put_u8(buf, entry.target ? 1 : 0);
+			if (entry.target) {
+				put_string(buf, *entry.target);
+			}
+			put_u8(buf, entry.time.empty() ? 0 : static_cast<uint8_t>(entry.time.get_accuracy() + 1));
+			if (!entry.time.empty()) {
+				put_u64(buf, static_cast<uint64_t>(entry.time.get_time_t()));
+				put_u32(buf, static_cast<uint32_t>(entry.time.get_milliseconds()));
+			}
+		}
+	}
+
+	// Write to a temporary file first, an interrupted save must not leave
+	// a truncated file behind.
+	std::wstring const temp = file + L".tmp";
+	{
+		fz::file f;
+		if (!f.open(fz::to_native(temp), fz::file::writing, static_cast<fz::file::creation_flags>(fz::file::empty | fz::file::current_user_and_admins_only))) {
+			return false;
+		}
+		if (f.write(buf.get(), static_cast<int64_t>(buf.size())) != static_cast<int64_t>(buf.size()) || !f.fsync()) {
+			f.close();
+			fz::remove_file(fz::to_native(temp));
+			return false;
+		}
+	}
+
+	if (!fz::rename_file(fz::to_native(temp), fz::to_native(file))) {
+		fz::remove_file(fz::to_native(temp));
+		return false;
+	}
+
+	return true;
+}
+
+bool LoadDirectoryCacheFile(std::wstring const& file, CServer const& server, std::vector<CDirectoryListing> & listings)
+{
+	listings.clear();
+
+	if (file.empty()) {
+		return false;
+	}
+
+	fz::file f;
+	if (!f.open(fz::to_native(file), fz::file::reading, fz::file::existing)) {
+		return false;
+	}
+	int64_t const size = f.size();
+	if (size < static_cast<int64_t>(sizeof(magic)) || static_cast<uint64_t>(size) > std::numeric_limits<size_t>::max()) {
+		return false;
+	}
+
+	fz::buffer buf;
+	if (f.read(buf.get(static_cast<size_t>(size)), size) != size) {
+		return false;
+	}
+	buf.add(static_cast<size_t>(size));
+
+	if (memcmp(buf.get(), magic, sizeof(magic))) {
+		return false;
+	}
+
+	reader r;
+	r.p_ = buf.get() + sizeof(magic);
+	r.left_ = buf.size() - sizeof(magic);
+
+	if (r.u32() != version || r.string() != identity(server) || !r.ok_) {
+		return false;
+	}
+
+	string_cache cache;
+	auto const now = fz::monotonic_clock::now();
+
+	uint32_t const count = r.u32();
+	for (uint32_t l = 0; l < count && r.ok_; ++l) {
+		CDirectoryListing listing;
+		if (!listing.path.SetSafePath(r.string())) {
+			return false;
+		}
+		listing.m_firstListTime = now;
+
+		uint32_t const entryCount = r.u32();
+
+		std::vector<fz::shared_value<CDirentry>> entries;
+		// Every entry needs at least 26 bytes, don't trust the count blindly.
+		entries.reserve(std::min(static_cast<size_t>(entryCount), r.left_ / 26));
+		for (uint32_t i = 0; i < entryCount && r.ok_; ++i) {
+			fz::shared_value<CDirentry> refEntry;
+			CDirentry & entry = refEntry.get();
+			entry.name = r.string();
+			entry.size = static_cast<int64_t>(r.u64());
+			entry.permissions = cache.get(r.string());
+			entry.ownerGroup = cache.get(r.string());
+			entry.flags = static_cast<int>(r.u32());
+			if (r.u8()) {
+				entry.target = r.string();
+			}
+			uint8_t const accuracy = r.u8();
+			if (accuracy) {
+				time_t const t = static_cast<time_t>(r.u64());
+				int const ms = static_cast<int>(r.u32());
+				entry.time = fz::datetime(t, static_cast<fz::datetime::accuracy>(accuracy - 1));
+				if (ms) {
+					entry.time += fz::duration::from_milliseconds(ms);
+				}
+			}
+			entries.emplace_back(std::move(refEntry));
+		}
+		if (!r.ok_) {
+			break;
+		}
+
+		listing.Assign(std::move(entries));
+		listings.emplace_back(std::move(listing));
+	}
+
+	if (!r.ok_) {
+		listings.clear();
+		return false;
+	}
+
+	return true;
+}
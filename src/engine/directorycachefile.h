@@ -0,0 +1,22 @@
+#ifndef FILEZILLA_ENGINE_DIRECTORYCACHEFILE_HEADER
+#define FILEZILLA_ENGINE_DIRECTORYCACHEFILE_HEADER
+
+/*
+Storage for the persistent directory cache. All listings of a server are
+kept in a single binary file in the cache directory, named after a hash of
+the server. The file repeats the server's identity, a hash collision thus
+cannot return listings of a different server.
+*/
+
+#include "../include/directorylisting.h"
+
+class CServer;
+
+std::wstring GetDirectoryCacheFileName(std::wstring const& dir, CServer const& server);
+
+bool SaveDirectoryCacheFile(std::wstring const& file, CServer const& server, std::vector<CDirectoryListing const*> const& listings);
+
+// Fails if the file does not exist, is corrupt or belongs to a different server
+bool LoadDirectoryCacheFile(std::wstring const& file, CServer const& server, std::vector<CDirectoryListing> & listings);
+
+#endif
@@ -71,6 +71,7 @@ void CDirectoryListing::Assign(std::vector<fz::shared_value<CDirentry>> && entri
 {
 	std::vector<fz::shared_value<CDirentry>> & own_entries = m_entries.get();
 	own_entries = std::move(entries);
+	own_entries.shrink_to_fit();
 
 	m_flags &= ~(listing_has_dirs | listing_has_perms | listing_has_usergroup);
 
@@ -120,87 +121,111 @@ void CDirectoryListing::GetFilenames(std::vector<std::wstring> &names) const
 	}
 }
 
-size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
+namespace {
+uint32_t hash_name(std::wstring const& name)
 {
-	if (!m_entries || m_entries->empty()) {
-		return std::string::npos;
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (auto const c : name) {
+		hash ^= static_cast<uint32_t>(c);
+		hash *= 16777619u;
 	}
+	return hash;
+}
 
-	if (!m_searchmap_case) {
-		m_searchmap_case.get();
+template<typename Key>
+void build_searchmap(std::vector<uint64_t> & slots, std::vector<fz::shared_value<CDirentry>> const& entries, Key const& key)
+{
+	// Load factor of at most one half keeps the probe sequences short
+	size_t capacity = 16;
+	while (capacity < entries.size() * 2) {
+		capacity <<= 1;
 	}
-
-	// Search map
-	auto iter = m_searchmap_case->find(name);
-	if (iter != m_searchmap_case->end()) {
-		return iter->second;
+	size_t const mask = capacity - 1;
+
+	slots.assign(capacity, 0);
+	for (size_t i = 0; i < entries.size(); ++i) {
+		uint32_t const hash = hash_name(key(entries[i]->name));
+		size_t pos = hash & mask;
+		while (slots[pos]) {
+			pos = (pos + 1) & mask;
+		}
+		slots[pos] = (static_cast<uint64_t>(hash) << 32) | static_cast<uint64_t>(i + 1);
 	}
+}
 
-	size_t i = m_searchmap_case->size();
-	if (i == m_entries->size()) {
-		return std::string::npos;
+// Adds an entry appended after the map got built. Returns false if the map
+// would exceed its load factor, it then needs to be rebuilt.
+bool add_to_searchmap(std::vector<uint64_t> & slots, uint32_t hash, size_t index)
+{
+	if ((index + 1) * 2 > slots.size()) {
+		return false;
 	}
 
-	auto & searchmap_case = m_searchmap_case.get();
-
-	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring const& entry_name = (*entry_iter)->name;
-		searchmap_case.emplace(entry_name, i);
+	size_t const mask = slots.size() - 1;
+	size_t pos = hash & mask;
+	while (slots[pos]) {
+		pos = (pos + 1) & mask;
+	}
+	slots[pos] = (static_cast<uint64_t>(hash) << 32) | static_cast<uint64_t>(index + 1);
+	return true;
+}
 
-		if (entry_name == name) {
-			return i;
+// Entries get inserted in order, so for duplicate names the first match is
+// the one with the lowest index.
+template<typename Match>
+size_t find_in_searchmap(std::vector<uint64_t> const& slots, uint32_t hash, Match const& match)
+{
+	size_t const mask = slots.size() - 1;
+	for (size_t pos = hash & mask; slots[pos]; pos = (pos + 1) & mask) {
+		if (static_cast<uint32_t>(slots[pos] >> 32) == hash) {
+			size_t const index = static_cast<size_t>(slots[pos] & 0xffffffffu) - 1;
+			if (match(index)) {
+				return index;
+			}
 		}
 	}
-
-	// Map is complete, item not in it
-	return std::string::npos;
+	return std::wstring::npos;
+}
 }
 
-size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
+size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
 {
 	if (!m_entries || m_entries->empty()) {
-		return std::string::npos;
+		return std::wstring::npos;
 	}
 
-	if (!m_searchmap_nocase) {
-		m_searchmap_nocase.get();
+	if (!m_searchmap_case) {
+		build_searchmap(m_searchmap_case.get(), *m_entries, [](std::wstring const& n) -> std::wstring const& { return n; });
 	}
 
-	std::wstring lwr = fz::str_tolower(name);
+	auto const& entries = *m_entries;
+	return find_in_searchmap(*m_searchmap_case, hash_name(name), [&](size_t index) {
+		return entries[index]->name == name;
+	});
+}
 
-	// Search map
-	auto iter = m_searchmap_nocase->find(lwr);
-	if (iter != m_searchmap_nocase->end()) {
-		return iter->second;
+size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
+{
+	if (!m_entries || m_entries->empty()) {
+		return std::wstring::npos;
 	}
 
-	size_t i = m_searchmap_nocase->size();
-	if (i == m_entries->size()) {
-		return std::string::npos;
+	if (!m_searchmap_nocase) {
+		build_searchmap(m_searchmap_nocase.get(), *m_entries, [](std::wstring const& n) { return fz::str_tolower(n); });
 	}
 
-	auto& searchmap_nocase = m_searchmap_nocase.get();
-
-	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring entry_lrw = fz::str_tolower((*entry_iter)->name);
-		searchmap_nocase.emplace(entry_lrw, i);
-
-		if (entry_lrw == lwr) {
-			return i;
-		}
-	}
+	std::wstring const lwr = fz::str_tolower(name);
 
-	// Map is complete, item not in it
-	return std::string::npos;
+	auto const& entries = *m_entries;
+	return find_in_searchmap(*m_searchmap_nocase, hash_name(lwr), [&](size_t index) {
+		return fz::str_tolower(entries[index]->name) == lwr;
+	});
 }
 
 void CDirectoryListing::ClearFindMap()
 {
-	if (!m_searchmap_case) {
+	if (!m_searchmap_case && !m_searchmap_nocase) {
 		return;
 	}
 
@@ -210,7 +235,39 @@ void CDirectoryListing::ClearFindMap()
 
 void CDirectoryListing::Append(CDirentry&& entry)
 {
-	m_entries.get().emplace_back(entry);
+	auto & entries = m_entries.get();
+	entries.emplace_back(std::move(entry));
+
+	// The directory cache appends single files to listings that have been
+	// searched before, update built maps instead of discarding them.
+	size_t const index = entries.size() - 1;
+	std::wstring const& name = entries.back()->name;
+	if (m_searchmap_case && !add_to_searchmap(m_searchmap_case.get(), hash_name(name), index)) {
+		m_searchmap_case.clear();
+	}
+	if (m_searchmap_nocase && !add_to_searchmap(m_searchmap_nocase.get(), hash_name(fz::str_tolower(name)), index)) {
+		m_searchmap_nocase.clear();
+	}
+}
+
+void CDirectoryListing::Append(std::vector<fz::shared_value<CDirentry>> const& entries)
+{
+	std::vector<fz::shared_value<CDirentry>> & own_entries = m_entries.get();
+	own_entries.insert(own_entries.end(), entries.begin(), entries.end());
+
+	for (auto const& entry : entries) {
+		if (entry->is_dir()) {
+			m_flags |= listing_has_dirs;
+		}
+		if (!entry->permissions->empty()) {
+			m_flags |= listing_has_perms;
+		}
+		if (!entry->ownerGroup->empty()) {
+			m_flags |= listing_has_usergroup;
+		}
+	}
+
+	ClearFindMap();
 }
 
 bool CheckInclusion(const CDirectoryListing& listing1, const CDirectoryListing& listing2)
@@ -1,4 +1,5 @@
 #include "filezilla.h"
+#include "byte_scan.h"
 #include "directorylistingparser.h"
 #include "controlsocket.h"
 
@@ -11,7 +12,234 @@
 #include <assert.h>
 #include <string.h>
 
-std::map<std::wstring, int> CDirectoryListingParser::m_MonthNamesMap;
+namespace {
+// Built on first use. Parsers get created on the event loops of all
+// engines, the initialization of the static makes this thread-safe.
+std::map<std::wstring, int> const& month_names()
+{
+	static std::map<std::wstring, int> const map = [] {
+		std::map<std::wstring, int> names;
+
+		//English month names
+		names[L"jan"] = 1;
+		names[L"feb"] = 2;
+		names[L"mar"] = 3;
+		names[L"apr"] = 4;
+		names[L"may"] = 5;
+		names[L"jun"] = 6;
+		names[L"june"] = 6;
+		names[L"jul"] = 7;
+		names[L"july"] = 7;
+		names[L"aug"] = 8;
+		names[L"sep"] = 9;
+		names[L"sept"] = 9;
+		names[L"oct"] = 10;
+		names[L"nov"] = 11;
+		names[L"dec"] = 12;
+
+		//Numerical values for the month
+		names[L"1"] = 1;
+		names[L"01"] = 1;
+		names[L"2"] = 2;
+		names[L"02"] = 2;
+		names[L"3"] = 3;
+		names[L"03"] = 3;
+		names[L"4"] = 4;
+		names[L"04"] = 4;
+		names[L"5"] = 5;
+		names[L"05"] = 5;
+		names[L"6"] = 6;
+		names[L"06"] = 6;
+		names[L"7"] = 7;
+		names[L"07"] = 7;
+		names[L"8"] = 8;
+		names[L"08"] = 8;
+		names[L"9"] = 9;
+		names[L"09"] = 9;
+		names[L"10"] = 10;
+		names[L"11"] = 11;
+		names[L"12"] = 12;
+
+		//German month names
+		names[L"mrz"] = 3;
+		names[L"m\xe4r"] = 3;
+		names[L"m\xe4rz"] = 3;
+		names[L"mai"] = 5;
+		names[L"juni"] = 6;
+		names[L"juli"] = 7;
+		names[L"okt"] = 10;
+		names[L"dez"] = 12;
+
+		//Austrian month names
+		names[L"j\xe4n"] = 1;
+
+		//French month names
+		names[L"janv"] = 1;
+		names[L"f\xe9" L"b"] = 1;
+		names[L"f\xe9v"] = 2;
+		names[L"fev"] = 2;
+		names[L"f\xe9vr"] = 2;
+		names[L"fevr"] = 2;
+		names[L"mars"] = 3;
+		names[L"mrs"] = 3;
+		names[L"avr"] = 4;
+		names[L"avril"] = 4;
+		names[L"juin"] = 6;
+		names[L"juil"] = 7;
+		names[L"jui"] = 7;
+		names[L"ao\xfb"] = 8;
+		names[L"ao\xfbt"] = 8;
+		names[L"aout"] = 8;
+		names[L"d\xe9" L"c"] = 12;
+		names[L"dec"] = 12;
+
+		//Italian month names
+		names[L"gen"] = 1;
+		names[L"mag"] = 5;
+		names[L"giu"] = 6;
+		names[L"lug"] = 7;
+		names[L"ago"] = 8;
+		names[L"set"] = 9;
+		names[L"ott"] = 10;
+		names[L"dic"] = 12;
+
+		//Spanish month names
+		names[L"ene"] = 1;
+		names[L"fbro"] = 2;
+		names[L"mzo"] = 3;
+		names[L"ab"] = 4;
+		names[L"abr"] = 4;
+		names[L"agto"] = 8;
+		names[L"sbre"] = 9;
+		names[L"obre"] = 9;
+		names[L"nbre"] = 9;
+		names[L"dbre"] = 9;
+
+		//Polish month names
+		names[L"sty"] = 1;
+		names[L"lut"] = 2;
+		names[L"kwi"] = 4;
+		names[L"maj"] = 5;
+		names[L"cze"] = 6;
+		names[L"lip"] = 7;
+		names[L"sie"] = 8;
+		names[L"wrz"] = 9;
+		names[L"pa\x9f"] = 10;
+		names[L"pa\xbc"] = 10; // ISO-8859-2
+		names[L"paz"] = 10; // ASCII
+		names[L"pa\xc5\xba"] = 10; // UTF-8
+		names[L"pa\x017a"] = 10; // some servers send this
+		names[L"lis"] = 11;
+		names[L"gru"] = 12;
+
+		//Russian month names
+		names[L"\xff\xed\xe2"] = 1;
+		names[L"\xf4\xe5\xe2"] = 2;
+		names[L"\xec\xe0\xf0"] = 3;
+		names[L"\xe0\xef\xf0"] = 4;
+		names[L"\xec\xe0\xe9"] = 5;
+		names[L"\xe8\xfe\xed"] = 6;
+		names[L"\xe8\xfe\xeb"] = 7;
+		names[L"\xe0\xe2\xe3"] = 8;
+		names[L"\xf1\xe5\xed"] = 9;
+		names[L"\xee\xea\xf2"] = 10;
+		names[L"\xed\xee\xff"] = 11;
+		names[L"\xe4\xe5\xea"] = 12;
+
+		//Dutch month names
+		names[L"mrt"] = 3;
+		names[L"mei"] = 5;
+
+		//Portuguese month names
+		names[L"out"] = 10;
+
+		//Finnish month names
+		names[L"tammi"] = 1;
+		names[L"helmi"] = 2;
+		names[L"maalis"] = 3;
+		names[L"huhti"] = 4;
+		names[L"touko"] = 5;
+		names[L"kes\xe4"] = 6;
+		names[L"hein\xe4"] = 7;
+		names[L"elo"] = 8;
+		names[L"syys"] = 9;
+		names[L"loka"] = 10;
+		names[L"marras"] = 11;
+		names[L"joulu"] = 12;
+
+		//Slovenian month names
+		names[L"avg"] = 8;
+
+		//Icelandic
+		names[L"ma\x00ed"] = 5;
+		names[L"j\x00fan"] = 6;
+		names[L"j\x00fal"] = 7;
+		names[L"\x00e1g"] = 8;
+		names[L"n\x00f3v"] = 11;
+		names[L"des"] = 12;
+
+		//Lithuanian
+		names[L"sau"] = 1;
+		names[L"vas"] = 2;
+		names[L"kov"] = 3;
+		names[L"bal"] = 4;
+		names[L"geg"] = 5;
+		names[L"bir"] = 6;
+		names[L"lie"] = 7;
+		names[L"rgp"] = 8;
+		names[L"rgs"] = 9;
+		names[L"spa"] = 10;
+		names[L"lap"] = 11;
+		names[L"grd"] = 12;
+
+		// Hungarian
+		names[L"szept"] = 9;
+
+		//There are more languages and thus month
+		//names, but as long as nobody reports a
+		//problem, I won't add them, there are way
+		//too many languages
+
+		// Some servers send a combination of month name and number,
+		// Add corresponding numbers to the month names.
+		std::map<std::wstring, int> combo;
+		for (auto iter = names.begin(); iter != names.end(); ++iter) {
+			// January could be 1 or 0, depends how the server counts
+			combo[fz::sprintf(L"%s%02d", iter->first, iter->second)] = iter->second;
+			combo[fz::sprintf(L"%s%02d", iter->first, iter->second - 1)] = iter->second;
+			if (iter->second < 10) {
+				combo[fz::sprintf(L"%s%d", iter->first, iter->second)] = iter->second;
+			}
+			else {
+				combo[fz::sprintf(L"%s%d", iter->first, iter->second % 10)] = iter->second;
+			}
+			if (iter->second <= 10) {
+				combo[fz::sprintf(L"%s%d", iter->first, iter->second - 1)] = iter->second;
+			}
+			else {
+				combo[fz::sprintf(L"%s%d", iter->first, (iter->second - 1) % 10)] = iter->second;
+			}
+		}
+		names.insert(combo.begin(), combo.end());
+
+		names[L"1"] = 1;
+		names[L"2"] = 2;
+		names[L"3"] = 3;
+		names[L"4"] = 4;
+		names[L"5"] = 5;
+		names[L"6"] = 6;
+		names[L"7"] = 7;
+		names[L"8"] = 8;
+		names[L"9"] = 9;
+		names[L"10"] = 10;
+		names[L"11"] = 11;
+		names[L"12"] = 12;
+
+		return names;
+	}();
+	return map;
+}
+}
 
 //#define LISTDEBUG_MVS
 //#define LISTDEBUG
@@ -52,7 +280,8 @@ struct ObjectCache
 };
 
 
-ObjectCache objcache;
+// Per thread, as engines may run on multiple event loops
+thread_local ObjectCache objcache;
 }
 
 class CToken final
@@ -317,7 +546,7 @@ class CLine final
 public:
 	CLine(std::wstring && line, size_t trailing_whitespace = std::string::npos)
 		: trailing_whitespace_(trailing_whitespace)
-		, line_(line)
+		, line_(std::move(line))
 	{
 		m_Tokens.reserve(10);
 		m_LineEndTokens.reserve(10);
@@ -428,16 +657,19 @@ public:
 		return token.operator bool();
 	}
 
-	CLine *Concat(CLine const* pLine) const
+	// Returns the concatenation of the given previous line and this line
+	CLine Prepend(std::wstring const& prev) const
 	{
 		std::wstring n;
-		n.reserve(line_.size() + pLine->line_.size() + 1);
-		n = line_;
+		n.reserve(prev.size() + line_.size() + 1);
+		n = prev;
 		n += ' ';
-		n += pLine->line_;
-		return new CLine(std::move(n), pLine->trailing_whitespace_);
+		n += line_;
+		return CLine(std::move(n), trailing_whitespace_);
 	}
 
+	std::wstring const& str() const { return line_; }
+
 protected:
 	std::vector<CToken> m_Tokens;
 	std::vector<CToken> m_LineEndTokens;
@@ -451,243 +683,16 @@ CDirectoryListingParser::CDirectoryListingParser(CControlSocket* pControlSocket,
 	, m_server(server)
 	, m_listingEncoding(encoding)
 {
-	if (m_MonthNamesMap.empty()) {
-		//Fill the month names map
-
-		//English month names
-		m_MonthNamesMap[L"jan"] = 1;
-		m_MonthNamesMap[L"feb"] = 2;
-		m_MonthNamesMap[L"mar"] = 3;
-		m_MonthNamesMap[L"apr"] = 4;
-		m_MonthNamesMap[L"may"] = 5;
-		m_MonthNamesMap[L"jun"] = 6;
-		m_MonthNamesMap[L"june"] = 6;
-		m_MonthNamesMap[L"jul"] = 7;
-		m_MonthNamesMap[L"july"] = 7;
-		m_MonthNamesMap[L"aug"] = 8;
-		m_MonthNamesMap[L"sep"] = 9;
-		m_MonthNamesMap[L"sept"] = 9;
-		m_MonthNamesMap[L"oct"] = 10;
-		m_MonthNamesMap[L"nov"] = 11;
-		m_MonthNamesMap[L"dec"] = 12;
-
-		//Numerical values for the month
-		m_MonthNamesMap[L"1"] = 1;
-		m_MonthNamesMap[L"01"] = 1;
-		m_MonthNamesMap[L"2"] = 2;
-		m_MonthNamesMap[L"02"] = 2;
-		m_MonthNamesMap[L"3"] = 3;
-		m_MonthNamesMap[L"03"] = 3;
-		m_MonthNamesMap[L"4"] = 4;
-		m_MonthNamesMap[L"04"] = 4;
-		m_MonthNamesMap[L"5"] = 5;
-		m_MonthNamesMap[L"05"] = 5;
-		m_MonthNamesMap[L"6"] = 6;
-		m_MonthNamesMap[L"06"] = 6;
-		m_MonthNamesMap[L"7"] = 7;
-		m_MonthNamesMap[L"07"] = 7;
-		m_MonthNamesMap[L"8"] = 8;
-		m_MonthNamesMap[L"08"] = 8;
-		m_MonthNamesMap[L"9"] = 9;
-		m_MonthNamesMap[L"09"] = 9;
-		m_MonthNamesMap[L"10"] = 10;
-		m_MonthNamesMap[L"11"] = 11;
-		m_MonthNamesMap[L"12"] = 12;
-
-		//German month names
-		m_MonthNamesMap[L"mrz"] = 3;
-		m_MonthNamesMap[L"m\xe4r"] = 3;
-		m_MonthNamesMap[L"m\xe4rz"] = 3;
-		m_MonthNamesMap[L"mai"] = 5;
-		m_MonthNamesMap[L"juni"] = 6;
-		m_MonthNamesMap[L"juli"] = 7;
-		m_MonthNamesMap[L"okt"] = 10;
-		m_MonthNamesMap[L"dez"] = 12;
-
-		//Austrian month names
-		m_MonthNamesMap[L"j\xe4n"] = 1;
-
-		//French month names
-		m_MonthNamesMap[L"janv"] = 1;
-		m_MonthNamesMap[L"f\xe9" L"b"] = 1;
-		m_MonthNamesMap[L"f\xe9v"] = 2;
-		m_MonthNamesMap[L"fev"] = 2;
-		m_MonthNamesMap[L"f\xe9vr"] = 2;
-		m_MonthNamesMap[L"fevr"] = 2;
-		m_MonthNamesMap[L"mars"] = 3;
-		m_MonthNamesMap[L"mrs"] = 3;
-		m_MonthNamesMap[L"avr"] = 4;
-		m_MonthNamesMap[L"avril"] = 4;
-		m_MonthNamesMap[L"juin"] = 6;
-		m_MonthNamesMap[L"juil"] = 7;
-		m_MonthNamesMap[L"jui"] = 7;
-		m_MonthNamesMap[L"ao\xfb"] = 8;
-		m_MonthNamesMap[L"ao\xfbt"] = 8;
-		m_MonthNamesMap[L"aout"] = 8;
-		m_MonthNamesMap[L"d\xe9" L"c"] = 12;
-		m_MonthNamesMap[L"dec"] = 12;
-
-		//Italian month names
-		m_MonthNamesMap[L"gen"] = 1;
-		m_MonthNamesMap[L"mag"] = 5;
-		m_MonthNamesMap[L"giu"] = 6;
-		m_MonthNamesMap[L"lug"] = 7;
-		m_MonthNamesMap[L"ago"] = 8;
-		m_MonthNamesMap[L"set"] = 9;
-		m_MonthNamesMap[L"ott"] = 10;
-		m_MonthNamesMap[L"dic"] = 12;
-
-		//Spanish month names
-		m_MonthNamesMap[L"ene"] = 1;
-		m_MonthNamesMap[L"fbro"] = 2;
-		m_MonthNamesMap[L"mzo"] = 3;
-		m_MonthNamesMap[L"ab"] = 4;
-		m_MonthNamesMap[L"abr"] = 4;
-		m_MonthNamesMap[L"agto"] = 8;
-		m_MonthNamesMap[L"sbre"] = 9;
-		m_MonthNamesMap[L"obre"] = 9;
-		m_MonthNamesMap[L"nbre"] = 9;
-		m_MonthNamesMap[L"dbre"] = 9;
-
-		//Polish month names
-		m_MonthNamesMap[L"sty"] = 1;
-		m_MonthNamesMap[L"lut"] = 2;
-		m_MonthNamesMap[L"kwi"] = 4;
-		m_MonthNamesMap[L"maj"] = 5;
-		m_MonthNamesMap[L"cze"] = 6;
-		m_MonthNamesMap[L"lip"] = 7;
-		m_MonthNamesMap[L"sie"] = 8;
-		m_MonthNamesMap[L"wrz"] = 9;
-		m_MonthNamesMap[L"pa\x9f"] = 10;
-		m_MonthNamesMap[L"pa\xbc"] = 10; // ISO-8859-2
-		m_MonthNamesMap[L"paz"] = 10; // ASCII
-		m_MonthNamesMap[L"pa\xc5\xba"] = 10; // UTF-8
-		m_MonthNamesMap[L"pa\x017a"] = 10; // some servers send this
-		m_MonthNamesMap[L"lis"] = 11;
-		m_MonthNamesMap[L"gru"] = 12;
-
-		//Russian month names
-		m_MonthNamesMap[L"\xff\xed\xe2"] = 1;
-		m_MonthNamesMap[L"\xf4\xe5\xe2"] = 2;
-		m_MonthNamesMap[L"\xec\xe0\xf0"] = 3;
-		m_MonthNamesMap[L"\xe0\xef\xf0"] = 4;
-		m_MonthNamesMap[L"\xec\xe0\xe9"] = 5;
-		m_MonthNamesMap[L"\xe8\xfe\xed"] = 6;
-		m_MonthNamesMap[L"\xe8\xfe\xeb"] = 7;
-		m_MonthNamesMap[L"\xe0\xe2\xe3"] = 8;
-		m_MonthNamesMap[L"\xf1\xe5\xed"] = 9;
-		m_MonthNamesMap[L"\xee\xea\xf2"] = 10;
-		m_MonthNamesMap[L"\xed\xee\xff"] = 11;
-		m_MonthNamesMap[L"\xe4\xe5\xea"] = 12;
-
-		//Dutch month names
-		m_MonthNamesMap[L"mrt"] = 3;
-		m_MonthNamesMap[L"mei"] = 5;
-
-		//Portuguese month names
-		m_MonthNamesMap[L"out"] = 10;
-
-		//Finnish month names
-		m_MonthNamesMap[L"tammi"] = 1;
-		m_MonthNamesMap[L"helmi"] = 2;
-		m_MonthNamesMap[L"maalis"] = 3;
-		m_MonthNamesMap[L"huhti"] = 4;
-		m_MonthNamesMap[L"touko"] = 5;
-		m_MonthNamesMap[L"kes\xe4"] = 6;
-		m_MonthNamesMap[L"hein\xe4"] = 7;
-		m_MonthNamesMap[L"elo"] = 8;
-		m_MonthNamesMap[L"syys"] = 9;
-		m_MonthNamesMap[L"loka"] = 10;
-		m_MonthNamesMap[L"marras"] = 11;
-		m_MonthNamesMap[L"joulu"] = 12;
-
-		//Slovenian month names
-		m_MonthNamesMap[L"avg"] = 8;
-
-		//Icelandic
-		m_MonthNamesMap[L"ma\x00ed"] = 5;
-		m_MonthNamesMap[L"j\x00fan"] = 6;
-		m_MonthNamesMap[L"j\x00fal"] = 7;
-		m_MonthNamesMap[L"\x00e1g"] = 8;
-		m_MonthNamesMap[L"n\x00f3v"] = 11;
-		m_MonthNamesMap[L"des"] = 12;
-
-		//Lithuanian
-		m_MonthNamesMap[L"sau"] = 1;
-		m_MonthNamesMap[L"vas"] = 2;
-		m_MonthNamesMap[L"kov"] = 3;
-		m_MonthNamesMap[L"bal"] = 4;
-		m_MonthNamesMap[L"geg"] = 5;
-		m_MonthNamesMap[L"bir"] = 6;
-		m_MonthNamesMap[L"lie"] = 7;
-		m_MonthNamesMap[L"rgp"] = 8;
-		m_MonthNamesMap[L"rgs"] = 9;
-		m_MonthNamesMap[L"spa"] = 10;
-		m_MonthNamesMap[L"lap"] = 11;
-		m_MonthNamesMap[L"grd"] = 12;
-
-		// Hungarian
-		m_MonthNamesMap[L"szept"] = 9;
-
-		//There are more languages and thus month
-		//names, but as long as nobody reports a
-		//problem, I won't add them, there are way
-		//too many languages
-
-		// Some servers send a combination of month name and number,
-		// Add corresponding numbers to the month names.
-		std::map<std::wstring, int> combo;
-		for (auto iter = m_MonthNamesMap.begin(); iter != m_MonthNamesMap.end(); ++iter) {
-			// January could be 1 or 0, depends how the server counts
-			combo[fz::sprintf(L"%s%02d", iter->first, iter->second)] = iter->second;
-			combo[fz::sprintf(L"%s%02d", iter->first, iter->second - 1)] = iter->second;
-			if (iter->second < 10) {
-				combo[fz::sprintf(L"%s%d", iter->first, iter->second)] = iter->second;
-			}
-			else {
-				combo[fz::sprintf(L"%s%d", iter->first, iter->second % 10)] = iter->second;
-			}
-			if (iter->second <= 10) {
-				combo[fz::sprintf(L"%s%d", iter->first, iter->second - 1)] = iter->second;
-			}
-			else {
-				combo[fz::sprintf(L"%s%d", iter->first, (iter->second - 1) % 10)] = iter->second;
-			}
-		}
-		m_MonthNamesMap.insert(combo.begin(), combo.end());
-
-		m_MonthNamesMap[L"1"] = 1;
-		m_MonthNamesMap[L"2"] = 2;
-		m_MonthNamesMap[L"3"] = 3;
-		m_MonthNamesMap[L"4"] = 4;
-		m_MonthNamesMap[L"5"] = 5;
-		m_MonthNamesMap[L"6"] = 6;
-		m_MonthNamesMap[L"7"] = 7;
-		m_MonthNamesMap[L"8"] = 8;
-		m_MonthNamesMap[L"9"] = 9;
-		m_MonthNamesMap[L"10"] = 10;
-		m_MonthNamesMap[L"11"] = 11;
-		m_MonthNamesMap[L"12"] = 12;
-	}
-
 #ifdef LISTDEBUG
 	for (unsigned int i = 0; data[i][0]; ++i) {
-		unsigned int len = (unsigned int)strlen(data[i]);
-		char *pData = new char[len + 3];
-		strcpy(pData, data[i]);
-		strcat(pData, "\r\n");
-		AddData(pData, len + 2);
+		AddData(data[i], strlen(data[i]));
+		AddData("\r\n", 2);
 	}
 #endif
 }
 
 CDirectoryListingParser::~CDirectoryListingParser()
 {
-	for (auto iter = m_DataList.begin(); iter != m_DataList.end(); ++iter) {
-		delete [] iter->p;
-	}
-
-	delete m_prevLine;
 }
 
 bool CDirectoryListingParser::ParseData(bool partial)
@@ -695,39 +700,57 @@ bool CDirectoryListingParser::ParseData(bool partial)
 	DeduceEncoding();
 
 	bool error = false;
-	CLine *pLine = GetLine(partial, error);
-	while (pLine) {
-		bool res = ParseLine(*pLine, m_server.GetType(), false);
+	std::wstring buffer;
+	while (GetLine(partial, error, buffer)) {
+		CLine line(std::move(buffer));
+		bool res = ParseLine(line, m_server.GetType(), false);
 		if (!res) {
-			if (m_prevLine) {
-				CLine* pConcatenatedLine = m_prevLine->Concat(pLine);
-				res = ParseLine(*pConcatenatedLine, m_server.GetType(), true);
-				delete pConcatenatedLine;
-				delete m_prevLine;
-
-				if (res) {
-					delete pLine;
-					m_prevLine = nullptr;
-				}
-				else {
-					m_prevLine = pLine;
-				}
+			if (!m_prevLine.empty()) {
+				CLine concatenated = line.Prepend(m_prevLine);
+				res = ParseLine(concatenated, m_server.GetType(), true);
+			}
+
+			if (res) {
+				m_prevLine.clear();
 			}
 			else {
-				m_prevLine = pLine;
+				m_prevLine = line.str();
 			}
 		}
 		else {
-			delete m_prevLine;
-			m_prevLine = nullptr;
-			delete pLine;
+			m_prevLine.clear();
 		}
-		pLine = GetLine(partial, error);
+		buffer.clear();
 	};
 
+	if (partial) {
+		ReportPartialListing();
+	}
+
 	return !error;
 }
 
+void CDirectoryListingParser::ReportPartialListing()
+{
+	if (!partial_listing_cb_ || entries_.size() <= reported_entries_) {
+		return;
+	}
+
+	// The first entries are reported right away, after that in batches
+	size_t const pending = entries_.size() - reported_entries_;
+	auto const now = fz::monotonic_clock::now();
+	if (last_report_ && pending < 10000 && (now - last_report_) < fz::duration::from_milliseconds(250)) {
+		return;
+	}
+
+	std::vector<fz::shared_value<CDirentry>> entries(entries_.begin() + reported_entries_, entries_.end());
+	bool const first = !reported_entries_;
+	reported_entries_ = entries_.size();
+	last_report_ = now;
+
+	partial_listing_cb_(std::move(entries), first);
+}
+
 CDirectoryListing CDirectoryListingParser::Parse(const CServerPath &path)
 {
 	CDirectoryListing listing;
@@ -2089,11 +2112,20 @@ bool CDirectoryListingParser::ParseOther(CLine &line, CDirentry &entry)
 	return true;
 }
 
-bool CDirectoryListingParser::AddData(char *pData, int len)
+bool CDirectoryListingParser::AddData(char const* pData, size_t len)
+{
+	if (!len) {
+		return true;
+	}
+	memcpy(GetReceiveBuffer(len), pData, len);
+	return AddReceivedData(len);
+}
+
+bool CDirectoryListingParser::AddReceivedData(size_t len)
 {
-	ConvertEncoding(pData, len);
+	data_.add(len);
+	ConvertEncoding(data_.get() + data_.size() - len, len);
 
-	m_DataList.emplace_back(pData, len);
 	m_totalData += len;
 
 	if (m_totalData < 512) {
@@ -2115,141 +2147,91 @@ bool CDirectoryListingParser::AddLine(std::wstring && line, std::wstring && name
 	CLine l(std::move(line));
 	ParseLine(l, m_server.GetType(), true, &override);
 
+	ReportPartialListing();
+
 	return true;
 }
 
-CLine *CDirectoryListingParser::GetLine(bool breakAtEnd, bool &error)
+void CDirectoryListingParser::AddEntry(CDirentry && entry, std::wstring && permissions, std::wstring && ownerGroup)
 {
-	while (!m_DataList.empty()) {
-		// Trim empty lines and spaces
-		auto iter = m_DataList.begin();
-		int len = iter->len;
-		while (iter->p[m_currentOffset] == '\r' || iter->p[m_currentOffset] == '\n'
-			|| iter->p[m_currentOffset] == ' ' || iter->p[m_currentOffset] == '\t'
-			|| !iter->p[m_currentOffset])
-		{
-			++m_currentOffset;
-			if (m_currentOffset >= len) {
-				delete [] iter->p;
-				++iter;
-				m_currentOffset = 0;
-				if (iter == m_DataList.end()) {
-					m_DataList.clear();
-					return nullptr;
-				}
-				len = iter->len;
-			}
-		}
-		m_DataList.erase(m_DataList.begin(), iter);
-		iter = m_DataList.begin();
+	if (entry.name.empty() || entry.name == L"." || entry.name == L"..") {
+		return;
+	}
 
-		// Remember start offset and find next linebreak
-		int startpos = m_currentOffset;
-		int reslen = 0;
+	fz::shared_value<CDirentry> refEntry;
+	CDirentry & e = refEntry.get();
+	e = std::move(entry);
+	e.permissions = objcache.get(std::move(permissions));
+	e.ownerGroup = objcache.get(std::move(ownerGroup));
 
-		int currentOffset = m_currentOffset;
-		while (iter->p[currentOffset] != '\n' && iter->p[currentOffset] != '\r' && iter->p[currentOffset]) {
-			++reslen;
+	auto const timezoneOffset = m_server.GetTimezoneOffset();
+	if (timezoneOffset && !e.time.empty()) {
+		e.time += fz::duration::from_minutes(timezoneOffset);
+	}
 
-			++currentOffset;
-			if (currentOffset >= len) {
-				++iter;
-				if (iter == m_DataList.end()) {
-					if (reslen > 10000) {
-						if (m_pControlSocket) {
-							m_pControlSocket->log(logmsg::error, _("Received a line exceeding 10000 characters, aborting."));
-						}
-						error = true;
-						return nullptr;
-					}
-					if (breakAtEnd) {
-						return nullptr;
-					}
-					break;
-				}
-				len = iter->len;
-				currentOffset = 0;
-			}
+	entries_.emplace_back(std::move(refEntry));
+
+	ReportPartialListing();
+}
+
+bool CDirectoryListingParser::GetLine(bool breakAtEnd, bool &error, std::wstring & line)
+{
+	while (!data_.empty()) {
+		// Trim empty lines and spaces
+		unsigned char const* p = data_.get();
+		size_t size = data_.size();
+		data_.consume(byte_scan::skip_blank(p, size));
+		if (data_.empty()) {
+			return false;
 		}
+		p = data_.get();
+		size = data_.size();
 
-		if (reslen > 10000) {
+		// Find next linebreak
+		size_t const len = byte_scan::find_line_end(p, size);
+
+		if (len > 10000) {
 			if (m_pControlSocket) {
 				m_pControlSocket->log(logmsg::error, _("Received a line exceeding 10000 characters, aborting."));
 			}
 			error = true;
-			return nullptr;
-		}
-		m_currentOffset = currentOffset;
-
-		// Reslen is now the length of the line, including any terminating whitespace
-		int const buflen = reslen;
-		char *res = new char[buflen + 1];
-		res[buflen] = 0;
-
-		int respos = 0;
-
-		// Copy line data
-		auto i = m_DataList.begin();
-		while (i != iter && reslen) {
-			int copylen = i->len - startpos;
-			if (copylen > reslen) {
-				copylen = reslen;
-			}
-			memcpy(&res[respos], &i->p[startpos], copylen);
-			reslen -= copylen;
-			respos += i->len - startpos;
-			startpos = 0;
-
-			delete [] i->p;
-			++i;
-		};
-
-		// Copy last chunk
-		if (iter != m_DataList.end() && reslen) {
-			int copylen = m_currentOffset-startpos;
-			if (copylen > reslen) {
-				copylen = reslen;
-			}
-			memcpy(&res[respos], &iter->p[startpos], copylen);
-			if (reslen >= iter->len) {
-				delete [] iter->p;
-				m_DataList.erase(m_DataList.begin(), ++iter);
-			}
-			else {
-				m_DataList.erase(m_DataList.begin(), iter);
-			}
+			return false;
 		}
-		else {
-			m_DataList.erase(m_DataList.begin(), iter);
+		if (len == size && breakAtEnd) {
+			return false;
 		}
 
-		std::wstring buffer;
+		char const* res = reinterpret_cast<char const*>(p);
 		if (m_pControlSocket) {
-			buffer = m_pControlSocket->ConvToLocal(res, buflen);
-			m_pControlSocket->log_raw(logmsg::listing, buffer);
+			line = m_pControlSocket->ConvToLocal(res, len);
+			m_pControlSocket->log_raw(logmsg::listing, line);
+		}
+		else if (byte_scan::is_ascii(p, len)) {
+			line.assign(p, p + len);
 		}
 		else {
-			buffer = fz::to_wstring_from_utf8(res);
-			if (buffer.empty()) {
-				buffer = fz::to_wstring(res);
-				if (buffer.empty()) {
-					buffer = std::wstring(res, res + strlen(res));
+			std::string_view const view(res, len);
+			line = fz::to_wstring_from_utf8(view);
+			if (line.empty()) {
+				line = fz::to_wstring(view);
+				if (line.empty()) {
+					line = std::wstring(res, res + len);
 				}
 			}
 		}
-		delete [] res;
+		data_.consume(len);
 
 		// Strip BOM
-		if (buffer[0] == 0xfeff) {
-			buffer = buffer.substr(1);
+		if (!line.empty() && line[0] == 0xfeff) {
+			line.erase(0, 1);
 		}
 
-		if (!buffer.empty()) {
-			return new CLine(std::move(buffer));
+		if (!line.empty()) {
+			return true;
 		}
 	}
 
-	return nullptr;
+	return false;
 }
 
 bool CDirectoryListingParser::ParseAsWfFtp(CLine &line, CDirentry &entry)
@@ -2946,17 +2928,13 @@ bool CDirectoryListingParser::ParseAsOS9(CLine &line, CDirentry &entry)
 
 void CDirectoryListingParser::Reset()
 {
-	for (auto & item : m_DataList) {
-		delete [] item.p;
-	}
-	m_DataList.clear();
-
-	delete m_prevLine;
-	m_prevLine = nullptr;
+	data_.clear();
+	m_prevLine.clear();
 
 	entries_.clear();
 	m_fileList.clear();
-	m_currentOffset = 0;
+	reported_entries_ = 0;
+	last_report_ = fz::monotonic_clock();
 	m_fileListOnly = true;
 	m_maybeMultilineVms = false;
 }
@@ -3111,8 +3089,9 @@ bool CDirectoryListingParser::ParseAsHPNonstop(CLine &line, CDirentry &entry)
 bool CDirectoryListingParser::GetMonthFromName(const std::wstring& name, int &month)
 {
 	std::wstring lower = fz::str_tolower_ascii(name);
-	auto iter = m_MonthNamesMap.find(lower);
-	if (iter == m_MonthNamesMap.end())
+	auto const& names = month_names();
+	auto iter = names.find(lower);
+	if (iter == names.end())
 		return false;
 
 	month = iter->second;
@@ -3139,14 +3118,14 @@ char const ebcdic_table[256] = {
 	'0',  '1',  '2',  '3',  '4',  '5',  '6',  '7',  '8',  '9',  ' ',  ' ',  ' ',  ' ',  ' ',  ' '   // f
 };
 
-void CDirectoryListingParser::ConvertEncoding(char *pData, int len)
+void CDirectoryListingParser::ConvertEncoding(unsigned char *pData, size_t len)
 {
 	if (m_listingEncoding != listingEncoding::ebcdic) {
 		return;
 	}
 
-	for (int i = 0; i < len; ++i) {
-		pData[i] = ebcdic_table[static_cast<unsigned char>(pData[i])];
+	for (size_t i = 0; i < len; ++i) {
+		pData[i] = ebcdic_table[pData[i]];
 	}
 }
 
@@ -3160,10 +3139,9 @@ void CDirectoryListingParser::DeduceEncoding()
 
 	memset(&count, 0, sizeof(int)*256);
 
-	for (auto const& data : m_DataList) {
-		for (int i = 0; i < data.len; ++i) {
-			++count[static_cast<unsigned char>(data.p[i])];
-		}
+	unsigned char const* p = data_.get();
+	for (size_t i = 0; i < data_.size(); ++i) {
+		++count[p[i]];
 	}
 
 	int count_normal = 0;
@@ -3206,9 +3184,7 @@ void CDirectoryListingParser::DeduceEncoding()
 			m_pControlSocket->log(logmsg::status, _("Received a directory listing which appears to be encoded in EBCDIC."));
 		}
 		m_listingEncoding = listingEncoding::ebcdic;
-		for (auto & data : m_DataList) {
-			ConvertEncoding(data.p, data.len);
-		}
+		ConvertEncoding(data_.get(), data_.size());
 	}
 	else {
 		m_listingEncoding = listingEncoding::normal;
@@ -35,7 +35,9 @@
 #include "../include/directorylisting.h"
 #include "../include/server.h"
 
-#include <deque>
+#include <libfilezilla/buffer.hpp>
+
+#include <functional>
 #include <vector>
 
 class CLine;
@@ -64,20 +66,39 @@ public:
 
 	CDirectoryListing Parse(const CServerPath &path);
 
-	bool AddData(char *pData, int len);
+	// Copies the data into the parser
+	bool AddData(char const* pData, size_t len);
+
+	// Allows reading directly into the parser's buffer without an intermediate
+	// copy: Returns space for at least len bytes, after writing into it call
+	// AddReceivedData with the number of bytes actually written.
+	unsigned char* GetReceiveBuffer(size_t len) { return data_.get(len); }
+	bool AddReceivedData(size_t len);
 	bool AddLine(std::wstring && line, std::wstring && name, fz::datetime const& time);
 
+	// Adds an entry whose fields are known already, e.g. from SFTP attributes.
+	// Permissions and owner/group get shared with those of other entries.
+	void AddEntry(CDirentry && entry, std::wstring && permissions, std::wstring && ownerGroup);
+
 	void Reset();
 
 	void SetTimezoneOffset(fz::duration const& span) { m_timezoneOffset = span; }
 
 	void SetServer(const CServer& server) { m_server = server; };
 
+	// While data is being added, the callback periodically receives batches of
+	// the entries parsed so far. first is set on the first batch after
+	// construction or Reset.
+	typedef std::function<void(std::vector<fz::shared_value<CDirentry>> && entries, bool first)> partial_listing_callback;
+	void SetPartialListingCallback(partial_listing_callback && cb) { partial_listing_cb_ = std::move(cb); }
+
 protected:
-	CLine *GetLine(bool breakAtEnd, bool& error);
+	bool GetLine(bool breakAtEnd, bool& error, std::wstring & line);
 
 	bool ParseData(bool partial);
 
+	void ReportPartialListing();
+
 	bool ParseLine(CLine &line, ServerType const serverType, bool concatenated, CDirentry const* override = nullptr);
 
 	bool ParseAsUnix(CLine &line, CDirentry &entry, bool expect_date);
@@ -114,30 +135,22 @@ protected:
 	bool GetMonthFromName(std::wstring const& name, int &month);
 
 	void DeduceEncoding();
-	void ConvertEncoding(char *pData, int len);
+	void ConvertEncoding(unsigned char *pData, size_t len);
 
 	CControlSocket* m_pControlSocket;
 
-	static std::map<std::wstring, int> m_MonthNamesMap;
+	// Received data not yet split into lines
+	fz::buffer data_;
 
-	struct t_list
-	{
-		t_list() = default;
-		t_list(char* s, int l)
-			: p(s), len(l)
-		{}
-
-		char *p;
-		int len;
-	};
-
-	int m_currentOffset{};
-
-	std::deque<t_list> m_DataList;
 	std::vector<fz::shared_value<CDirentry>> entries_;
 	int64_t m_totalData{};
 
-	CLine *m_prevLine{};
+	// Unparsable line, possibly the first part of a multiline entry
+	std::wstring m_prevLine;
+
+	partial_listing_callback partial_listing_cb_;
+	size_t reported_entries_{};
+	fz::monotonic_clock last_report_;
 
 	CServer m_server;
 
@@ -8,27 +8,42 @@
 #include "logging_private.h"
 #include "oplock_manager.h"
 #include "pathcache.h"
+#include "tls.h"
 
 #include <libfilezilla/event_loop.hpp>
+#include <libfilezilla/mutex.hpp>
 #include <libfilezilla/rate_limiter.hpp>
 #include <libfilezilla/thread_pool.hpp>
 #include <libfilezilla/tls_system_trust_store.hpp>
 
+#include <thread>
+
 namespace {
 class option_change_handler final : public fz::event_handler
 {
 public:
-	option_change_handler(COptionsBase& options, fz::event_loop & loop, fz::rate_limit_manager & rate_limit_mgr, fz::rate_limiter & rate_limiter)
+	option_change_handler(COptionsBase& options, fz::event_loop & loop, fz::rate_limit_manager & rate_limit_mgr, fz::rate_limiter & rate_limiter, CDirectoryCache & directory_cache, tls_session_cache & tls_sessions)
 		: fz::event_handler(loop)
 		, options_(options)
 		, rate_limit_mgr_(rate_limit_mgr)
 		, rate_limiter_(rate_limiter)
+		, directory_cache_(directory_cache)
+		, tls_sessions_(tls_sessions)
 	{
 		UpdateRateLimit();
+		UpdateDirectoryCache();
+		UpdateTlsSessionCache();
 		options_.watch(OPTION_SPEEDLIMIT_ENABLE, this);
 		options_.watch(OPTION_SPEEDLIMIT_INBOUND, this);
 		options_.watch(OPTION_SPEEDLIMIT_OUTBOUND, this);
 		options_.watch(OPTION_SPEEDLIMIT_BURSTTOLERANCE, this);
+		options_.watch(OPTION_CACHE_TTL, this);
+		options_.watch(OPTION_CACHE_MEMORY_LIMIT, this);
+		options_.watch(OPTION_CACHE_EVICTION_POLICY, this);
+		options_.watch(OPTION_CACHE_PERSISTENT, this);
+		options_.watch(OPTION_CACHE_DIRECTORY, this);
+		options_.watch(OPTION_TLS_SESSION_CACHE, this);
+		options_.watch(OPTION_TLS_SESSION_CACHE_FILE, this);
 	}
 
 	~option_change_handler()
@@ -42,16 +57,30 @@ private:
 		fz::dispatch<options_changed_event>(ev, this, &option_change_handler::on_options_changed);
 	}
 
-	void on_options_changed(watched_options const&)
+	void on_options_changed(watched_options const& options)
 	{
-		UpdateRateLimit();
+		if (options.test(OPTION_SPEEDLIMIT_ENABLE) || options.test(OPTION_SPEEDLIMIT_INBOUND) || options.test(OPTION_SPEEDLIMIT_OUTBOUND) || options.test(OPTION_SPEEDLIMIT_BURSTTOLERANCE)) {
+			UpdateRateLimit();
+		}
+		if (options.test(OPTION_CACHE_TTL) || options.test(OPTION_CACHE_MEMORY_LIMIT) || options.test(OPTION_CACHE_EVICTION_POLICY) ||
+			options.test(OPTION_CACHE_PERSISTENT) || options.test(OPTION_CACHE_DIRECTORY))
+		{
+			UpdateDirectoryCache();
+		}
+		if (options.test(OPTION_TLS_SESSION_CACHE) || options.test(OPTION_TLS_SESSION_CACHE_FILE)) {
+			UpdateTlsSessionCache();
+		}
 	}
 
 	void UpdateRateLimit();
+	void UpdateDirectoryCache();
+	void UpdateTlsSessionCache();
 
 	COptionsBase & options_;
 	fz::rate_limit_manager & rate_limit_mgr_;
 	fz::rate_limiter & rate_limiter_;
+	CDirectoryCache & directory_cache_;
+	tls_session_cache & tls_sessions_;
 };
 
 void option_change_handler::UpdateRateLimit()
@@ -82,6 +111,42 @@ void option_change_handler::UpdateRateLimit()
 	}
 	rate_limiter_.set_limits(limits[0], limits[1]);
 }
+
+void option_change_handler::UpdateDirectoryCache()
+{
+	directory_cache_.SetTtl(fz::duration::from_seconds(options_.get_int(OPTION_CACHE_TTL)));
+	directory_cache_.SetMemoryLimit(static_cast<int64_t>(options_.get_int(OPTION_CACHE_MEMORY_LIMIT)) * 1024 * 1024);
+
+	switch (options_.get_int(OPTION_CACHE_EVICTION_POLICY)) {
+	case 1:
+		directory_cache_.SetEvictionPolicy(CDirectoryCache::eviction_policy::size_aware);
+		break;
+	case 2:
+		directory_cache_.SetEvictionPolicy(CDirectoryCache::eviction_policy::frequency_aware);
+		break;
+	default:
+		directory_cache_.SetEvictionPolicy(CDirectoryCache::eviction_policy::lru);
+	}
+
+	if (options_.get_int(OPTION_CACHE_PERSISTENT)) {
+		directory_cache_.SetPersistentDirectory(options_.get_string(OPTION_CACHE_DIRECTORY));
+	}
+	else {
+		directory_cache_.SetPersistentDirectory(std::wstring());
+	}
+}
+
+void option_change_handler::UpdateTlsSessionCache()
+{
+	int const mode = options_.get_int(OPTION_TLS_SESSION_CACHE);
+	tls_sessions_.set_enabled(mode != 0);
+	if (mode == 2) {
+		tls_sessions_.set_persistent_file(options_.get_string(OPTION_TLS_SESSION_CACHE_FILE));
+	}
+	else {
+		tls_sessions_.set_persistent_file(std::wstring());
+	}
+}
 }
 
 class CFileZillaEngineContext::Impl final
@@ -92,8 +157,19 @@ public:
 		, rate_limit_mgr_(loop_)
 		, tlsSystemTrustStore_(pool_)
 	{
-		directory_cache_.SetTtl(fz::duration::from_seconds(options.get_int(OPTION_CACHE_TTL)));
 		rate_limit_mgr_.add(&rate_limiter_);
+
+		// Only read at startup, engines cannot move between loops.
+		int loops = options.get_int(OPTION_ENGINE_EVENT_LOOPS);
+		if (!loops) {
+			loops = static_cast<int>(std::thread::hardware_concurrency());
+		}
+		if (loops > 1) {
+			for (int i = 0; i < loops; ++i) {
+				engine_loops_.emplace_back(std::make_unique<fz::event_loop>(pool_));
+			}
+			engine_loop_load_.resize(engine_loops_.size());
+		}
 	}
 
 	~Impl()
@@ -104,10 +180,17 @@ public:
 	COptionsBase& options_;
 	fz::thread_pool pool_;
 	fz::event_loop loop_{pool_};
+
+	// Loops the engines get spread over. If empty, all engines use loop_.
+	std::vector<std::unique_ptr<fz::event_loop>> engine_loops_;
+	std::vector<size_t> engine_loop_load_;
+	fz::mutex engine_loop_mutex_;
+
 	fz::rate_limit_manager rate_limit_mgr_;
 	fz::rate_limiter rate_limiter_;
-	option_change_handler option_change_handler_{options_, loop_, rate_limit_mgr_, rate_limiter_};
 	CDirectoryCache directory_cache_;
+	tls_session_cache tls_session_cache_;
+	option_change_handler option_change_handler_{options_, loop_, rate_limit_mgr_, rate_limiter_, directory_cache_, tls_session_cache_};
 	CPathCache path_cache_;
 	OpLockManager opLockManager_;
 	fz::tls_system_trust_store tlsSystemTrustStore_;
@@ -135,6 +218,35 @@ fz::event_loop& CFileZillaEngineContext::GetEventLoop()
 	return impl_->loop_;
 }
 
+fz::event_loop& CFileZillaEngineContext::AcquireEngineEventLoop()
+{
+	fz::scoped_lock l(impl_->engine_loop_mutex_);
+	if (impl_->engine_loops_.empty()) {
+		return impl_->loop_;
+	}
+
+	// Pick the loop with the fewest engines
+	size_t best = 0;
+	for (size_t i = 1; i < impl_->engine_loop_load_.size(); ++i) {
+		if (impl_->engine_loop_load_[i] < impl_->engine_loop_load_[best]) {
+			best = i;
+		}
+	}
+	++impl_->engine_loop_load_[best];
+	return *impl_->engine_loops_[best];
+}
+
+void CFileZillaEngineContext::ReleaseEngineEventLoop(fz::event_loop& loop)
+{
+	fz::scoped_lock l(impl_->engine_loop_mutex_);
+	for (size_t i = 0; i < impl_->engine_loops_.size(); ++i) {
+		if (impl_->engine_loops_[i].get() == &loop) {
+			--impl_->engine_loop_load_[i];
+			break;
+		}
+	}
+}
+
 fz::rate_limiter& CFileZillaEngineContext::GetRateLimiter()
 {
 	return impl_->rate_limiter_;
@@ -145,6 +257,11 @@ CDirectoryCache& CFileZillaEngineContext::GetDirectoryCache()
 	return impl_->directory_cache_;
 }
 
+directory_cache_stats CFileZillaEngineContext::GetDirectoryCacheStats()
+{
+	return impl_->directory_cache_.GetStats();
+}
+
 CPathCache& CFileZillaEngineContext::GetPathCache()
 {
 	return impl_->path_cache_;
@@ -160,6 +277,11 @@ fz::tls_system_trust_store& CFileZillaEngineContext::GetTlsSystemTrustStore()
 	return impl_->tlsSystemTrustStore_;
 }
 
+tls_session_cache& CFileZillaEngineContext::GetTlsSessionCache()
+{
+	return impl_->tls_session_cache_;
+}
+
 activity_logger& CFileZillaEngineContext::GetActivityLogger()
 {
 	return impl_->activity_logger_;
@@ -78,7 +78,16 @@ unsigned int register_engine_options()
 		{ "Size decimal places", 1, option_flags::numeric_clamp, 0, 3 },
 		{ "TCP Keepalive Interval", 15, option_flags::numeric_clamp, 1, 10000 },
 		{ "Cache TTL", 600, option_flags::numeric_clamp, 30, 60*60*24 },
-		{ "Minimum TLS Version", 2, option_flags::numeric_clamp, 0, 3 }
+		{ "Cache memory limit", 256, option_flags::numeric_clamp, 16, 4096 },
+		{ "Cache eviction policy", 0, option_flags::numeric_clamp, 0, 2 },
+		{ "Cache persistent", false, option_flags::normal },
+		{ "Cache directory", L"", option_flags::internal },
+		{ "Minimum TLS Version", 2, option_flags::numeric_clamp, 0, 3 },
+		{ "Engine event loops", 1, option_flags::numeric_clamp, 0, 64 },
+		{ "TLS session cache", 1, option_flags::numeric_clamp, 0, 2 },
+		{ "TLS session cache file", L"", option_flags::internal },
+		{ "FTP compression level", 0, option_flags::numeric_clamp, 0, 9 },
+		{ "FTP pipeline depth", 1, option_flags::numeric_clamp, 1, 64 }
 	});
 	return value;
 }
@@ -36,7 +36,7 @@ unsigned int get_next_engine_id()
 }
 
 CFileZillaEnginePrivate::CFileZillaEnginePrivate(CFileZillaEngineContext& context, CFileZillaEngine& parent, std::function<void(CFileZillaEngine*)> const& notification_cb)
-	: event_handler(context.GetEventLoop())
+	: event_handler(context.AcquireEngineEventLoop())
 	, transfer_status_(*this)
 	, opLockManager_(context.GetOpLockManager())
 	, activity_logger_(context.GetActivityLogger())
@@ -98,6 +98,7 @@ void erase_unordered(C & container, V const& v) noexcept
 CFileZillaEnginePrivate::~CFileZillaEnginePrivate()
 {
 	shutdown();
+	context_.ReleaseEngineEventLoop(event_loop_);
 }
 
 void CFileZillaEnginePrivate::shutdown()
@@ -382,6 +383,13 @@ int CFileZillaEnginePrivate::List(CListCommand const& command)
 
 int CFileZillaEnginePrivate::FileTransfer(CFileTransferCommand const& command)
 {
+	if (command.GetSegment()) {
+		auto const feature = command.Download() ? ProtocolFeature::SegmentedDownload : ProtocolFeature::SegmentedUpload;
+		if (!controlSocket_->GetCurrentServer().HasFeature(feature)) {
+			return FZ_REPLY_NOTSUPPORTED;
+		}
+	}
+
 	controlSocket_->FileTransfer(command);
 	return FZ_REPLY_CONTINUE;
 }
@@ -895,6 +903,14 @@ void CTransferStatusManager::SetMadeProgress()
 	made_progress_ = true;
 }
 
+void CTransferStatusManager::SetWindow(int64_t window)
+{
+	fz::scoped_lock lock(mutex_);
+	if (status_) {
+		status_.window = window;
+	}
+}
+
 void CTransferStatusManager::Update(int64_t transferredBytes)
 {
 	std::unique_ptr<CNotification> notification;
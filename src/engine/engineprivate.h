@@ -40,6 +40,7 @@ public:
 	void Reset();
 	void SetStartTime();
 	void SetMadeProgress();
+	void SetWindow(int64_t window);
 	void Update(int64_t transferredBytes);
 
 	CTransferStatus Get(bool &changed);
@@ -2,6 +2,7 @@
 
 #include "delete.h"
 #include "../directorycache.h"
+#include "../servercapabilities.h"
 
 enum rmdStates
 {
@@ -18,21 +19,36 @@ int CFtpDeleteOpData::Send()
 		return FZ_REPLY_CONTINUE;
 	}
 	else if (opState == del_del) {
-		std::wstring const& file = files_.back();
-		if (file.empty()) {
-			log(logmsg::debug_info, L"Empty filename");
-			return FZ_REPLY_INTERNALERROR;
+		// Keep up to the pipeline depth of commands outstanding. Pipelining
+		// is off unless enabled by the user, not all servers cope with it.
+		size_t depth = 1;
+		if (CServerCapabilities::GetCapability(currentServer_, command_pipelining) != no) {
+			depth = static_cast<size_t>(engine_.GetOptions().get_int(OPTION_FTP_PIPELINE_DEPTH));
 		}
 
-		std::wstring filename = path_.FormatFilename(file, omitPath_);
-		if (filename.empty()) {
-			log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
-			return FZ_REPLY_ERROR;
+		while (pending_.size() < depth && pending_.size() < files_.size()) {
+			std::wstring const& file = files_[files_.size() - 1 - pending_.size()];
+			if (file.empty()) {
+				log(logmsg::debug_info, L"Empty filename");
+				return FZ_REPLY_INTERNALERROR;
+			}
+
+			std::wstring filename = path_.FormatFilename(file, omitPath_);
+			if (filename.empty()) {
+				log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
+				return FZ_REPLY_ERROR;
+			}
+
+			engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+
+			int res = controlSocket_.SendCommand(L"DELE " + filename);
+			if (res != FZ_REPLY_WOULDBLOCK) {
+				return res;
+			}
+			pending_.push_back(!pending_.empty());
 		}
 
-		engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
-
-		return controlSocket_.SendCommand(L"DELE " + filename);
+		return FZ_REPLY_WOULDBLOCK;
 	}
 
 	log(logmsg::debug_warning, L"Unkown op state %d", opState);
@@ -42,7 +58,30 @@ int CFtpDeleteOpData::Send()
 int CFtpDeleteOpData::ParseResponse()
 {
 	int code = controlSocket_.GetReplyCode();
-	if (code != 2 && code != 3) {
+	if (code == 1) {
+		// Preliminary reply, the final one follows
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	if (pending_.empty() || files_.empty()) {
+		log(logmsg::debug_warning, L"Reply without pending DELE command");
+		return FZ_REPLY_INTERNALERROR;
+	}
+	bool const pipelined = pending_.front();
+	pending_.pop_front();
+
+	std::wstring const& response = controlSocket_.m_Response;
+	if (pipelined && (response.substr(0, 3) == L"500" || response.substr(0, 3) == L"503")) {
+		// Server got confused by the pipelined commands. Try this file again
+		// once the outstanding replies are in, one command at a time.
+		log(logmsg::debug_info, L"Server does not handle pipelined commands, disabling pipelining.");
+		CServerCapabilities::SetCapability(currentServer_, command_pipelining, no);
+		std::wstring file = std::move(files_.back());
+		files_.pop_back();
+		files_.insert(files_.begin(), std::move(file));
+		return FZ_REPLY_CONTINUE;
+	}
+	else if (code != 2 && code != 3) {
 		deleteFailed_ = true;
 	}
 	else {
@@ -64,6 +103,7 @@ int CFtpDeleteOpData::ParseResponse()
 	files_.pop_back();
 
 	if (!files_.empty()) {
+		// Refill the window, Send does nothing if it is still full
 		return FZ_REPLY_CONTINUE;
 	}
 
@@ -5,6 +5,8 @@
 
 #include "../../include/serverpath.h"
 
+#include <deque>
+
 class CFtpDeleteOpData final : public COpData, public CFtpOpData
 {
 public:
@@ -30,6 +32,11 @@ public:
 
 	// Set to true if deletion of at least one file failed
 	bool deleteFailed_{};
+
+	// One entry per DELE command awaiting a reply, set if the command was
+	// sent while other commands were outstanding. The commands are sent for
+	// the files at the back of files_, the replies arrive in the same order.
+	std::deque<bool> pending_;
 };
 
 #endif
@@ -16,7 +16,8 @@ CFtpFileTransferOpData::CFtpFileTransferOpData(CFtpControlSocket& controlSocket,
 	: CFileTransferOpData(L"CFtpFileTransferOpData", cmd)
 	, CFtpOpData(controlSocket)
 {
-	binary = !(cmd.GetFlags() & ftp_transfer_flags::ascii);
+	// Segments are byte ranges, they cannot be transferred in ASCII mode
+	binary = segment_ || !(cmd.GetFlags() & ftp_transfer_flags::ascii);
 }
 
 int CFtpFileTransferOpData::Send()
@@ -65,7 +66,10 @@ int CFtpFileTransferOpData::Send()
 				localFileSize_ = writer_factory_.size(); 
 				fileDidExist_ = localFileSize_ != fz::aio_base::nosize;
 
-				if (resume_) {
+				if (segment_) {
+					resumeOffset = static_cast<int64_t>(segment_.offset + segment_.done);
+				}
+				else if (resume_) {
 					resumeOffset = fileDidExist_ ? static_cast<int64_t>(localFileSize_) : 0;
 
 					// Check resume capabilities
@@ -80,7 +84,12 @@ int CFtpFileTransferOpData::Send()
 					localFileSize_ = 0;
 				}
 
-				engine_.transfer_status_.Init(remoteFileSize_, resumeOffset, false);
+				if (segment_) {
+					engine_.transfer_status_.Init(segment_.length, segment_.done, false);
+				}
+				else {
+					engine_.transfer_status_.Init(remoteFileSize_, resumeOffset, false);
+				}
 			}
 			else {
 				if (resume_) {
@@ -109,7 +118,22 @@ int CFtpFileTransferOpData::Send()
 
 			controlSocket_.m_pTransferSocket = std::make_unique<CTransferSocket>(engine_, controlSocket_, download() ? TransferMode::download : TransferMode::upload);
 			controlSocket_.m_pTransferSocket->m_binaryMode = binary;
-			if (download()) {
+			if (download() && segment_) {
+				// The target has already been allocated by whoever split the file into segments
+				auto writer = controlSocket_.OpenSegmentWriter(writer_factory_, segment_, true);
+				if (!writer) {
+					return FZ_REPLY_CRITICALERROR;
+				}
+				controlSocket_.m_pTransferSocket->set_writer(std::move(writer), false);
+
+				// Unless the segment extends to the end of the file, stop once it has
+				// been received and abort the remainder.
+				uint64_t const end = segment_.offset + segment_.length;
+				if (remoteFileSize_ < 0 || end < static_cast<uint64_t>(remoteFileSize_)) {
+					controlSocket_.m_pTransferSocket->set_limit(segment_.length - segment_.done);
+				}
+			}
+			else if (download()) {
 				auto writer = controlSocket_.OpenWriter(writer_factory_, resumeOffset, true);
 				if (!writer) {
 					return FZ_REPLY_CRITICALERROR;
@@ -416,7 +440,9 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 		}
 	}
 	else if (opState == filetransfer_waittransfer) {
-		if (prevResult == FZ_REPLY_OK && options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
+		// Segments leave timestamps alone, segmented_transfer applies the one of
+		// a download once all segments are done
+		if (prevResult == FZ_REPLY_OK && options_.get_int(OPTION_PRESERVE_TIMESTAMPS) && !segment_) {
 			if (!download() &&
 				CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
 			{
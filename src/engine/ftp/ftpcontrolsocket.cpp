@@ -178,6 +178,8 @@ void CFtpControlSocket::ParseLine(std::wstring line)
 void CFtpControlSocket::OnConnect()
 {
 	m_lastTypeBinary = -1;
+	m_modeZ = false;
+	m_modeZLevelSent = false;
 	m_sentRestartOffset = false;
 
 	SetAlive();
@@ -191,7 +193,7 @@ void CFtpControlSocket::OnConnect()
 
 			tls_layer_->set_alpn("ftp");
 			tls_layer_->set_min_tls_ver(get_min_tls_ver(engine_.GetOptions()));
-			if (!tls_layer_->client_handshake(this)) {
+			if (!tls_layer_->client_handshake(this, engine_.GetContext().GetTlsSessionCache().get(currentServer_))) {
 				DoClose();
 			}
 
@@ -199,10 +201,16 @@ void CFtpControlSocket::OnConnect()
 		}
 		else {
 			log(logmsg::status, _("TLS connection established, waiting for welcome message..."));
+			if (tls_layer_->resumed_session()) {
+				log(logmsg::debug_info, L"Resumed cached TLS session");
+			}
 		}
 	}
 	else if ((currentServer_.GetProtocol() == FTPES || currentServer_.GetProtocol() == FTP) && tls_layer_) {
 		log(logmsg::status, _("TLS connection established."));
+		if (tls_layer_->resumed_session()) {
+			log(logmsg::debug_info, L"Resumed cached TLS session");
+		}
 		SendNextCommand();
 		return;
 	}
@@ -446,6 +454,15 @@ void CFtpControlSocket::TransferEnd()
 		return;
 	}
 
+	if (reason == TransferEndReason::successful && m_pTransferSocket->limit_reached()) {
+		// Only a segment of the file was requested. Both the reply to the
+		// transfer command and to ABOR get skipped.
+		log(logmsg::debug_info, L"End of segment reached, aborting remainder of transfer");
+		int res = SendCommand(L"ABOR");
+		ResetOperation(res == FZ_REPLY_WOULDBLOCK ? FZ_REPLY_OK : res);
+		return;
+	}
+
 	switch (data.opState)
 	{
 	case rawtransfer_transfer:
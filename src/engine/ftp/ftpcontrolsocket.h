@@ -116,6 +116,10 @@ protected:
 
 	int m_lastTypeBinary{-1};
 
+	// MODE Z currently in effect and whether its level has been set
+	bool m_modeZ{};
+	bool m_modeZLevelSent{};
+
 	// Used by keepalive code so that we're not using keep alive
 	// till the end of time. Stop after a couple of minutes.
 	fz::monotonic_clock m_lastCommandCompletionTime;
@@ -300,7 +300,7 @@ int CFtpLogonOpData::ParseResponse()
 
 			controlSocket_.tls_layer_->set_alpn({"ftp", "x-filezilla-ftp"});
 			controlSocket_.tls_layer_->set_min_tls_ver(get_min_tls_ver(options_));
-			if (!controlSocket_.tls_layer_->client_handshake(&controlSocket_)) {
+			if (!controlSocket_.tls_layer_->client_handshake(&controlSocket_, engine_.GetContext().GetTlsSessionCache().get(currentServer_))) {
 				return FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED;
 			}
 
@@ -478,6 +478,10 @@ int CFtpLogonOpData::ParseResponse()
 		++opState;
 
 		if (opState == LOGON_DONE) {
+			if (controlSocket_.tls_layer_) {
+				// Only now, TLS 1.3 servers send their session tickets after the handshake
+				engine_.GetContext().GetTlsSessionCache().store(currentServer_, controlSocket_.tls_layer_->get_session_parameters());
+			}
 			log(logmsg::status, _("Logged in"));
 			log(logmsg::debug_info, L"Measured latency of %d ms", controlSocket_.m_rtt.GetLatency());
 			return FZ_REPLY_OK;
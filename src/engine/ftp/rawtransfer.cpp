@@ -24,7 +24,7 @@ int CFtpRawTransferOpData::Send()
 		if ((pOldData->binary && controlSocket_.m_lastTypeBinary == 1) ||
 			(!pOldData->binary && controlSocket_.m_lastTypeBinary == 0))
 		{
-			opState = rawtransfer_port_pasv;
+			opState = ModeState();
 		}
 		else {
 			opState = rawtransfer_type;
@@ -65,7 +65,14 @@ int CFtpRawTransferOpData::Send()
 		}
 		measureRTT = true;
 		break;
+	case rawtransfer_mode_level:
+		cmd = fz::sprintf(L"OPTS MODE Z LEVEL %d", options_.get_int(OPTION_FTP_COMPRESSION_LEVEL));
+		break;
+	case rawtransfer_mode:
+		cmd = controlSocket_.m_modeZ ? L"MODE S" : L"MODE Z";
+		break;
 	case rawtransfer_port_pasv:
+		controlSocket_.m_pTransferSocket->set_compression(controlSocket_.m_modeZ ? options_.get_int(OPTION_FTP_COMPRESSION_LEVEL) : 0);
 		if (bPasv) {
 			cmd = GetPassiveCommand();
 		}
@@ -152,10 +159,29 @@ int CFtpRawTransferOpData::ParseResponse()
 			error = true;
 		}
 		else {
-			opState = rawtransfer_port_pasv;
 			controlSocket_.m_lastTypeBinary = pOldData->binary ? 1 : 0;
+			opState = ModeState();
 		}
 		break;
+	case rawtransfer_mode_level:
+		// Not fatal, the server then uses its default level
+		controlSocket_.m_modeZLevelSent = true;
+		opState = rawtransfer_mode;
+		break;
+	case rawtransfer_mode:
+		if (code == 2) {
+			controlSocket_.m_modeZ = !controlSocket_.m_modeZ;
+		}
+		else if (controlSocket_.m_modeZ) {
+			error = true;
+			break;
+		}
+		else {
+			log(logmsg::debug_info, L"Server refused MODE Z, transferring uncompressed");
+			CServerCapabilities::SetCapability(currentServer_, mode_z_support, no);
+		}
+		opState = rawtransfer_port_pasv;
+		break;
 	case rawtransfer_port_pasv:
 		if (code != 2 && code != 3) {
 			if (!options_.get_int(OPTION_ALLOW_TRANSFERMODEFALLBACK)) {
@@ -294,6 +320,19 @@ int CFtpRawTransferOpData::ParseResponse()
 	return FZ_REPLY_CONTINUE;
 }
 
+int CFtpRawTransferOpData::ModeState()
+{
+	bool const want = options_.get_int(OPTION_FTP_COMPRESSION_LEVEL) > 0 &&
+		CServerCapabilities::GetCapability(currentServer_, mode_z_support) == yes;
+	if (want == controlSocket_.m_modeZ) {
+		return rawtransfer_port_pasv;
+	}
+	if (want && !controlSocket_.m_modeZLevelSent) {
+		return rawtransfer_mode_level;
+	}
+	return rawtransfer_mode;
+}
+
 bool CFtpRawTransferOpData::ParseEpsvResponse()
 {
 	size_t pos = controlSocket_.m_Response.find(L"(|||");
@@ -7,6 +7,8 @@ enum rawtransferStates
 {
 	rawtransfer_init = 0,
 	rawtransfer_type,
+	rawtransfer_mode_level,
+	rawtransfer_mode,
 	rawtransfer_port_pasv,
 	rawtransfer_rest,
 	rawtransfer_transfer,
@@ -32,6 +34,9 @@ public:
 	bool ParsePasvResponse();
 	bool ParseEpsvResponse();
 
+	// Next state after the transfer type is set
+	int ModeState();
+
 	std::wstring cmd_;
 
 	CFtpTransferOpData* pOldData{};
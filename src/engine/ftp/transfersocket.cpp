@@ -1,5 +1,6 @@
 #include "../filezilla.h"
 #include "../activity_logger_layer.h"
+#include "../deflate_layer.h"
 #include "../directorylistingparser.h"
 #include "../engineprivate.h"
 #include "../proxy.h"
@@ -14,6 +15,9 @@
 #include <libfilezilla/rate_limited_layer.hpp>
 #include <libfilezilla/util.hpp>
 
+#include <algorithm>
+#include <atomic>
+
 using namespace std::literals;
 
 #if HAVE_ASCII_TRANSFORM
@@ -56,6 +60,12 @@ void CTransferSocket::set_writer(std::unique_ptr<fz::writer_base> && writer, [[m
 	writer_ = std::move(writer);
 }
 
+void CTransferSocket::set_limit(uint64_t limit)
+{
+	has_limit_ = true;
+	limit_ = limit;
+}
+
 void CTransferSocket::ResetSocket()
 {
 	socketServer_.reset();
@@ -65,6 +75,7 @@ void CTransferSocket::ResetSocket()
 #if HAVE_ASCII_TRANSFORM
 	ascii_layer_.reset();
 #endif
+	deflate_layer_.reset();
 	tls_layer_.reset();
 	proxy_layer_.reset();
 	ratelimit_layer_.reset();
@@ -276,11 +287,11 @@ void CTransferSocket::OnReceive()
 		if (m_transferMode == TransferMode::list) {
 			// See comment in download loop
 			for (int i = 0; i < 100; ++i) {
-				char *pBuffer = new char[4096];
+				// Read straight into the parser's buffer
+				unsigned char* pBuffer = m_pDirectoryListingParser->GetReceiveBuffer(listReadSize_);
 				int error;
-				int numread = active_layer_->read(pBuffer, 4096, error);
+				int numread = active_layer_->read(pBuffer, static_cast<unsigned int>(listReadSize_), error);
 				if (numread < 0) {
-					delete [] pBuffer;
 					if (error != EAGAIN) {
 						controlSocket_.log(logmsg::error, L"Could not read from transfer socket: %s", fz::socket_error_description(error));
 						TransferEnd(TransferEndReason::transfer_failure);
@@ -289,7 +300,7 @@ void CTransferSocket::OnReceive()
 				}
 
 				if (numread > 0) {
-					if (!m_pDirectoryListingParser->AddData(pBuffer, numread)) {
+					if (!m_pDirectoryListingParser->AddReceivedData(static_cast<size_t>(numread))) {
 						TransferEnd(TransferEndReason::transfer_failure);
 						return;
 					}
@@ -302,7 +313,6 @@ void CTransferSocket::OnReceive()
 					engine_.transfer_status_.Update(numread);
 				}
 				else {
-					delete [] pBuffer;
 					TransferEnd(TransferEndReason::successful);
 					return;
 				}
@@ -318,11 +328,19 @@ void CTransferSocket::OnReceive()
 			// Otherwise this behaves like a livelock on very large files written to a very fast
 			// SSD downloaded from a very fast server.
 			for (int i = 0; i < 100; ++i) {
+				if (limit_reached()) {
+					FinalizeWrite();
+					return;
+				}
+
 				if (!CheckGetNextWriteBuffer()) {
 					return;
 				}
 
 				size_t to_read = buffer_->capacity() - buffer_->size();
+				if (has_limit_ && to_read > limit_) {
+					to_read = static_cast<size_t>(limit_);
+				}
 				numread = active_layer_->read(buffer_->get(to_read), static_cast<unsigned int>(to_read), error);
 				if (numread <= 0) {
 					break;
@@ -335,6 +353,9 @@ void CTransferSocket::OnReceive()
 				}
 
 				buffer_->add(static_cast<size_t>(numread));
+				if (has_limit_) {
+					limit_ -= static_cast<uint64_t>(numread);
+				}
 			}
 
 			if (numread < 0) {
@@ -344,7 +365,13 @@ void CTransferSocket::OnReceive()
 				}
 			}
 			else if (!numread) {
-				FinalizeWrite();
+				if (has_limit_ && limit_) {
+					controlSocket_.log(logmsg::error, _("Server closed data connection before the end of the segment"));
+					TransferEnd(TransferEndReason::transfer_failure);
+				}
+				else {
+					FinalizeWrite();
+				}
 			}
 			else {
 				send_event<fz::socket_event>(active_layer_, fz::socket_event_flag::read, 0);
@@ -568,6 +595,11 @@ bool CTransferSocket::InitLayers(bool active)
 		}
 	}
 
+	if (compression_level_) {
+		deflate_layer_ = std::make_unique<deflate_layer>(nullptr, *active_layer_, m_transferMode == TransferMode::upload, compression_level_);
+		active_layer_ = deflate_layer_.get();
+	}
+
 #if HAVE_ASCII_TRANSFORM
 	if (use_ascii_) {
 		ascii_layer_ = std::make_unique<fz::ascii_layer>(event_loop_, nullptr, *active_layer_);
@@ -608,7 +640,14 @@ void CTransferSocket::TransferEnd(TransferEndReason reason)
 	}
 	m_transferEndReason = reason;
 
-	if (reason != TransferEndReason::successful) {
+	if (deflate_layer_ && reason == TransferEndReason::successful && deflate_layer_->data_bytes()) {
+		int64_t const data = deflate_layer_->data_bytes();
+		int64_t const wire = deflate_layer_->wire_bytes();
+		controlSocket_.log(logmsg::status, _("Compressed transfer of %d bytes took %d bytes (%d%%)"), data, wire, wire * 100 / data);
+	}
+
+	if (reason != TransferEndReason::successful || limit_reached()) {
+		// After a limited download the server is still sending, don't wait for it
 		ResetSocket();
 	}
 	else {
@@ -650,7 +689,10 @@ std::unique_ptr<fz::listen_socket> CTransferSocket::CreateSocketServer()
 	// connection attempts. This may cause problems if transferring lots of
 	// files with a narrow port range.
 
-	static int start = 0;
+	// Shared by all engines, which may run on different event loops. Each
+	// attempt claims its own port, so concurrent transfers don't race for the
+	// same one.
+	static std::atomic<unsigned int> next_port{static_cast<unsigned int>(fz::random_number(0, 65535))};
 
 	int low = engine_.GetOptions().get_int(OPTION_LIMITPORTS_LOW);
 	int high = engine_.GetOptions().get_int(OPTION_LIMITPORTS_HIGH);
@@ -658,21 +700,15 @@ std::unique_ptr<fz::listen_socket> CTransferSocket::CreateSocketServer()
 		low = high;
 	}
 
-	if (start < low || start > high) {
-		start = static_cast<decltype(start)>(fz::random_number(low, high));
-	}
-
 	std::unique_ptr<fz::listen_socket> server;
 
-	int count = high - low + 1;
-	while (count--) {
-		server = CreateSocketServer(start++);
+	unsigned int const count = static_cast<unsigned int>(high - low + 1);
+	for (unsigned int i = 0; i < count; ++i) {
+		int const port = low + static_cast<int>(next_port.fetch_add(1) % count);
+		server = CreateSocketServer(port);
 		if (server) {
 			break;
 		}
-		if (start > high) {
-			start = low;
-		}
 	}
 
 	return server;
@@ -791,6 +827,10 @@ void CTransferSocket::TriggerPostponedEvents()
 void CTransferSocket::SetSocketBufferSizes(fz::socket_base& socket)
 {
 	const int size_read = engine_.GetOptions().get_int(OPTION_SOCKET_BUFFERSIZE_RECV);
+	if (size_read > 0) {
+		// Listings are read in chunks matching the receive buffer
+		listReadSize_ = std::clamp(static_cast<size_t>(size_read), size_t(16 * 1024), size_t(256 * 1024));
+	}
 #if FZ_WINDOWS
 	const int size_write = -1;
 #else
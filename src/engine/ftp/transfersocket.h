@@ -6,6 +6,7 @@
 class CFileZillaEnginePrivate;
 class CFtpControlSocket;
 class CDirectoryListingParser;
+class deflate_layer;
 
 enum class TransferMode
 {
@@ -44,6 +45,18 @@ public:
 	void set_reader(std::unique_ptr<fz::reader_base> && reader, bool ascii);
 	void set_writer(std::unique_ptr<fz::writer_base> && writer, bool ascii);
 
+	// Downloads only: Stop after the given number of bytes have been received,
+	// used when downloading just a segment of a file.
+	void set_limit(uint64_t limit);
+
+	// True once a limited download has received all the requested data. The
+	// server still has to be told to abort the remainder.
+	bool limit_reached() const { return has_limit_ && !limit_; }
+
+	// Compress the data connection with the given zlib level, see MODE Z.
+	// 0 disables compression.
+	void set_compression(int level) { compression_level_ = level; }
+
 	void ContinueWithoutSesssionResumption();
 
 protected:
@@ -94,6 +107,8 @@ protected:
 	std::unique_ptr<fz::rate_limited_layer> ratelimit_layer_;
 	std::unique_ptr<CProxySocket> proxy_layer_;
 	std::unique_ptr<fz::tls_layer> tls_layer_;
+	std::unique_ptr<deflate_layer> deflate_layer_;
+	int compression_level_{};
 #if HAVE_ASCII_TRANSFORM
 	std::unique_ptr<fz::ascii_layer> ascii_layer_;
 	bool use_ascii_{};
@@ -110,6 +125,12 @@ protected:
 	std::unique_ptr<fz::writer_base> writer_;
 	fz::buffer_lease buffer_;
 	size_t resumetest_{};
+
+	// Size of reads in list mode, see SetSocketBufferSizes
+	size_t listReadSize_{64 * 1024};
+
+	bool has_limit_{};
+	uint64_t limit_{};
 };
 
 #endif
@@ -5,6 +5,11 @@ CDirectoryListingNotification::CDirectoryListingNotification(CServerPath const&
 {
 }
 
+CDirectoryListingPartNotification::CDirectoryListingPartNotification(CServerPath const& path, std::vector<fz::shared_value<CDirentry>> && entries, bool first)
+	: m_path(path), entries_(std::move(entries)), first_(first)
+{
+}
+
 RequestId CFileExistsNotification::GetRequestID() const
 {
 	return reqId_fileexists;
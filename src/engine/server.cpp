@@ -648,6 +648,16 @@ bool CServer::ProtocolHasFeature(ServerProtocol const protocol, ProtocolFeature
 			return true;
 		}
 		break;
+	case ProtocolFeature::SegmentedDownload:
+		if (protocol == SFTP || protocol == FTP || protocol == FTPS || protocol == FTPES || protocol == INSECURE_FTP) {
+			return true;
+		}
+		break;
+	case ProtocolFeature::SegmentedUpload:
+		if (protocol == SFTP) {
+			return true;
+		}
+		break;
 	}
 	return false;
 }
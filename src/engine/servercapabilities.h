@@ -46,7 +46,10 @@ enum capabilityNames
 	auth_tls_command,
 	auth_ssl_command,
 
-	tls_resumption
+	tls_resumption,
+
+	// Set to 'no' if the server chokes on pipelined commands
+	command_pipelining
 };
 
 class CCapabilities final
@@ -3,31 +3,55 @@
 #include "delete.h"
 #include "../directorycache.h"
 
+#include <algorithm>
+
+namespace {
+// fzsftp keeps the removal requests of a single rm command in flight
+// together and replies to each file separately.
+size_t const max_batch = 64;
+}
+
 int CSftpDeleteOpData::Send()
 {
-	std::wstring const& file = files_.back();
-	if (file.empty()) {
-		log(logmsg::debug_info, L"Empty filename");
-		return FZ_REPLY_INTERNALERROR;
-	}
+	std::wstring cmd = L"rm";
+
+	size_t const count = std::min(files_.size(), max_batch);
+	for (size_t i = 0; i < count; ++i) {
+		std::wstring const& file = files_[files_.size() - 1 - i];
+		if (file.empty()) {
+			log(logmsg::debug_info, L"Empty filename");
+			return FZ_REPLY_INTERNALERROR;
+		}
 
-	std::wstring filename = path_.FormatFilename(file);
-	if (filename.empty()) {
-		log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
-		return FZ_REPLY_ERROR;
+		std::wstring filename = path_.FormatFilename(file);
+		if (filename.empty()) {
+			log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
+			return FZ_REPLY_ERROR;
+		}
+
+		cmd += L" " + controlSocket_.QuoteFilename(filename);
 	}
 
 	if (time_.empty()) {
 		time_ = fz::datetime::now();
 	}
 
-	engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+	for (size_t i = 0; i < count; ++i) {
+		engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, files_[files_.size() - 1 - i]);
+	}
 
-	return controlSocket_.SendCommand(L"rm " + controlSocket_.QuoteFilename(filename));
+	pending_ = count;
+	return controlSocket_.SendCommand(cmd);
 }
 
 int CSftpDeleteOpData::ParseResponse()
 {
+	if (!pending_ || files_.empty()) {
+		log(logmsg::debug_warning, L"Reply without pending file");
+		return FZ_REPLY_INTERNALERROR;
+	}
+	--pending_;
+
 	if (controlSocket_.result_ != FZ_REPLY_OK) {
 		deleteFailed_ = true;
 	}
@@ -49,6 +73,9 @@ int CSftpDeleteOpData::ParseResponse()
 
 	files_.pop_back();
 
+	if (pending_) {
+		return FZ_REPLY_WOULDBLOCK;
+	}
 	if (!files_.empty()) {
 		return FZ_REPLY_CONTINUE;
 	}
@@ -27,6 +27,10 @@ public:
 
 	// Set to true if deletion of at least one file failed
 	bool deleteFailed_{};
+
+	// Number of files of the last rm command still awaiting their reply.
+	// These are the files at the back of files_, replies arrive in order.
+	size_t pending_{};
 };
 
 #endif
@@ -5,7 +5,7 @@
 
 #include <string>
 
-#define FZSFTP_PROTOCOL_VERSION 11
+#define FZSFTP_PROTOCOL_VERSION 15
 
 enum class sftpEvent {
 	Unknown = -1,
@@ -39,6 +39,7 @@ enum class sftpEvent {
 	io_open,
 	io_nextbuf,
 	io_finalize,
+	TransferWindow,
 
 	count
 };
@@ -52,11 +53,19 @@ struct sftp_message
 struct sftp_event_type;
 typedef fz::simple_event<sftp_event_type, sftp_message> CSftpEvent;
 
+// A directory entry with its attributes as sent by the server. The
+// attribute flags tell which of the attributes are present.
 struct sftp_list_message
 {
-	mutable std::wstring text;
+	mutable std::wstring text; // The longname, formatted like ls -l
 	mutable std::wstring name;
-	uint64_t mtime;
+
+	uint32_t attr_flags{};
+	uint64_t size{};
+	uint32_t permissions{};
+	uint32_t uid{};
+	uint32_t gid{};
+	uint64_t mtime{};
 };
 
 struct sftp_list_event_type;
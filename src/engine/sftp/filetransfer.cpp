@@ -55,12 +55,24 @@ int CSftpFileTransferOpData::Send()
 		// whereas we need to use server encoding for remote filenames.
 		std::string cmd;
 		std::wstring logstr;
-		if (resume_) {
+		if (resume_ && !segment_) {
 			cmd = "re";
 			logstr = L"re";
 		}
+
+		// Segments are passed as range of the first byte and the byte after the last one
+		std::string range;
+		if (segment_) {
+			range = fz::sprintf(" %u %u", segment_.offset + segment_.done, segment_.offset + segment_.length);
+		}
+
 		if (download()) {
-			engine_.transfer_status_.Init(remoteFileSize_, resume_ ? localFileSize_ : 0, false);
+			if (segment_) {
+				engine_.transfer_status_.Init(segment_.length, segment_.done, false);
+			}
+			else {
+				engine_.transfer_status_.Init(remoteFileSize_, resume_ ? localFileSize_ : 0, false);
+			}
 			cmd += "get ";
 			logstr += L"get ";
 			
@@ -77,7 +89,12 @@ int CSftpFileTransferOpData::Send()
 			logstr += localFile;
 		}
 		else {
-			engine_.transfer_status_.Init(localFileSize_, resume_ ? remoteFileSize_ : 0, false);
+			if (segment_) {
+				engine_.transfer_status_.Init(segment_.length, segment_.done, false);
+			}
+			else {
+				engine_.transfer_status_.Init(localFileSize_, resume_ ? remoteFileSize_ : 0, false);
+			}
 			cmd += "put ";
 			logstr += L"put ";
 
@@ -93,6 +110,9 @@ int CSftpFileTransferOpData::Send()
 			cmd += remoteFile;
 			logstr += controlSocket_.QuoteFilename(remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_));
 		}
+		cmd += range;
+		logstr += fz::to_wstring(range);
+
 		engine_.transfer_status_.SetStartTime();
 		transferInitiated_ = true;
 		controlSocket_.SetWait(true);
@@ -129,7 +149,9 @@ int CSftpFileTransferOpData::ParseResponse()
 {
 	if (opState == filetransfer_transfer) {
 		writer_.reset();
-		if (controlSocket_.result_ == FZ_REPLY_OK && options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
+		// Segments leave timestamps alone, segmented_transfer applies the one of
+		// a download once all segments are done
+		if (controlSocket_.result_ == FZ_REPLY_OK && options_.get_int(OPTION_PRESERVE_TIMESTAMPS) && !segment_) {
 			if (download()) {
 				if (!remoteFileTime_.empty()) {
 					if (!writer_factory_->set_mtime(remoteFileTime_)) {
@@ -314,24 +336,39 @@ void CSftpFileTransferOpData::OnOpenRequested(uint64_t offset)
 	}
 
 	if (download()) {
-		if (resume_) {
-			offset = writer_factory_.size();
-			if (offset == fz::aio_base::nosize) {
-				controlSocket_.AddToSendBuffer("-1\n");
-				return;
-			}
+		if (segment_) {
+			offset = segment_.offset + segment_.done;
+			writer_ = controlSocket_.OpenSegmentWriter(writer_factory_, segment_, true);
 		}
 		else {
-			offset = 0;
+			if (resume_) {
+				offset = writer_factory_.size();
+				if (offset == fz::aio_base::nosize) {
+					controlSocket_.AddToSendBuffer("-1\n");
+					return;
+				}
+			}
+			else {
+				offset = 0;
+			}
+			writer_ = controlSocket_.OpenWriter(writer_factory_, offset, true);
 		}
-		writer_ = controlSocket_.OpenWriter(writer_factory_, offset, true);
 		if (!writer_) {
 			controlSocket_.AddToSendBuffer("--\n");
 			return;
 		}
 	}
 	else {
-		reader_ = reader_factory_->open(*controlSocket_.buffer_pool_, offset, fz::aio_base::nosize, controlSocket_.max_buffer_count());
+		uint64_t size = fz::aio_base::nosize;
+		if (segment_) {
+			uint64_t const end = segment_.offset + segment_.length;
+			if (offset < segment_.offset || offset > end) {
+				controlSocket_.AddToSendBuffer("--\n");
+				return;
+			}
+			size = end - offset;
+		}
+		reader_ = reader_factory_->open(*controlSocket_.buffer_pool_, offset, size, controlSocket_.max_buffer_count());
 		if (!reader_) {
 			controlSocket_.AddToSendBuffer("--\n");
 			return;
@@ -50,6 +50,7 @@ size_t SftpInputParser::lines(sftpEvent eventType) const
 	case sftpEvent::io_open:
 	case sftpEvent::io_finalize:
 	case sftpEvent::io_nextbuf:
+	case sftpEvent::TransferWindow:
 		return 1;
 	case sftpEvent::AskHostkey:
 	case sftpEvent::AskHostkeyChanged:
@@ -61,6 +62,32 @@ size_t SftpInputParser::lines(sftpEvent eventType) const
 	return 0;
 }
 
+bool SftpInputParser::ParseAttributes(std::string_view line, sftp_list_message & message)
+{
+	// Flags, size, permissions, uid, gid and mtime
+	uint64_t fields[6];
+	for (auto & field : fields) {
+		size_t const pos = line.find(' ');
+		auto const token = line.substr(0, pos);
+		if (token.empty() || token.find_first_not_of("0123456789") != std::string_view::npos) {
+			return false;
+		}
+		field = fz::to_integral<uint64_t>(token);
+		line = (pos == std::string_view::npos) ? std::string_view() : line.substr(pos + 1);
+	}
+	if (!line.empty()) {
+		return false;
+	}
+
+	message.attr_flags = static_cast<uint32_t>(fields[0]);
+	message.size = fields[1];
+	message.permissions = static_cast<uint32_t>(fields[2]);
+	message.uid = static_cast<uint32_t>(fields[3]);
+	message.gid = static_cast<uint32_t>(fields[4]);
+	message.mtime = fields[5];
+	return true;
+}
+
 int SftpInputParser::OnData()
 {
 	bool need_read = true;
@@ -119,8 +146,12 @@ int SftpInputParser::OnData()
 					std::get<0>(event_->v_).text[i] = std::move(converted);
 				}
 				else {
-					if (i == 1) {
-						std::get<0>(listEvent_->v_).mtime = fz::to_integral<uint64_t>(line);
+					auto & message = std::get<0>(listEvent_->v_);
+					if (!i) {
+						if (!ParseAttributes(line, message)) {
+							owner_.log(logmsg::error, _("Received malformed directory entry from child process."));
+							return FZ_REPLY_DISCONNECTED;
+						}
 					}
 					else {
 						std::wstring converted = owner_.ConvToLocal(line.data(), line.size());
@@ -128,11 +159,11 @@ int SftpInputParser::OnData()
 							owner_.log(logmsg::error, _("Failed to convert reply to local character set."));
 							return FZ_REPLY_DISCONNECTED;
 						}
-						if (i) {
-							std::get<0>(listEvent_->v_).name = std::move(converted);
+						if (i == 1) {
+							message.name = std::move(converted);
 						}
 						else {
-							std::get<0>(listEvent_->v_).text = std::move(converted);
+							message.text = std::move(converted);
 						}
 					}
 				}
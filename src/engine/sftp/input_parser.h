@@ -7,6 +7,8 @@ class CSftpControlSocket;
 
 #include <libfilezilla/buffer.hpp>
 
+#include <string_view>
+
 namespace fz {
 class process;
 }
@@ -23,6 +25,8 @@ protected:
 
 	size_t lines(sftpEvent eventType) const;
 
+	static bool ParseAttributes(std::string_view line, sftp_list_message & message);
+
 	fz::process& process_;
 	CSftpControlSocket& owner_;
 
@@ -13,6 +13,91 @@ enum listStates
 	list_list
 };
 
+namespace {
+// See the SFTP specification, draft-ietf-secsh-filexfer-02
+uint32_t const attr_size = 0x1;
+uint32_t const attr_uidgid = 0x2;
+uint32_t const attr_permissions = 0x4;
+uint32_t const attr_acmodtime = 0x8;
+
+uint32_t const type_mask = 0170000;
+uint32_t const type_dir = 0040000;
+uint32_t const type_link = 0120000;
+
+// Same format as in ls -l
+std::wstring FormatPermissions(uint32_t mode)
+{
+	std::wstring ret(10, '-');
+	switch (mode & type_mask) {
+	case type_dir:
+		ret[0] = 'd';
+		break;
+	case type_link:
+		ret[0] = 'l';
+		break;
+	case 0020000:
+		ret[0] = 'c';
+		break;
+	case 0060000:
+		ret[0] = 'b';
+		break;
+	case 0010000:
+		ret[0] = 'p';
+		break;
+	case 0140000:
+		ret[0] = 's';
+		break;
+	}
+
+	wchar_t const chars[] = L"rwx";
+	for (int i = 0; i < 9; ++i) {
+		if (mode & (0400 >> i)) {
+			ret[i + 1] = chars[i % 3];
+		}
+	}
+
+	auto special = [&](uint32_t bit, size_t pos, wchar_t c) {
+		if (mode & bit) {
+			ret[pos] = (ret[pos] == 'x') ? c : static_cast<wchar_t>(c - 'a' + 'A');
+		}
+	};
+	special(04000, 3, 's');
+	special(02000, 6, 's');
+	special(01000, 9, 't');
+
+	return ret;
+}
+
+// Owner and group names are only part of the longname. Servers all format it
+// like ls -l, permissions and link count followed by owner and group.
+std::wstring GetOwnerGroup(sftp_list_message const& message)
+{
+	std::wstring_view v = message.text;
+	std::wstring_view tokens[4];
+	size_t n = 0;
+	while (n < 4) {
+		size_t const start = v.find_first_not_of(' ');
+		if (start == std::wstring_view::npos) {
+			break;
+		}
+		v = v.substr(start);
+		size_t const end = v.find(' ');
+		tokens[n++] = v.substr(0, end);
+		v = (end == std::wstring_view::npos) ? std::wstring_view() : v.substr(end);
+	}
+
+	if (n == 4 && !v.empty() && tokens[0].size() >= 10 && tokens[1].find_first_not_of(L"0123456789") == std::wstring_view::npos) {
+		return std::wstring(tokens[2]) + L" " + std::wstring(tokens[3]);
+	}
+
+	if (message.attr_flags & attr_uidgid) {
+		return fz::sprintf(L"%u %u", message.uid, message.gid);
+	}
+
+	return std::wstring();
+}
+}
+
 int CSftpListOpData::Send()
 {
 	if (opState == list_init) {
@@ -61,6 +146,7 @@ int CSftpListOpData::Send()
 	}
 	else if (opState == list_list) {
 		listing_parser_ = std::make_unique<CDirectoryListingParser>(&controlSocket_, currentServer_, listingEncoding::unknown);
+		controlSocket_.SetupPartialListingNotifications(*listing_parser_, currentPath_);
 		return controlSocket_.SendCommand(L"ls");
 	}
 
@@ -117,31 +203,55 @@ int CSftpListOpData::SubcommandResult(int prevResult, COpData const&)
 	return FZ_REPLY_CONTINUE;
 }
 
-int CSftpListOpData::ParseEntry(std::wstring && entry, uint64_t mtime, std::wstring && name)
+int CSftpListOpData::ParseEntry(sftp_list_message const& message)
 {
 	if (opState != list_list) {
-		controlSocket_.log_raw(logmsg::listing, entry);
+		controlSocket_.log_raw(logmsg::listing, message.text);
 		log(logmsg::debug_warning, L"CSftpListOpData::ParseEntry called at improper time: %d", opState);
 		return FZ_REPLY_INTERNALERROR;
 	}
 
-	if (entry.size() > 65536 || name.size() > 65536) {
+	if (message.text.size() > 65536 || message.name.size() > 65536) {
 		log(fz::logmsg::error, _("Received too long response line from server, closing connection."));
 		return FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED;
 	}
 
 
 	if (!listing_parser_) {
-		controlSocket_.log_raw(logmsg::listing, entry);
+		controlSocket_.log_raw(logmsg::listing, message.text);
 		log(logmsg::debug_warning, L"listing_parser_ is null");
 		return FZ_REPLY_INTERNALERROR;
 	}
 
 	fz::datetime time;
-	if (mtime) {
-		time = fz::datetime(static_cast<time_t>(mtime), fz::datetime::seconds);
+	if ((message.attr_flags & attr_acmodtime) && message.mtime) {
+		time = fz::datetime(static_cast<time_t>(message.mtime), fz::datetime::seconds);
+	}
+
+	if (!(message.attr_flags & attr_permissions)) {
+		// Without the file type, the longname is all there is to go by
+		listing_parser_->AddLine(std::move(message.text), std::move(message.name), time);
+		return FZ_REPLY_WOULDBLOCK;
 	}
-	listing_parser_->AddLine(std::move(entry), std::move(name), time);
+
+	controlSocket_.log_raw(logmsg::listing, message.text);
+
+	CDirentry entry;
+	entry.name = std::move(message.name);
+	entry.flags = 0;
+	switch (message.permissions & type_mask) {
+	case type_dir:
+		entry.flags |= CDirentry::flag_dir;
+		break;
+	case type_link:
+		// Like in ls -l listings, links might point to a directory
+		entry.flags |= CDirentry::flag_dir | CDirentry::flag_link;
+		break;
+	}
+	entry.size = (message.attr_flags & attr_size) ? static_cast<int64_t>(message.size) : -1;
+	entry.time = time;
+
+	listing_parser_->AddEntry(std::move(entry), FormatPermissions(message.permissions), GetOwnerGroup(message));
 
 	return FZ_REPLY_WOULDBLOCK;
 }
@@ -8,13 +8,13 @@ enum mkdStates
 	mkd_init = 0,
 	mkd_findparent,
 	mkd_mkdsub,
-	mkd_cwdsub,
 	mkd_tryfull
 };
 
 /* Directory creation works like this: First find a parent directory into
- * which we can CWD, then create the subdirs one by one. If either part
- * fails, try MKD with the full path directly.
+ * which we can CWD, then create all subdirs with a single mkdir command.
+ * fzsftp pipelines the requests and replies to each subdir in order. If
+ * either part fails, try MKD with the full path directly.
  */
 
 int CSftpMkdirOpData::Send()
@@ -63,11 +63,22 @@ int CSftpMkdirOpData::Send()
 		}
 		return FZ_REPLY_CONTINUE;
 	case mkd_findparent:
-	case mkd_cwdsub:
 		currentPath_.clear();
 		return controlSocket_.SendCommand(L"cd " + controlSocket_.QuoteFilename(currentMkdPath_.GetPath()));
 	case mkd_mkdsub:
-		return controlSocket_.SendCommand(L"mkdir " + controlSocket_.QuoteFilename(segments_.back()));
+		{
+			std::wstring cmd = L"mkdir";
+			CServerPath path = currentMkdPath_;
+			for (auto it = segments_.crbegin(); it != segments_.crend(); ++it) {
+				if (!path.AddSegment(*it)) {
+					log(logmsg::debug_warning, L"Could not append segment %s to %s", *it, path.GetPath());
+					return FZ_REPLY_INTERNALERROR;
+				}
+				cmd += L" " + controlSocket_.QuoteFilename(path.GetPath());
+			}
+			pending_ = segments_.size();
+			return controlSocket_.SendCommand(cmd);
+		}
 	case mkd_tryfull:
 		return controlSocket_.SendCommand(L"mkdir " + controlSocket_.QuoteFilename(path_.GetPath()));
 	default:
@@ -99,11 +110,13 @@ int CSftpMkdirOpData::ParseResponse()
 		}
 		return FZ_REPLY_CONTINUE;
 	case mkd_mkdsub:
+		if (!pending_ || segments_.empty()) {
+			log(logmsg::debug_warning, L"  no pending subdirectory");
+			return FZ_REPLY_INTERNALERROR;
+		}
+		--pending_;
+
 		if (successful) {
-			if (segments_.empty()) {
-				log(logmsg::debug_warning, L"  segments_ is empty");
-				return FZ_REPLY_INTERNALERROR;
-			}
 			engine_.GetDirectoryCache().UpdateFile(currentServer_, currentMkdPath_, segments_.back(), true, CDirectoryCache::dir);
 			controlSocket_.SendDirectoryListingNotification(currentMkdPath_, false);
 
@@ -113,24 +126,19 @@ int CSftpMkdirOpData::ParseResponse()
 			if (segments_.empty()) {
 				return FZ_REPLY_OK;
 			}
-			else {
-				opState = mkd_cwdsub;
-			}
-		}
-		else {
-			opState = mkd_tryfull;
-		}
-		return FZ_REPLY_CONTINUE;
-	case mkd_cwdsub:
-		if (successful) {
-			currentPath_ = currentMkdPath_;
-			opState = mkd_mkdsub;
 		}
 		else {
+			// Any subdirs after the failed one fail as well
+			segments_.clear();
 			opState = mkd_tryfull;
 		}
-		return FZ_REPLY_CONTINUE;
+		return pending_ ? FZ_REPLY_WOULDBLOCK : FZ_REPLY_CONTINUE;
 	case mkd_tryfull:
+		if (pending_) {
+			// Remaining replies of the failed mkdir command
+			--pending_;
+			return pending_ ? FZ_REPLY_WOULDBLOCK : FZ_REPLY_CONTINUE;
+		}
 		return successful ? FZ_REPLY_OK : FZ_REPLY_ERROR;
 	default:
 		log(logmsg::debug_warning, L"unknown op state: %d", opState);
@@ -13,6 +13,10 @@ public:
 
 	virtual int Send() override;
 	virtual int ParseResponse() override;
+
+private:
+	// Subdirectories of the last mkdir command still awaiting their reply
+	size_t pending_{};
 };
 
 #endif
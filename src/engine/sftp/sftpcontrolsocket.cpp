@@ -139,6 +139,9 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 			}
 		}
 		break;
+	case sftpEvent::TransferWindow:
+		engine_.transfer_status_.SetWindow(fz::to_integral<int64_t>(message.text[0], -1));
+		break;
 	case sftpEvent::AskHostkey:
 	case sftpEvent::AskHostkeyChanged:
 		{
@@ -302,7 +305,7 @@ void CSftpControlSocket::OnSftpListEvent(sftp_list_message const& message)
 		return;
 	}
 	else {
-		int res = static_cast<CSftpListOpData&>(*operations_.back()).ParseEntry(std::move(message.text), message.mtime, std::move(message.name));
+		int res = static_cast<CSftpListOpData&>(*operations_.back()).ParseEntry(message);
 		if (res != FZ_REPLY_WOULDBLOCK) {
 			ResetOperation(res);
 		}
@@ -1,6 +1,11 @@
+#include "filezilla.h"
 #include "tls.h"
 #include "../include/engine_options.h"
 
+#include <libfilezilla/encode.hpp>
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
 fz::tls_ver get_min_tls_ver(COptionsBase & options)
 {
 	auto v = options.get_int(OPTION_MIN_TLS_VER);
@@ -15,3 +20,213 @@ fz::tls_ver get_min_tls_ver(COptionsBase & options)
 		return fz::tls_ver::v1_3;
 	}
 }
+
+fz::duration const tls_session_cache::lifetime = fz::duration::from_hours(2);
+
+namespace {
+char const header[] = "FZTLSSESSIONS1";
+}
+
+tls_session_cache::~tls_session_cache()
+{
+	fz::scoped_lock l(mtx_);
+	save();
+}
+
+tls_session_cache::key_type tls_session_cache::key(CServer const& server)
+{
+	return key_type(static_cast<int>(server.GetProtocol()), fz::str_tolower_ascii(server.GetHost()), server.GetPort());
+}
+
+std::vector<uint8_t> tls_session_cache::get(CServer const& server)
+{
+	fz::scoped_lock l(mtx_);
+
+	auto it = sessions_.find(key(server));
+	if (it == sessions_.end()) {
+		return std::vector<uint8_t>();
+	}
+	if (it->second.expiry < fz::datetime::now()) {
+		sessions_.erase(it);
+		dirty_ = true;
+		return std::vector<uint8_t>();
+	}
+
+	return it->second.session;
+}
+
+void tls_session_cache::store(CServer const& server, std::vector<uint8_t> const& session)
+{
+	if (session.empty()) {
+		return;
+	}
+
+	fz::scoped_lock l(mtx_);
+	if (!enabled_) {
+		return;
+	}
+
+	auto & e = sessions_[key(server)];
+	e.session = session;
+	e.expiry = fz::datetime::now() + lifetime;
+	dirty_ = true;
+
+	if (sessions_.size() > max_sessions) {
+		auto oldest = sessions_.begin();
+		for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+			if (it->second.expiry < oldest->second.expiry) {
+				oldest = it;
+			}
+		}
+		sessions_.erase(oldest);
+	}
+}
+
+void tls_session_cache::set_enabled(bool enabled)
+{
+	fz::scoped_lock l(mtx_);
+	enabled_ = enabled;
+	if (!enabled_) {
+		sessions_.clear();
+		dirty_ = true;
+	}
+}
+
+void tls_session_cache::set_persistent_file(std::wstring const& file)
+{
+	fz::scoped_lock l(mtx_);
+
+	if (file == file_) {
+		return;
+	}
+
+	if (file.empty()) {
+		fz::remove_file(fz::to_native(file_));
+	}
+	else {
+		save();
+	}
+
+	file_ = file;
+	load();
+}
+
+void tls_session_cache::load()
+{
+	if (file_.empty() || !enabled_) {
+		return;
+	}
+
+	fz::file f;
+	if (!f.open(fz::to_native(file_), fz::file::reading, fz::file::existing)) {
+		return;
+	}
+
+	int64_t const size = f.size();
+	if (size <= 0 || size > 1024 * 1024 * 16) {
+		return;
+	}
+
+	std::string data;
+	data.resize(static_cast<size_t>(size));
+	if (f.read(&data[0], size) != size) {
+		return;
+	}
+
+	auto const now = fz::datetime::now();
+
+	// One session per line: expiry, protocol, port, host and session
+	// parameters, the latter two hex-encoded.
+	size_t pos = data.find('\n');
+	if (pos == std::string::npos || data.substr(0, pos) != header) {
+		return;
+	}
+	++pos;
+	while (pos < data.size()) {
+		size_t end = data.find('\n', pos);
+		if (end == std::string::npos) {
+			end = data.size();
+		}
+
+		std::vector<std::string> tokens;
+		size_t start = pos;
+		while (start < end) {
+			size_t sep = data.find(' ', start);
+			if (sep == std::string::npos || sep > end) {
+				sep = end;
+			}
+			tokens.emplace_back(data.substr(start, sep - start));
+			start = sep + 1;
+		}
+		pos = end + 1;
+
+		if (tokens.size() != 5) {
+			continue;
+		}
+
+		fz::datetime const expiry(fz::to_integral<time_t>(tokens[0]), fz::datetime::seconds);
+		if (expiry.empty() || expiry < now) {
+			continue;
+		}
+
+		auto const host = fz::hex_decode<std::string>(tokens[3]);
+		auto session = fz::hex_decode(tokens[4]);
+		if (host.empty() || session.empty()) {
+			continue;
+		}
+
+		auto & e = sessions_[key_type(fz::to_integral<int>(tokens[1]), fz::to_wstring_from_utf8(host), fz::to_integral<unsigned int>(tokens[2]))];
+		if (e.expiry.empty() || e.expiry < expiry) {
+			e.session = std::move(session);
+			e.expiry = expiry;
+		}
+	}
+}
+
+void tls_session_cache::save()
+{
+	if (file_.empty() || !dirty_) {
+		return;
+	}
+	dirty_ = false;
+
+	auto const now = fz::datetime::now();
+
+	std::string data = header;
+	data += '\n';
+	for (auto const& s : sessions_) {
+		if (s.second.expiry < now) {
+			continue;
+		}
+		data += fz::to_string(s.second.expiry.get_time_t());
+		data += ' ';
+		data += fz::to_string(std::get<0>(s.first));
+		data += ' ';
+		data += fz::to_string(std::get<2>(s.first));
+		data += ' ';
+		data += fz::hex_encode<std::string>(fz::to_utf8(std::get<1>(s.first)));
+		data += ' ';
+		data += fz::hex_encode<std::string>(s.second.session);
+		data += '\n';
+	}
+
+	// Session tickets allow resuming the sessions, only the current user may
+	// read them. Write to a temporary file that replaces the old one, so a
+	// failed write does not lose the previous sessions.
+	std::wstring const temp = file_ + L".tmp";
+	{
+		fz::file f;
+		if (!f.open(fz::to_native(temp), fz::file::writing, static_cast<fz::file::creation_flags>(fz::file::empty | fz::file::current_user_only))) {
+			return;
+		}
+		if (f.write(data.c_str(), static_cast<int64_t>(data.size())) != static_cast<int64_t>(data.size()) || !f.fsync()) {
+			f.close();
+			fz::remove_file(fz::to_native(temp));
+			return;
+		}
+	}
+
+	if (!fz::rename_file(fz::to_native(temp), fz::to_native(file_))) {
+		fz::remove_file(fz::to_native(temp));
+	}
+}
@@ -1,9 +1,69 @@
 #ifndef FILEZILLA_ENGINE_TLS_HEADER
 #define FILEZILLA_ENGINE_TLS_HEADER
 
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
 #include <libfilezilla/tls_layer.hpp>
 
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
 class COptionsBase;
+class CServer;
 fz::tls_ver get_min_tls_ver(COptionsBase & options);
 
+// Remembers TLS sessions of control connections, so that further connections
+// to the same server, be it from another engine or after a restart, can resume
+// the session instead of going through a full handshake.
+//
+// Optionally the sessions are kept in a file. As the session parameters hold
+// key material, the file is removed again once persistence gets disabled.
+class tls_session_cache final
+{
+public:
+	tls_session_cache() = default;
+	~tls_session_cache();
+
+	tls_session_cache(tls_session_cache const&) = delete;
+	tls_session_cache& operator=(tls_session_cache const&) = delete;
+
+	// Returns an empty vector if there is no usable session
+	std::vector<uint8_t> get(CServer const& server);
+	void store(CServer const& server, std::vector<uint8_t> const& session);
+
+	// Disabling the cache forgets all sessions
+	void set_enabled(bool enabled);
+
+	// Empty to not persist sessions
+	void set_persistent_file(std::wstring const& file);
+
+	static size_t constexpr max_sessions = 256;
+
+	// Servers usually expire their tickets earlier, this merely avoids
+	// resuming sessions certain to fail.
+	static fz::duration const lifetime;
+
+private:
+	typedef std::tuple<int, std::wstring, unsigned int> key_type;
+	static key_type key(CServer const& server);
+
+	void load();
+	void save();
+
+	struct entry final
+	{
+		std::vector<uint8_t> session;
+		fz::datetime expiry;
+	};
+
+	fz::mutex mtx_;
+	std::map<key_type, entry> sessions_;
+
+	bool enabled_{true};
+	std::wstring file_;
+	bool dirty_{};
+};
+
 #endif
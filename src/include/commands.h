@@ -221,17 +221,36 @@ namespace ftp_transfer_flags
 	auto constexpr ascii = transfer_flags::protocol_reserved_max;
 }
 
+// A byte range of a file, used when a single file is transferred in
+// several segments over multiple connections.
+//
+// The local file is neither truncated nor checked for existence when
+// transferring a segment, the caller is responsible for that.
+struct transfer_segment final
+{
+	uint64_t offset{};
+	uint64_t length{};
+
+	// Bytes at the start of the segment that have already been
+	// transferred. The transfer resumes after them.
+	uint64_t done{};
+
+	bool empty() const { return !length; }
+	explicit operator bool() const { return !empty(); }
+};
+
 class FZC_PUBLIC_SYMBOL CFileTransferCommand final : public CCommandHelper<CFileTransferCommand, Command::transfer>
 {
 public:
-	CFileTransferCommand(fz::reader_factory_holder const& reader, CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraflags = {});
-	CFileTransferCommand(fz::writer_factory_holder const& writer, CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags = {});
+	CFileTransferCommand(fz::reader_factory_holder const& reader, CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraflags = {}, transfer_segment const& segment = {});
+	CFileTransferCommand(fz::writer_factory_holder const& writer, CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags = {}, transfer_segment const& segment = {});
 
 	CServerPath GetRemotePath() const;
 	std::wstring GetRemoteFile() const;
 	bool Download() const { return flags_ & transfer_flags::download; }
 	transfer_flags const& GetFlags() const { return flags_; }
 	std::wstring const& GetExtraFlags() const { return extraFlags_; }
+	transfer_segment const& GetSegment() const { return segment_; }
 
 	bool valid() const;
 
@@ -245,6 +264,7 @@ protected:
 	std::wstring const m_remoteFile;
 	transfer_flags const flags_;
 	std::wstring const extraFlags_;
+	transfer_segment const segment_;
 };
 
 class FZC_PUBLIC_SYMBOL CHttpRequestCommand final : public CCommandHelper<CHttpRequestCommand, Command::httprequest>
@@ -7,7 +7,7 @@
 #include <libfilezilla/shared.hpp>
 #include <libfilezilla/time.hpp>
 
-#include <unordered_map>
+#include <vector>
 
 class FZC_PUBLIC_SYMBOL CDirentry
 {
@@ -92,6 +92,9 @@ public:
 
 	void Append(CDirentry&& entry);
 
+	// Appends the entries and updates the flags accordingly
+	void Append(std::vector<fz::shared_value<CDirentry>> const& entries);
+
 	size_t FindFile_CmpCase(std::wstring const& name) const;
 	size_t FindFile_CmpNoCase(std::wstring const& name) const;
 
@@ -146,8 +149,11 @@ protected:
 
 	fz::shared_optional<std::vector<fz::shared_value<CDirentry>>> m_entries;
 
-	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_case;
-	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_nocase;
+	// Lazily built open addressing hash tables for the FindFile functions. Each
+	// slot holds the hash of the name in the upper and the entry index plus one
+	// in the lower 32 bits. The names themselves aren't copied.
+	mutable fz::shared_optional<std::vector<uint64_t>> m_searchmap_case;
+	mutable fz::shared_optional<std::vector<uint64_t>> m_searchmap_nocase;
 
 public:
 	int m_flags{};
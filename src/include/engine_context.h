@@ -4,12 +4,16 @@
 #include "visibility.h"
 
 #include <memory>
+#include <string>
+
+#include <stdint.h>
 
 class activity_logger;
 class CDirectoryCache;
 class COptionsBase;
 class CPathCache;
 class OpLockManager;
+class tls_session_cache;
 
 namespace fz {
 class event_loop;
@@ -19,6 +23,23 @@ class tls_system_trust_store;
 }
 
 
+struct directory_cache_stats final
+{
+	int64_t hits{};
+	int64_t misses{};
+
+	// Hits on listings older than the cache TTL
+	int64_t outdated{};
+
+	int64_t evictions{};
+
+	size_t listings{};
+	int64_t files{};
+
+	// Estimated memory used by the cached listings, in bytes
+	int64_t size{};
+};
+
 class FZC_PUBLIC_SYMBOL CustomEncodingConverterBase
 {
 public:
@@ -38,12 +59,21 @@ public:
 	COptionsBase& GetOptions() { return options_; }
 	fz::thread_pool& GetThreadPool();
 	fz::event_loop& GetEventLoop();
+
+	// Event loop for a new engine. With OPTION_ENGINE_EVENT_LOOPS set to
+	// more than one loop, engines get spread over multiple loops each running
+	// in its own thread. Each acquired loop must be released again.
+	fz::event_loop& AcquireEngineEventLoop();
+	void ReleaseEngineEventLoop(fz::event_loop& loop);
+
 	fz::rate_limiter& GetRateLimiter();
 	CDirectoryCache& GetDirectoryCache();
+	directory_cache_stats GetDirectoryCacheStats();
 	CPathCache& GetPathCache();
 	CustomEncodingConverterBase const& GetCustomEncodingConverter() { return customEncodingConverter_; }
 	OpLockManager& GetOpLockManager();
 	fz::tls_system_trust_store& GetTlsSystemTrustStore();
+	tls_session_cache& GetTlsSessionCache();
 	activity_logger& GetActivityLogger();
 
 protected:
@@ -78,9 +78,22 @@ enum engineOptions : unsigned int
 	OPTION_TCP_KEEPALIVE_INTERVAL,
 
 	OPTION_CACHE_TTL,
+	OPTION_CACHE_MEMORY_LIMIT,
+	OPTION_CACHE_EVICTION_POLICY,
+	OPTION_CACHE_PERSISTENT,
+	OPTION_CACHE_DIRECTORY,
 
 	OPTION_MIN_TLS_VER,
 
+	OPTION_ENGINE_EVENT_LOOPS,
+
+	OPTION_TLS_SESSION_CACHE, // 0 disabled, 1 in memory, 2 also kept on disk
+	OPTION_TLS_SESSION_CACHE_FILE,
+
+	OPTION_FTP_COMPRESSION_LEVEL, // MODE Z, 0 to disable
+
+	OPTION_FTP_PIPELINE_DEPTH, // Commands sent ahead of replies in batch operations, 1 (the default) disables it
+
 	OPTIONS_ENGINE_NUM
 };
 
@@ -19,6 +19,7 @@
 // CFileZillaEngine::SetAsyncRequestReply to continue the current operation.
 
 #include "commands.h"
+#include "directorylisting.h"
 #include "local_path.h"
 #include "logging.h"
 #include "server.h"
@@ -36,7 +37,8 @@ enum NotificationId : unsigned int
 	nId_sftp_encryption,	// information about key exchange, encryption algorithms and so on for SFTP
 	nId_local_dir_created,	// local directory has been created
 	nId_serverchange,		// With some protocols, actual server identity isn't known until after logon
-	nId_ftp_tls_resumption
+	nId_ftp_tls_resumption,
+	nId_listing_part		// parts of a directory listing while it is being received
 };
 
 // Async request IDs
@@ -134,6 +136,26 @@ protected:
 	CServerPath m_path;
 };
 
+// Sent while a primary directory listing is being received, containing the
+// entries parsed since the previous part. The entries are preliminary, the
+// complete listing follows with a CDirectoryListingNotification.
+class FZC_PUBLIC_SYMBOL CDirectoryListingPartNotification final : public CNotificationHelper<nId_listing_part>
+{
+public:
+	CDirectoryListingPartNotification(CServerPath const& path, std::vector<fz::shared_value<CDirentry>> && entries, bool first);
+
+	CServerPath const& GetPath() const { return m_path; }
+	std::vector<fz::shared_value<CDirentry>> const& GetEntries() const { return entries_; }
+
+	// If set, previously received parts for the same path are to be discarded
+	bool First() const { return first_; }
+
+protected:
+	CServerPath m_path;
+	std::vector<fz::shared_value<CDirentry>> entries_;
+	bool first_{};
+};
+
 class FZC_PUBLIC_SYMBOL CAsyncRequestNotification : public CNotificationHelper<nId_asyncrequest>
 {
 public:
@@ -255,6 +277,9 @@ public:
 	bool madeProgress{};
 
 	bool list{};
+
+	// Read-ahead window of SFTP downloads in bytes, -1 if not applicable
+	int64_t window{-1};
 };
 
 class FZC_PUBLIC_SYMBOL CTransferStatusNotification final : public CNotificationHelper<nId_transferstatus>
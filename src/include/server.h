@@ -111,7 +111,9 @@ enum class ProtocolFeature
 	ProExclusive,
 	ListVersions,
 	DownloadVersion,
-	DeleteVersion
+	DeleteVersion,
+	SegmentedDownload, // A single file can be downloaded as multiple byte ranges in parallel, see transfer_segment
+	SegmentedUpload
 };
 
 enum class CaseSensitivity
@@ -1078,6 +1078,11 @@ void CMainFrame::OnEngineEvent(CFileZillaEngine* engine)
 				}
 			}
 			break;
+		case nId_listing_part:
+			if (pState->m_pCommandQueue) {
+				pState->m_pCommandQueue->ProcessDirectoryListingPart(static_cast<CDirectoryListingPartNotification const&>(*pNotification.get()));
+			}
+			break;
 		case nId_asyncrequest:
 			{
 				auto pAsyncRequest = unique_static_cast<CAsyncRequestNotification>(std::move(pNotification));
@@ -115,7 +115,12 @@ static unsigned int register_interface_options()
 		{ "Drag and Drop disabled", false, option_flags::normal },
 		{ "Disable update footer", false, option_flags::normal },
 		{ "Tab data", L"", option_flags::normal | option_flags::sensitive_data, option_type::xml },
-		{ "Highest shown overlay id", 0, option_flags::normal }
+		{ "Highest shown overlay id", 0, option_flags::normal },
+		{ "Recursive listing connections", 0, option_flags::numeric_clamp, 0, 10 },
+		{ "Local recursion threads", 4, option_flags::numeric_clamp, 1, 32 },
+		{ "Journal queue", false, option_flags::normal },
+		{ "Queue idle connection timeout", 60, option_flags::numeric_clamp, 1, 3600 },
+		{ "Segmented download connections", 0, option_flags::numeric_clamp, 0, 10 }
 	});
 	return value;
 }
@@ -86,6 +86,11 @@ enum interfaceOptions : unsigned int
 	OPTION_DISABLE_UPDATE_FOOTER,
 	OPTION_TAB_DATA,
 	OPTION_SHOWN_OVERLAY,
+	OPTION_RECURSIVE_LIST_CONNECTIONS,
+	OPTION_LOCAL_RECURSION_THREADS,
+	OPTION_QUEUE_JOURNAL,
+	OPTION_QUEUE_IDLE_TIMEOUT,
+	OPTION_SEGMENTED_DOWNLOAD_CONNECTIONS,
 
 	// Has to be last element
 	OPTIONS_NUM
@@ -26,8 +26,11 @@
 #include "../commonui/ipcmutex.h"
 #include "../commonui/auto_ascii_files.h"
 #include "../commonui/misc.h"
+#include "../commonui/segmented_transfer.h"
 
+#include <libfilezilla/file.hpp>
 #include <libfilezilla/glue/wxinvoker.hpp>
+#include <libfilezilla/local_filesys.hpp>
 
 #if WITH_LIBDBUS
 #include "../dbus/desktop_notification.h"
@@ -41,10 +44,73 @@
 #include <wx/sound.h>
 #include <wx/utils.h>
 
+#include <algorithm>
+
 #ifdef __WXMSW__
 #include <powrprof.h>
 #endif
 
+namespace {
+// Number of items per server loaded at once in journal mode
+size_t const queue_page_size = 1000;
+}
+
+class CSegmentedDownload final : public segmented_transfer_handler
+{
+public:
+	CSegmentedDownload(CFileZillaEngineContext& context, uint64_t serial, std::function<void(int)> && onDone, std::function<void()> && onProgress)
+		: serial_(serial)
+		, onDone_(std::move(onDone))
+		, onProgress_(std::move(onProgress))
+		, transfer_(std::make_unique<segmented_transfer>(context, *this))
+	{
+	}
+
+	virtual ~CSegmentedDownload()
+	{
+		// Stop the segments before the handler goes away
+		transfer_.reset();
+	}
+
+	segmented_transfer & transfer() { return *transfer_; }
+
+	uint64_t const serial_;
+
+private:
+	// Both get called on the event loop of the engine context, the invokers
+	// pass them on to the GUI thread.
+	virtual void on_segmented_transfer_done(int result) override
+	{
+		onDone_(result);
+	}
+
+	virtual void on_segmented_transfer_progress() override
+	{
+		onProgress_();
+	}
+
+	std::function<void(int)> const onDone_;
+	std::function<void()> const onProgress_;
+	std::unique_ptr<segmented_transfer> transfer_;
+};
+
+t_EngineData::~t_EngineData()
+{
+	wxASSERT(!active);
+	segmented.reset();
+	if (!transient)
+		delete pEngine;
+	delete m_idleDisconnectTimer;
+}
+
+CTransferStatus t_EngineData::GetTransferStatus(bool & changed) const
+{
+	if (segmented) {
+		return segmented->transfer().status(changed);
+	}
+	return pEngine->GetTransferStatus(changed);
+}
+
 class CQueueViewDropTarget final : public CFileDropTarget<wxListCtrlEx>
 {
 public:
@@ -477,6 +543,12 @@ void CQueueView::ProcessNotification(t_EngineData *pEngineData, std::unique_ptr<
 				}
 				m_pAsyncRequestQueue->AddRequest(pEngineData->pEngine, std::move(asyncRequestNotification));
 			}
+			else if (pEngineData->state == t_EngineData::prewarm) {
+				// Don't prompt the user for a connection no transfer has asked for
+				// yet. Cancelling the connection also excludes the site from
+				// prewarming, a transfer connects and prompts once it needs to.
+				pEngineData->pEngine->Cancel();
+			}
 			else {
 				if (pEngineData->active && asyncRequestNotification->GetRequestID() != reqId_fileexists) {
 					m_pAsyncRequestQueue->AddRequest(pEngineData->pEngine, std::move(asyncRequestNotification));
@@ -635,14 +707,19 @@ bool CQueueView::TryStartNextTransfer()
 	// Find inactive file. Check all servers for
 	// the file with the highest priority
 	for (auto const& currentServerItem : m_serverList) {
+		// Looking up the idle child is cheap, unlike checking the connection
+		// limits. Skip servers which have nothing better to offer.
+		CFileItem* newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection);
+		if (!newFileItem || (bestMatch.fileItem && newFileItem->GetPriority() <= bestMatch.fileItem->GetPriority())) {
+			continue;
+		}
+
 		t_EngineData* pEngineData = 0;
 
 		if (!CanStartTransfer(*currentServerItem, pEngineData)) {
 			continue;
 		}
 
-		CFileItem* newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection);
-
 		while (newFileItem && newFileItem->Download() && newFileItem->GetType() == QueueItemType::Folder) {
 			CLocalPath localPath(newFileItem->GetLocalPath());
 			localPath.AddSegment(newFileItem->GetLocalFile());
@@ -714,6 +791,13 @@ bool CQueueView::TryStartNextTransfer()
 	pEngineData->lastSite = bestMatch.serverItem->GetSite();
 
 	if (pEngineData->state != t_EngineData::waitprimary) {
+		if (pEngineData->pEngine->IsConnected() && oldSite == pEngineData->lastSite) {
+			++m_connectionStats.reused;
+		}
+		else {
+			++m_connectionStats.connected;
+		}
+
 		if (!pEngineData->pEngine->IsConnected()) {
 			if (CLoginManager::Get().GetPassword(pEngineData->lastSite, true)) {
 				pEngineData->state = t_EngineData::connect;
@@ -775,6 +859,18 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 	// Process reply from the engine
 	int replyCode = notification.replyCode_;
 
+	if (pEngineData->state == t_EngineData::prewarm) {
+		pEngineData->state = t_EngineData::none;
+		if (replyCode == FZ_REPLY_OK) {
+			ConnectFinished(*pEngineData);
+		}
+		else {
+			m_noPrewarm.push_back(pEngineData->lastSite);
+		}
+		AdvanceQueue(false);
+		return;
+	}
+
 	if ((replyCode & FZ_REPLY_CANCELED) == FZ_REPLY_CANCELED) {
 		ResetReason reason;
 		if (pEngineData->pItem) {
@@ -821,6 +917,7 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 			return;
 		}
 		else if (replyCode == FZ_REPLY_OK) {
+			ConnectFinished(*pEngineData);
 			if (pEngineData->pItem->GetType() == QueueItemType::File) {
 				pEngineData->state = t_EngineData::transfer;
 			}
@@ -967,6 +1064,8 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 
 	m_waitStatusLineUpdate = true;
 
+	data.segmented.reset();
+
 	if (data.pItem) {
 		CServerItem* pServerItem = static_cast<CServerItem*>(data.pItem->GetTopLevelItem());
 		if (pServerItem) {
@@ -1122,6 +1221,8 @@ bool CQueueView::RemoveItem(CQueueItem* item, bool destroy, bool updateItemCount
 	// RemoveItem assumes that the item has already been removed from all engines
 
 	if (item->GetType() == QueueItemType::File) {
+		DropSegments(static_cast<CFileItem const*>(item));
+
 		// Update size information
 		const CFileItem* const pFileItem = static_cast<CFileItem const*>(item);
 		int64_t size = pFileItem->GetSize();
@@ -1140,8 +1241,36 @@ bool CQueueView::RemoveItem(CQueueItem* item, bool destroy, bool updateItemCount
 		}
 	}
 
+	auto* serverItem = static_cast<CServerItem*>(item->GetTopLevelItem());
+	auto unloaded = m_unloaded.find(serverItem);
+	if (unloaded != m_unloaded.end() && m_insertionStart == -1 && serverItem->GetChildrenCount(false) <= queue_page_size / 4) {
+		LoadQueuePage(*serverItem);
+		CommitChanges();
+		unloaded = m_unloaded.find(serverItem);
+	}
+
+	int64_t const serverId = serverItem->GetStorageId();
+	if (m_queue_storage.JournalEnabled() && item->GetStorageId()) {
+		m_queue_storage.JournalRemoveFile(item->GetStorageId());
+		item->SetStorageId(0);
+	}
+
 	bool didRemoveParent = CQueueViewBase::RemoveItem(item, destroy, updateItemCount, updateSelections, forward);
 
+	if (didRemoveParent && m_queue_storage.JournalEnabled()) {
+		if (unloaded != m_unloaded.end()) {
+			// Remaining items did not get loaded in time, they stay stored
+			// for the next start.
+			m_unloaded.erase(unloaded);
+		}
+		else if (serverId) {
+			m_queue_storage.JournalRemoveServer(serverId);
+		}
+	}
+	if (updateItemCount) {
+		m_queue_storage.Flush();
+	}
+
 	UpdateStatusLinePositions();
 
 	return didRemoveParent;
@@ -1211,6 +1340,7 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 			engineData.pItem->SetStatusMessage(CFileItem::Status::connecting);
 			RefreshItem(engineData.pItem);
 
+			engineData.connectStart = fz::monotonic_clock::now();
 			int res = engineData.pEngine->Execute(CConnectCommand(engineData.lastSite.server, engineData.lastSite.Handle(), engineData.lastSite.credentials, false));
 
 			wxASSERT((res & FZ_REPLY_BUSY) != FZ_REPLY_BUSY);
@@ -1224,6 +1354,7 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 			}
 
 			if (res == FZ_REPLY_OK) {
+				ConnectFinished(engineData);
 				if (engineData.pItem->GetType() == QueueItemType::File) {
 					engineData.state = t_EngineData::transfer;
 					if (engineData.active && engineData.pStatusLineCtrl) {
@@ -1248,6 +1379,10 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 			fileItem->SetStatusMessage(CFileItem::Status::transferring);
 			RefreshItem(engineData.pItem);
 
+			if (TryStartSegmentedDownload(engineData)) {
+				return;
+			}
+
 			std::wstring extraFlags;
 			auto extraData = fileItem->GetExtraData();
 			if (extraData) {
@@ -1362,7 +1497,7 @@ bool CQueueView::SetActive(bool active)
 				if (!pEngineData->pEngine) {
 					continue;
 				}
-				pEngineData->pEngine->Cancel();
+				CancelTransfer(*pEngineData);
 			}
 		}
 
@@ -1412,6 +1547,11 @@ bool CQueueView::Quit()
 
 	DeleteEngines();
 
+	// The queue does not persist the state of segments
+	while (!m_segmentedProgress.empty()) {
+		DropSegments(m_segmentedProgress.begin()->first);
+	}
+
 	if (m_quit == 1) {
 		SaveQueue();
 		m_quit = 2;
@@ -1459,6 +1599,10 @@ void CQueueView::CheckQueueState()
 
 		TryRefreshListings();
 
+		LogConnectionStats();
+		m_noPrewarm.clear();
+		m_noSegmented.clear();
+
 		CContextManager::Get()->NotifyGlobalHandlers(STATECHANGE_QUEUEPROCESSING);
 
 		ActionAfter();
@@ -1555,6 +1699,21 @@ void CQueueView::SaveQueue(bool silent)
 	// just as extra precaution. Better 'save' than sorry.
 	CInterProcessMutex mutex(MUTEX_QUEUE);
 
+	if (m_queue_storage.JournalEnabled()) {
+		// Changes have been stored all along
+		bool ret = m_queue_storage.Flush();
+		if (ret && m_serverList.empty() && m_unloaded.empty()) {
+			// Other instances might have stored their queue in the meantime,
+			// only unreferenced paths can go.
+			ret = m_queue_storage.JournalPrunePaths();
+		}
+		if (!ret && !silent) {
+			wxString msg = wxString::Format(_("An error occurred saving the transfer queue to \"%s\".\nSome queue items might not have been saved."), m_queue_storage.GetDatabaseFilename());
+			wxMessageBoxEx(msg, _("Error saving queue"), wxICON_ERROR);
+		}
+		return;
+	}
+
 	if (!m_queue_storage.SaveQueue(m_serverList) && !silent) {
 		wxString msg = wxString::Format(_("An error occurred saving the transfer queue to \"%s\".\nSome queue items might not have been saved."), m_queue_storage.GetDatabaseFilename());
 		wxMessageBoxEx(msg, _("Error saving queue"), wxICON_ERROR);
@@ -1568,6 +1727,19 @@ void CQueueView::LoadQueue()
 	// to the same file or one is reading while the other one writes.
 	CInterProcessMutex mutex(MUTEX_QUEUE);
 
+	auto journalMutex = std::make_unique<CInterProcessMutex>(MUTEX_QUEUE_JOURNAL, false);
+	int const journalLock = journalMutex->TryLock();
+	if (!journalLock) {
+		// Another instance keeps the stored queue in sync with its own, leave it alone.
+		return;
+	}
+
+	if (journalLock == 1 && options_.get_int(OPTION_QUEUE_JOURNAL) && options_.get_int(OPTION_DEFAULT_KIOSKMODE) != 2 && m_queue_storage.EnableJournal()) {
+		m_journalMutex = std::move(journalMutex);
+		LoadQueueJournaled();
+		return;
+	}
+
 	bool error = false;
 
 	if (!m_queue_storage.BeginTransaction()) {
@@ -1636,6 +1808,151 @@ void CQueueView::LoadQueue()
 	}
 }
 
+void CQueueView::LoadQueueJournaled()
+{
+	// Only the first page of each server gets loaded, further pages follow
+	// as the queue drains. Stored rows are kept, changes to the queue get
+	// recorded as they happen.
+	bool error = false;
+
+	if (!m_queue_storage.BeginTransaction()) {
+		error = true;
+	}
+	else {
+		Site site;
+		int64_t id;
+		for (id = m_queue_storage.GetServer(site, true); id > 0; id = m_queue_storage.GetServer(site, false)) {
+			m_insertionStart = -1;
+			m_insertionCount = 0;
+			CServerItem *pServerItem = CreateServerItem(site);
+
+			if (!pServerItem->GetStorageId()) {
+				pServerItem->SetStorageId(id);
+				m_unloaded[pServerItem] = 0;
+				LoadQueuePage(*pServerItem);
+			}
+			else {
+				// Same site stored twice, e.g. by an instance not keeping a journal.
+				// Load all its items and store them anew under the first one.
+				std::vector<std::pair<int64_t, CFileItem*>> items;
+				int64_t last = 0;
+				for (int64_t next; (next = m_queue_storage.GetFiles(items, id, last, queue_page_size)) > last; ) {
+					last = next;
+				}
+				if (!m_queue_storage.JournalRemoveServer(id)) {
+					error = true;
+				}
+				for (auto & item : items) {
+					item.second->SetParent(pServerItem);
+					item.second->SetPriority(item.second->GetPriority());
+					InsertItem(pServerItem, item.second);
+				}
+			}
+
+			if (!pServerItem->GetChild(0)) {
+				auto it = m_unloaded.find(pServerItem);
+				if (it != m_unloaded.end()) {
+					m_unloaded.erase(it);
+				}
+				else if (!m_queue_storage.JournalRemoveServer(pServerItem->GetStorageId())) {
+					error = true;
+				}
+				m_itemCount--;
+				m_serverList.pop_back();
+				delete pServerItem;
+			}
+		}
+		if (id < 0) {
+			error = true;
+		}
+
+		if (!m_queue_storage.EndTransaction()) {
+			error = true;
+		}
+	}
+
+	m_insertionStart = -1;
+	m_insertionCount = 0;
+	CommitChanges();
+	if (error) {
+		wxString file = CQueueStorage::GetDatabaseFilename();
+		wxString msg = wxString::Format(_("An error occurred loading the transfer queue from \"%s\".\nSome queue items might not have been restored."), file);
+		wxMessageBoxEx(msg, _("Error loading queue"), wxICON_ERROR);
+	}
+}
+
+void CQueueView::LoadQueuePage(CServerItem & serverItem)
+{
+	auto it = m_unloaded.find(&serverItem);
+	if (it == m_unloaded.end()) {
+		return;
+	}
+
+	std::vector<std::pair<int64_t, CFileItem*>> items;
+	int64_t last = it->second;
+	while (items.empty()) {
+		int64_t const next = m_queue_storage.GetFiles(items, serverItem.GetStorageId(), last, queue_page_size);
+		if (next < 0) {
+			// Keep the entry, the remaining rows must not get deleted along with the server.
+			break;
+		}
+		if (next == last) {
+			m_unloaded.erase(it);
+			it = m_unloaded.end();
+			break;
+		}
+		last = next;
+	}
+	if (it != m_unloaded.end()) {
+		it->second = last;
+	}
+
+	for (auto & item : items) {
+		CFileItem* fileItem = item.second;
+		fileItem->SetParent(&serverItem);
+		fileItem->SetPriority(fileItem->GetPriority());
+		fileItem->SetStorageId(item.first);
+		InsertItem(&serverItem, fileItem);
+	}
+}
+
+void CQueueView::LoadRemainingItems()
+{
+	std::vector<CServerItem*> servers;
+	for (auto const& unloaded : m_unloaded) {
+		servers.push_back(unloaded.first);
+	}
+
+	for (auto * serverItem : servers) {
+		for (;;) {
+			auto it = m_unloaded.find(serverItem);
+			if (it == m_unloaded.end()) {
+				break;
+			}
+			int64_t const last = it->second;
+			LoadQueuePage(*serverItem);
+			it = m_unloaded.find(serverItem);
+			if (it != m_unloaded.end() && it->second == last) {
+				// Failed to load
+				break;
+			}
+		}
+	}
+
+	CommitChanges();
+}
+
+void CQueueView::DropUnloadedItems(CServerItem & serverItem)
+{
+	auto it = m_unloaded.find(&serverItem);
+	if (it != m_unloaded.end()) {
+		// Also hits items added after loading, only to be used if all items
+		// of the server get removed.
+		m_queue_storage.JournalRemoveFiles(serverItem.GetStorageId(), it->second);
+		m_unloaded.erase(it);
+	}
+}
+
 void CQueueView::ImportQueue(pugi::xml_node element, bool updateSelections)
 {
 	auto xServer = element.child("Server");
@@ -1930,7 +2247,17 @@ void CQueueView::RemoveAll()
 	std::vector<CServerItem*> newServerList;
 	m_itemCount = 0;
 	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
+		if (m_queue_storage.JournalEnabled()) {
+			// Active items get removed once stopped, no need to keep them stored
+			m_unloaded.erase(*iter);
+			m_queue_storage.JournalRemoveFiles((*iter)->GetStorageId());
+			auto const& children = (*iter)->GetChildren();
+			for (auto it = children.begin() + (*iter)->GetRemovedAtFront(); it != children.end(); ++it) {
+				(*it)->SetStorageId(0);
+			}
+		}
 		if ((*iter)->TryRemoveAll()) {
+			m_queue_storage.JournalRemoveServer((*iter)->GetStorageId());
 			delete *iter;
 		}
 		else {
@@ -1946,6 +2273,7 @@ void CQueueView::RemoveAll()
 	}
 
 	m_serverList = newServerList;
+	m_queue_storage.Flush();
 	UpdateStatusLinePositions();
 
 	CalculateQueueSize();
@@ -2002,6 +2330,7 @@ void CQueueView::OnRemoveSelected(wxCommandEvent&)
 		}
 		else if (pItem->GetType() == QueueItemType::Server) {
 			CServerItem* pServer = (CServerItem*)pItem;
+			DropUnloadedItems(*pServer);
 			StopItem(pServer, false);
 
 			// Server items get deleted automatically if all children are gone
@@ -2034,6 +2363,7 @@ void CQueueView::OnRemoveSelected(wxCommandEvent&)
 		bool forward = selectedItem.first < (topItemIndex + static_cast<int>(pTopLevelItem->GetChildrenCount(false)) / 2);
 		RemoveItem(pItem, true, false, false, forward);
 	}
+	m_queue_storage.Flush();
 	DisplayNumberQueuedFiles();
 	DisplayQueueSize();
 	SaveSetItemCount(m_itemCount);
@@ -2067,7 +2397,7 @@ bool CQueueView::StopItem(CFileItem* item)
 		return true;
 	}
 	else {
-		item->m_pEngineData->pEngine->Cancel();
+		CancelTransfer(*item->m_pEngineData);
 		return false;
 	}
 }
@@ -2244,7 +2574,8 @@ t_EngineData* CQueueView::GetIdleEngine(Site const& site, bool allowTransient)
 {
 	wxASSERT(!allowTransient || site);
 
-	t_EngineData* pFirstIdle = 0;
+	t_EngineData* pUnconnected = 0;
+	t_EngineData* pOtherSite = 0;
 
 	int transient = 0;
 	for (unsigned int i = 0; i < m_engineData.size(); ++i) {
@@ -2259,33 +2590,311 @@ t_EngineData* CQueueView::GetIdleEngine(Site const& site, bool allowTransient)
 			}
 		}
 
+		if (m_engineData[i]->state == t_EngineData::prewarm) {
+			continue;
+		}
+
 		if (!site) {
 			return m_engineData[i];
 		}
 
-		if (m_engineData[i]->pEngine->IsConnected() && m_engineData[i]->lastSite == site) {
-			return m_engineData[i];
+		if (m_engineData[i]->pEngine->IsConnected()) {
+			if (m_engineData[i]->lastSite == site) {
+				return m_engineData[i];
+			}
+			if (!pOtherSite) {
+				pOtherSite = m_engineData[i];
+			}
+		}
+		else if (!pUnconnected) {
+			pUnconnected = m_engineData[i];
+		}
+	}
+
+	if (pUnconnected) {
+		return pUnconnected;
+	}
+
+	// Rather open another connection than dropping one which might still
+	// be of use for a different server.
+	const int newEngineCount = options_.get_int(OPTION_NUMTRANSFERS);
+	if (newEngineCount > static_cast<int>(m_engineData.size()) - transient) {
+		return CreateEngine();
+	}
+
+	return pOtherSite;
+}
+
+t_EngineData* CQueueView::CreateEngine()
+{
+	t_EngineData* pEngineData = new t_EngineData;
+	pEngineData->pEngine = new CFileZillaEngine(m_pMainFrame->GetEngineContext(), fz::make_invoker(*this, [this](CFileZillaEngine* engine) { OnEngineEvent(engine); }));
+
+	m_engineData.push_back(pEngineData);
+
+	return pEngineData;
+}
+
+void CQueueView::PrewarmEngines()
+{
+	if (m_quit || !m_activeMode) {
+		return;
+	}
+
+	for (auto const& serverItem : m_serverList) {
+		if (!serverItem->GetIdleChild(m_activeMode == 1, TransferDirection::both)) {
+			continue;
+		}
+
+		Site const& site = serverItem->GetSite();
+		if (std::find(m_noPrewarm.cbegin(), m_noPrewarm.cend(), site) != m_noPrewarm.cend()) {
+			continue;
+		}
+
+		// One idle connection per server is enough, once used the next
+		// one gets warmed up.
+		int count = 0;
+		bool idle = false;
+		for (auto const* pEngineData : m_engineData) {
+			if (pEngineData->lastSite != site) {
+				continue;
+			}
+			if (pEngineData->active || pEngineData->state == t_EngineData::prewarm || pEngineData->pEngine->IsConnected()) {
+				++count;
+				if (!pEngineData->active) {
+					idle = true;
+				}
+			}
+		}
+		if (idle) {
+			continue;
+		}
+
+		// Leave room for the browsing connection
+		const int max_count = site.server.MaximumMultipleConnections();
+		if (max_count && count + 1 >= max_count) {
+			continue;
+		}
+
+		// Never drop another connection for this
+		t_EngineData* pEngineData = 0;
+		int transient = 0;
+		for (auto * pData : m_engineData) {
+			if (pData->transient) {
+				++transient;
+			}
+			else if (!pData->active && pData->state == t_EngineData::none && !pData->pEngine->IsConnected() && !pData->pEngine->IsBusy()) {
+				pEngineData = pData;
+				break;
+			}
+		}
+		if (!pEngineData) {
+			if (options_.get_int(OPTION_NUMTRANSFERS) <= static_cast<int>(m_engineData.size()) - transient) {
+				return;
+			}
+		}
+
+		// Do not prompt for passwords ahead of time
+		if (!CLoginManager::Get().GetPassword(site, true)) {
+			continue;
+		}
+
+		if (!pEngineData) {
+			pEngineData = CreateEngine();
+		}
+
+		pEngineData->lastSite = site;
+		pEngineData->state = t_EngineData::prewarm;
+		pEngineData->connectStart = fz::monotonic_clock::now();
+
+		int res = pEngineData->pEngine->Execute(CConnectCommand(site.server, site.Handle(), site.credentials, false));
+		if (res != FZ_REPLY_WOULDBLOCK) {
+			pEngineData->state = t_EngineData::none;
+			if (res == FZ_REPLY_OK) {
+				ConnectFinished(*pEngineData);
+			}
+			else {
+				m_noPrewarm.push_back(site);
+			}
+		}
+	}
+}
+
+void CQueueView::ConnectFinished(t_EngineData & engineData)
+{
+	if (engineData.connectStart) {
+		++m_connectionStats.handshakes;
+		m_connectionStats.handshakeTime += fz::monotonic_clock::now() - engineData.connectStart;
+		engineData.connectStart = fz::monotonic_clock();
+	}
+}
+
+void CQueueView::LogConnectionStats()
+{
+	connection_stats const stats = m_connectionStats;
+	m_connectionStats = connection_stats();
+
+	int const total = stats.reused + stats.connected;
+	if (!total) {
+		return;
+	}
+
+	wxString msg = wxString::Format(wxPLURAL("%d of %d transfer used an existing connection.", "%d of %d transfers used an existing connection.", total), stats.reused, total);
+	if (stats.reused && stats.handshakes) {
+		double const saved = (stats.handshakeTime.get_milliseconds() / stats.handshakes) * stats.reused / 1000.0;
+		msg += L" " + wxString::Format(_("Estimated time saved on connection setup: %.1f seconds."), saved);
+	}
+	m_pMainFrame->GetStatusView()->AddToLog(logmsg::status, msg.ToStdWstring(), fz::datetime::now());
+}
+
+
+bool CQueueView::TryStartSegmentedDownload(t_EngineData & engineData)
+{
+	CFileItem* const fileItem = engineData.pItem;
+	if (!fileItem->Download()) {
+		return false;
+	}
+
+	std::wstring const localFile = fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile();
+
+	std::vector<transfer_segment> segments;
+	auto const progress = m_segmentedProgress.find(fileItem);
+	if (progress != m_segmentedProgress.end()) {
+		segments = progress->second;
+	}
+	else {
+		size_t const connections = static_cast<size_t>(options_.get_int(OPTION_SEGMENTED_DOWNLOAD_CONNECTIONS));
+		int64_t const size = fileItem->GetSize();
+		if (connections < 2 || size < static_cast<int64_t>(2 * segmented_transfer::default_min_segment_size)) {
+			return false;
 		}
 
-		if (!pFirstIdle) {
-			pFirstIdle = m_engineData[i];
+		// Segments are byte ranges, ASCII mode would alter them
+		if (fileItem->flags() & ftp_transfer_flags::ascii) {
+			return false;
+		}
+
+		// Servers limiting the number of connections don't get any extra ones
+		Site const& site = engineData.lastSite;
+		if (!site.server.HasFeature(ProtocolFeature::SegmentedDownload) || site.server.MaximumMultipleConnections()) {
+			return false;
+		}
+		if (std::find(m_noSegmented.cbegin(), m_noSegmented.cend(), site) != m_noSegmented.cend()) {
+			return false;
+		}
+
+		// Existing files are left to the usual file exists handling
+		if (fz::local_filesys::get_file_type(fz::to_native(localFile)) != fz::local_filesys::unknown) {
+			return false;
+		}
+
+		segments = segmented_transfer::split(static_cast<uint64_t>(size), connections);
+		if (segments.size() < 2) {
+			return false;
 		}
 	}
 
-	if (!pFirstIdle) {
-		// Check whether we can create another engine
-		const int newEngineCount = options_.get_int(OPTION_NUMTRANSFERS);
-		if (newEngineCount > static_cast<int>(m_engineData.size()) - transient) {
-			pFirstIdle = new t_EngineData;
-			pFirstIdle->pEngine = new CFileZillaEngine(m_pMainFrame->GetEngineContext(), fz::make_invoker(*this, [this](CFileZillaEngine* engine) { OnEngineEvent(engine); }));
+	uint64_t const serial = ++m_segmentedSerial;
+	auto segmented = std::make_unique<CSegmentedDownload>(m_pMainFrame->GetEngineContext(), serial,
+		fz::make_invoker(*this, [this, serial](int result) { OnSegmentedDownloadDone(serial, result); }),
+		fz::make_invoker(*this, [this, serial]() { OnSegmentedDownloadProgress(serial); }));
+	if (!segmented->transfer().start(engineData.lastSite, fileItem->GetRemotePath(), fileItem->GetRemoteFile(), localFile, true, segments)) {
+		DropSegments(fileItem);
+		return false;
+	}
+
+	engineData.segmented = std::move(segmented);
+	return true;
+}
 
-			m_engineData.push_back(pFirstIdle);
+t_EngineData* CQueueView::GetSegmentedEngineData(uint64_t serial)
+{
+	for (auto * pEngineData : m_engineData) {
+		if (pEngineData->segmented && pEngineData->segmented->serial_ == serial) {
+			return pEngineData;
+		}
+	}
+	return nullptr;
+}
+
+void CQueueView::OnSegmentedDownloadDone(uint64_t serial, int result)
+{
+	t_EngineData* const pEngineData = GetSegmentedEngineData(serial);
+	if (!pEngineData || !pEngineData->pItem || pEngineData->state != t_EngineData::transfer) {
+		return;
+	}
+
+	CFileItem* const pItem = pEngineData->pItem;
+	std::vector<transfer_segment> const segments = pEngineData->segmented->transfer().segments();
+	pEngineData->segmented.reset();
+
+	bool const resumed = m_segmentedProgress.find(pItem) != m_segmentedProgress.end();
+	uint64_t done{};
+	for (auto const& segment : segments) {
+		done += segment.done;
+	}
+
+	if (result == FZ_REPLY_OK) {
+		m_segmentedProgress.erase(pItem);
+	}
+	else if (done) {
+		m_segmentedProgress[pItem] = segments;
+	}
+	else if (!resumed) {
+		fz::remove_file(fz::to_native(pItem->GetLocalPath().GetPath() + pItem->GetLocalFile()));
+
+		// Nothing got transferred, most likely the server refuses the additional
+		// connections. Transfer the file the usual way instead.
+		if ((result & FZ_REPLY_CANCELED) != FZ_REPLY_CANCELED && m_activeMode) {
+			m_noSegmented.push_back(pEngineData->lastSite);
+			SendNextCommand(*pEngineData);
+			return;
 		}
 	}
 
-	return pFirstIdle;
+	ProcessReply(pEngineData, COperationNotification(result, Command::transfer));
+}
+
+void CQueueView::OnSegmentedDownloadProgress(uint64_t serial)
+{
+	t_EngineData* const pEngineData = GetSegmentedEngineData(serial);
+	if (!pEngineData || !pEngineData->active || !pEngineData->pItem || !pEngineData->pStatusLineCtrl) {
+		return;
+	}
+
+	bool changed;
+	CTransferStatus const status = pEngineData->GetTransferStatus(changed);
+	if (status.madeProgress) {
+		pEngineData->pItem->set_made_progress(true);
+	}
+	pEngineData->pStatusLineCtrl->SetTransferStatus(status);
 }
 
+void CQueueView::CancelTransfer(t_EngineData & engineData)
+{
+	if (engineData.segmented) {
+		engineData.segmented->transfer().cancel();
+	}
+	else {
+		engineData.pEngine->Cancel();
+	}
+}
+
+void CQueueView::DropSegments(CFileItem const* item)
+{
+	auto const it = m_segmentedProgress.find(item);
+	if (it == m_segmentedProgress.end()) {
+		return;
+	}
+
+	int64_t const size = static_cast<int64_t>(segmented_transfer::contiguous(it->second));
+	m_segmentedProgress.erase(it);
+
+	fz::file f(fz::to_native(item->GetLocalPath().GetPath() + item->GetLocalFile()), fz::file::writing, fz::file::existing);
+	if (f.opened() && f.seek(size, fz::file::begin) == size) {
+		f.truncate();
+	}
+}
 
 t_EngineData* CQueueView::GetEngineData(CFileZillaEngine const* pEngine)
 {
@@ -2442,6 +3051,8 @@ void CQueueView::AdvanceQueue(bool refresh)
 	while (TryStartNextTransfer()) {
 	}
 
+	PrewarmEngines();
+
 	// Set timer for connected, idle engines
 	for (unsigned int i = 0; i < m_engineData.size(); ++i) {
 		if (m_engineData[i]->active || m_engineData[i]->transient) {
@@ -2462,7 +3073,7 @@ void CQueueView::AdvanceQueue(bool refresh)
 			}
 
 			m_engineData[i]->m_idleDisconnectTimer = new wxTimer(this);
-			m_engineData[i]->m_idleDisconnectTimer->Start(60000, true);
+			m_engineData[i]->m_idleDisconnectTimer->Start(options_.get_int(OPTION_QUEUE_IDLE_TIMEOUT) * 1000, true);
 		}
 	}
 
@@ -2479,6 +3090,10 @@ void CQueueView::InsertItem(CServerItem* pServerItem, CQueueItem* pItem)
 {
 	CQueueViewBase::InsertItem(pServerItem, pItem);
 
+	if (m_queue_storage.JournalEnabled() && !pItem->GetStorageId() && (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder)) {
+		m_queue_storage.JournalAdd(*pServerItem, static_cast<CFileItem&>(*pItem));
+	}
+
 	if (pItem->GetType() == QueueItemType::File) {
 		CFileItem* pFileItem = (CFileItem*)pItem;
 
@@ -2496,6 +3111,8 @@ void CQueueView::CommitChanges()
 {
 	CQueueViewBase::CommitChanges();
 
+	m_queue_storage.Flush();
+
 	DisplayQueueSize();
 }
 
@@ -2523,6 +3140,11 @@ void CQueueView::OnTimer(wxTimerEvent& event)
 			pData->m_idleDisconnectTimer = 0;
 
 			if (pData->pEngine->IsConnected()) {
+				// Nothing made use of the connection, don't open it again
+				// just to have it idle.
+				if (m_activeMode) {
+					m_noPrewarm.push_back(pData->lastSite);
+				}
 				pData->pEngine->Execute(CDisconnectCommand());
 			}
 		}
@@ -2590,7 +3212,17 @@ void CQueueView::OnSetPriority(wxCommandEvent& event)
 		}
 
 		pItem->SetPriority(priority);
+
+		if (m_queue_storage.JournalEnabled()) {
+			if (pItem->GetType() == QueueItemType::Server) {
+				m_queue_storage.JournalPriority(static_cast<CServerItem&>(*pItem), priority);
+			}
+			else if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder) {
+				m_queue_storage.JournalPriority(static_cast<CFileItem&>(*pItem), priority);
+			}
+		}
 	}
+	m_queue_storage.Flush();
 
 	RefreshListOnly();
 }
@@ -2885,6 +3517,25 @@ bool CQueueView::IsOtherEngineConnected(t_EngineData* pEngineData)
 	return false;
 }
 
+size_t CQueueView::GetConnectionCount(Site const& site) const
+{
+	size_t count{};
+	for (auto const* current : m_engineData) {
+		if (!current->pEngine || current->lastSite != site) {
+			continue;
+		}
+
+		if (current->pEngine->IsConnected()) {
+			++count;
+		}
+		if (current->segmented && current->segmented->transfer().busy()) {
+			count += current->segmented->transfer().segments().size();
+		}
+	}
+
+	return count;
+}
+
 void CQueueView::OnChar(wxKeyEvent& event)
 {
 	if (event.GetKeyCode() == WXK_DELETE || event.GetKeyCode() == WXK_NUMPAD_DELETE)
@@ -3080,6 +3731,13 @@ void CQueueView::OnStateChange(CState*, t_statechange_notifications notification
 			protect((*it)->GetCredentials());
 			++it;
 		}
+
+		if (m_queue_storage.JournalEnabled()) {
+			for (auto * serverItem : m_serverList) {
+				m_queue_storage.JournalUpdateServer(*serverItem);
+			}
+			m_queue_storage.Flush();
+		}
 	}
 	else if (notification == STATECHANGE_QUITNOW) {
 		if (m_quit != 2) {
@@ -15,6 +15,7 @@
 #include <wx/progdlg.h>
 
 #include <list>
+#include <map>
 #include <set>
 
 namespace ActionAfterState {
@@ -36,6 +37,8 @@ enum type {
 };
 }
 
+class CInterProcessMutex;
+class CSegmentedDownload;
 class CStatusLineCtrl;
 class CFileItem;
 struct t_EngineData final
@@ -51,13 +54,11 @@ struct t_EngineData final
 	{
 	}
 
-	~t_EngineData()
-	{
-		wxASSERT(!active);
-		if (!transient)
-			delete pEngine;
-		delete m_idleDisconnectTimer;
-	}
+	~t_EngineData();
+
+	// Transfer status of the engine, or of the segments if the file is
+	// being downloaded in segments.
+	CTransferStatus GetTransferStatus(bool & changed) const;
 
 	CFileZillaEngine* pEngine;
 	bool active;
@@ -73,13 +74,20 @@ struct t_EngineData final
 		list,
 		mkdir,
 		askpassword,
-		waitprimary
+		waitprimary,
+		prewarm // Connecting ahead of time, no item assigned
 	} state;
 
 	CFileItem* pItem;
 	Site lastSite;
 	CStatusLineCtrl* pStatusLineCtrl;
 	wxTimer* m_idleDisconnectTimer;
+
+	fz::monotonic_clock connectStart;
+
+	// Set while the file of the item gets downloaded in segments over
+	// additional engines. The engine itself stays idle meanwhile.
+	std::unique_ptr<CSegmentedDownload> segmented;
 };
 
 class CMainFrame;
@@ -150,6 +158,8 @@ public:
 
 	virtual void CommitChanges() override;
 
+	virtual void LoadRemainingItems() override;
+
 	virtual void ProcessNotification(CFileZillaEngine* pEngine, std::unique_ptr<CNotification>&& pNotification) override;
 
 	void RenameFileInTransfer(CFileZillaEngine *pEngine, std::wstring const& newName, bool local, fz::writer_factory_holder & new_writer);
@@ -158,6 +168,10 @@ public:
 
 	std::shared_ptr<CActionAfterBlocker> GetActionAfterBlocker();
 
+	// Number of connections the queue holds to the site, including those
+	// of segmented downloads.
+	size_t GetConnectionCount(Site const& site) const;
+
 protected:
 
 #ifdef __WXMSW__
@@ -221,6 +235,7 @@ protected:
 	bool IsOtherEngineConnected(t_EngineData* pEngineData);
 
 	t_EngineData* GetIdleEngine(Site const& site = Site(), bool allowTransient = false);
+	t_EngineData* CreateEngine();
 	t_EngineData* GetEngineData(const CFileZillaEngine* pEngine);
 
 	std::vector<t_EngineData*> m_engineData;
@@ -279,6 +294,55 @@ protected:
 
 	CQueueStorage m_queue_storage;
 
+	// Journal mode, the queue database mirrors the queue while running
+	void LoadQueueJournaled();
+	void LoadQueuePage(CServerItem & serverItem);
+	void DropUnloadedItems(CServerItem & serverItem);
+
+	std::unique_ptr<CInterProcessMutex> m_journalMutex;
+
+	// Servers with items remaining in the database, mapped to the storage
+	// id of the last loaded item.
+	std::map<CServerItem*, int64_t> m_unloaded;
+
+	// Connects idle engine slots to servers with waiting files, so that the
+	// next transfer to those servers need not wait for the login.
+	void PrewarmEngines();
+	std::vector<Site> m_noPrewarm; // Cleared once the queue stops
+
+	void ConnectFinished(t_EngineData & engineData);
+	void LogConnectionStats();
+
+	// Downloads large files in segments over multiple connections, see
+	// OPTION_SEGMENTED_DOWNLOAD_CONNECTIONS. Returns false if the file of the
+	// item does not qualify, it then gets transferred as usual.
+	bool TryStartSegmentedDownload(t_EngineData & engineData);
+	void OnSegmentedDownloadDone(uint64_t serial, int result);
+	void OnSegmentedDownloadProgress(uint64_t serial);
+	t_EngineData* GetSegmentedEngineData(uint64_t serial);
+
+	// Cancels the transfer of the engine or its segmented download
+	void CancelTransfer(t_EngineData & engineData);
+
+	// Forgets the progress of an interrupted segmented download. The local
+	// file is truncated to the part without gaps so that it can be resumed
+	// the usual way.
+	void DropSegments(CFileItem const* item);
+
+	uint64_t m_segmentedSerial{};
+	std::vector<Site> m_noSegmented; // Cleared once the queue stops
+
+	// Interrupted segmented downloads resume with the state of their segments
+	std::map<CFileItem const*, std::vector<transfer_segment>> m_segmentedProgress;
+
+	struct connection_stats final
+	{
+		int reused{};
+		int connected{};
+		int handshakes{};
+		fz::duration handshakeTime;
+	} m_connectionStats;
+
 	void OnEngineEvent(CFileZillaEngine* engine);
 
 	void OnAskPassword();
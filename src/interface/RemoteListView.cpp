@@ -323,6 +323,7 @@ CRemoteListView::CRemoteListView(CView* pParent, CState& state, CQueueView* pQue
 	, m_parentView(pParent)
 {
 	state.RegisterHandler(this, STATECHANGE_REMOTE_DIR);
+	state.RegisterHandler(this, STATECHANGE_REMOTE_DIR_PARTIAL);
 	state.RegisterHandler(this, STATECHANGE_APPLYFILTER);
 	state.RegisterHandler(this, STATECHANGE_REMOTE_LINKNOTDIR);
 	state.RegisterHandler(this, STATECHANGE_SERVER);
@@ -416,9 +417,9 @@ bool CRemoteListView::IsItemValid(unsigned int item) const
 	return true;
 }
 
-void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
+void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, size_t previousSize)
 {
-	size_t const to_add = pDirectoryListing->size() - m_pDirectoryListing->size();
+	size_t const to_add = pDirectoryListing->size() - previousSize;
 	m_pDirectoryListing = pDirectoryListing;
 	UpdateSortComparisonObject();
 
@@ -676,7 +677,7 @@ bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing>
 		if (unsure & (CDirectoryListing::unsure_dir_removed | CDirectoryListing::unsure_file_removed)) {
 			return false; // Cannot handle both at the same time unfortunately
 		}
-		UpdateDirectoryListing_Added(pDirectoryListing);
+		UpdateDirectoryListing_Added(pDirectoryListing, m_pDirectoryListing->size());
 		return true;
 	}
 
@@ -861,6 +862,25 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	}
 }
 
+void CRemoteListView::AddPartialListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
+{
+	if (!pDirectoryListing || IsComparing()) {
+		return;
+	}
+
+	if (m_pDirectoryListing != pDirectoryListing) {
+		SetDirectoryListing(pDirectoryListing);
+		return;
+	}
+
+	// Same listing as before, it has grown by the entries of the new part
+	size_t const shown = m_fileData.size() - 1;
+	if (pDirectoryListing->size() > shown) {
+		UpdateDirectoryListing_Added(pDirectoryListing, shown);
+		RefreshListOnly();
+	}
+}
+
 void CRemoteListView::OnItemActivated(wxListEvent &event)
 {
 	int const action = options_.get_int(OPTION_DOUBLECLICK_ACTION_DIRECTORY);
@@ -2102,6 +2122,10 @@ void CRemoteListView::OnStateChange(t_statechange_notifications notification, st
 	if (notification == STATECHANGE_REMOTE_DIR) {
 		SetDirectoryListing(m_state.GetRemoteDir());
 	}
+	else if (notification == STATECHANGE_REMOTE_DIR_PARTIAL) {
+		wxASSERT(data2);
+		AddPartialListing(*static_cast<std::shared_ptr<CDirectoryListing> const*>(data2));
+	}
 	else if (notification == STATECHANGE_REMOTE_LINKNOTDIR) {
 		wxASSERT(data2);
 		LinkIsNotDir(*(CServerPath*)data2, data);
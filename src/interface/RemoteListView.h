@@ -72,7 +72,8 @@ protected:
 	void SetDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 	bool UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 	void UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
-	void UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
+	void UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, size_t previousSize);
+	void AddPartialListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 
 #ifdef __WXDEBUG__
 	void ValidateIndexMapping();
@@ -285,6 +285,24 @@ bool CCommandQueue::Quit()
 	return Cancel();
 }
 
+void CCommandQueue::ProcessDirectoryListingPart(CDirectoryListingPartNotification const& notification)
+{
+	// Recursive operations only need the complete listing
+	auto const firstListing = std::find_if(m_CommandList.begin(), m_CommandList.end(), [](CommandInfo const& v) { return v.command->GetId() == Command::list; });
+	if (firstListing == m_CommandList.end() || firstListing->origin == recursiveOperation) {
+		return;
+	}
+
+	if (notification.First() || !m_partialListing || m_partialListing->path != notification.GetPath()) {
+		m_partialListing = std::make_shared<CDirectoryListing>();
+		m_partialListing->path = notification.GetPath();
+		m_partialListing->m_firstListTime = fz::monotonic_clock::now();
+	}
+	m_partialListing->Append(notification.GetEntries());
+
+	m_state.NotifyHandlers(STATECHANGE_REMOTE_DIR_PARTIAL, std::wstring(), &m_partialListing);
+}
+
 void CCommandQueue::ProcessDirectoryListing(CDirectoryListingNotification const& listingNotification)
 {
 	auto const firstListing = std::find_if(m_CommandList.begin(), m_CommandList.end(), [](CommandInfo const& v) { return v.command->GetId() == Command::list; });
@@ -309,7 +327,15 @@ void CCommandQueue::ProcessDirectoryListing(CDirectoryListingNotification const&
 		}
 	}
 	else {
-		m_state.SetRemoteDir(pListing, listingNotification.Primary());
+		bool const hadPartial = m_partialListing && listingNotification.Primary();
+		if (hadPartial) {
+			m_partialListing.reset();
+		}
+		if (m_state.SetRemoteDir(pListing, listingNotification.Primary()) && hadPartial && (!pListing || pListing->failed())) {
+			// The partial listing is still on display, restore the previous listing
+			bool primary = true;
+			m_state.NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
+		}
 	}
 
 	if (pListing && !listingNotification.Failed() && m_state.GetSite()) {
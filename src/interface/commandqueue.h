@@ -42,6 +42,7 @@ public:
 	bool EngineLocked() const { return exclusive_lock_; }
 
 	void ProcessDirectoryListing(CDirectoryListingNotification const& listingNotification);
+	void ProcessDirectoryListingPart(CDirectoryListingPartNotification const& notification);
 
 protected:
 	void ProcessReply(int nReplyCode, Command commandId);
@@ -72,6 +73,9 @@ protected:
 	};
 	std::deque<CommandInfo> m_CommandList;
 
+	// Entries received so far for the listing currently being retrieved
+	std::shared_ptr<CDirectoryListing> m_partialListing;
+
 	bool m_quit{};
 };
 
@@ -89,6 +89,7 @@ void CExportDialog::Run()
 	}
 
 	if (queue) {
+		m_pQueueView->LoadRemainingItems();
 		m_pQueueView->WriteToFile(exportRoot);
 	}
 
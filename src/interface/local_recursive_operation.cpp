@@ -3,6 +3,7 @@
 
 #include <libfilezilla/local_filesys.hpp>
 
+#include "Options.h"
 #include "QueueView.h"
 
 BEGIN_EVENT_TABLE(CLocalRecursiveOperation, wxEvtHandler)
@@ -44,6 +45,8 @@ bool CLocalRecursiveOperation::do_start_recursive_operation(OperationMode mode,
 		site_ = Site();
 	}
 
+	set_thread_count(static_cast<size_t>(COptions::Get()->get_int(OPTION_LOCAL_RECURSION_THREADS)));
+
 	if (!local_recursive_operation::do_start_recursive_operation(mode, filters, ignore_links)) {
 		return false;
 	}
@@ -10,6 +10,8 @@
 
 #include <wx/filedlg.h>
 
+#include <algorithm>
+
 CQueueItem::CQueueItem(CQueueItem* parent)
 	: m_parent(parent)
 {
@@ -40,12 +42,14 @@ void CQueueItem::AddChild(CQueueItem* item)
 	}
 	m_children.push_back(item);
 
+	CQueueItem* child = this;
 	CQueueItem* parent = GetParent();
 	while (parent) {
 		if (parent->GetType() == QueueItemType::Server) {
 			static_cast<CServerItem*>(parent)->m_visibleOffspring += 1 + item->GetChildrenCount(true);
-			static_cast<CServerItem*>(parent)->m_maxCachedIndex = -1;
+			static_cast<CServerItem*>(parent)->UpdateExpanded(child);
 		}
+		child = parent;
 		parent = parent->GetParent();
 	}
 }
@@ -171,12 +175,14 @@ bool CQueueItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 	}
 
 	// Propagate new children count to parent
+	CQueueItem* child = this;
 	CQueueItem* parent = GetParent();
 	while (parent) {
 		if (parent->GetType() == QueueItemType::Server) {
-			static_cast<CServerItem*>(parent)->m_maxCachedIndex = -1;
 			static_cast<CServerItem*>(parent)->m_visibleOffspring -= oldVisibleOffspring - visibleOffspring;
+			static_cast<CServerItem*>(parent)->UpdateExpanded(child);
 		}
+		child = parent;
 		parent = parent->GetParent();
 	}
 
@@ -222,6 +228,13 @@ int CQueueItem::GetItemIndex() const
 		return 0;
 	}
 
+	if (pParent->GetType() == QueueItemType::Server) {
+		int const row = static_cast<CServerItem const*>(pParent)->GetChildRow(*this);
+		if (row >= 0) {
+			return row + 1;
+		}
+	}
+
 	int index = 1;
 	for (std::vector<CQueueItem*>::const_iterator iter = pParent->m_children.begin() + pParent->m_removed_at_front; iter != pParent->m_children.end(); ++iter) {
 		if (*iter == this) {
@@ -281,11 +294,17 @@ void CFileItem::SetActive(const bool active)
 		wxASSERT(!GetChildrenCount(false));
 		AddChild(new CStatusItem);
 		flags_ |= queue_flags::active;
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, true);
+		}
 	}
 	else if (!active && IsActive()) {
 		CQueueItem* pItem = GetChild(0, false);
 		RemoveChild(pItem);
 		flags_ -= queue_flags::active;
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, false);
+		}
 	}
 }
 
@@ -401,12 +420,19 @@ void CFolderItem::SaveItem(pugi::xml_node& element) const
 
 void CFolderItem::SetActive(bool const active)
 {
+	if (active == IsActive()) {
+		return;
+	}
+
 	if (active) {
 		flags_ |= queue_flags::active;
 	}
 	else {
 		flags_ -= queue_flags::active;
 	}
+	if (m_parent) {
+		static_cast<CServerItem*>(m_parent)->SetChildActive(this, active);
+	}
 }
 
 CServerItem::CServerItem(Site const& site)
@@ -426,8 +452,9 @@ wxString CServerItem::GetName() const
 
 void CServerItem::AddChild(CQueueItem* pItem)
 {
+	pItem->m_childKey = ++m_nextChildKey;
 	CQueueItem::AddChild(pItem);
-	m_maxCachedIndex = -1;
+	UpdateExpanded(pItem);
 	m_visibleOffspring += 1 + pItem->GetChildrenCount(true);
 	if (pItem->GetType() == QueueItemType::File ||
 		pItem->GetType() == QueueItemType::Folder)
@@ -446,35 +473,122 @@ unsigned int CServerItem::GetChildrenCount(bool recursive) const
 	return m_visibleOffspring;
 }
 
+CServerItem::idle_list& CServerItem::GetIdleList(bool queued, QueuePriority priority, bool download)
+{
+	return m_idleList[queued ? 0 : 1][static_cast<int>(priority)][download ? 0 : 1];
+}
+
+void CServerItem::LinkIdle(idle_list& list, CFileItem* pItem, bool front)
+{
+	// Items can still be linked into the list of a server item they have
+	// been moved away from, don't look at their old links.
+	if (front) {
+		pItem->idle_seq_ = --m_idleFrontSeq;
+		pItem->idle_prev_ = nullptr;
+		pItem->idle_next_ = list.front;
+		if (list.front) {
+			list.front->idle_prev_ = pItem;
+		}
+		else {
+			list.back = pItem;
+		}
+		list.front = pItem;
+	}
+	else {
+		pItem->idle_seq_ = ++m_idleBackSeq;
+		pItem->idle_next_ = nullptr;
+		pItem->idle_prev_ = list.back;
+		if (list.back) {
+			list.back->idle_next_ = pItem;
+		}
+		else {
+			list.front = pItem;
+		}
+		list.back = pItem;
+	}
+	pItem->idle_listed_ = true;
+}
+
+void CServerItem::UnlinkIdle(idle_list& list, CFileItem* pItem)
+{
+	if (pItem->idle_prev_) {
+		pItem->idle_prev_->idle_next_ = pItem->idle_next_;
+	}
+	else {
+		list.front = pItem->idle_next_;
+	}
+	if (pItem->idle_next_) {
+		pItem->idle_next_->idle_prev_ = pItem->idle_prev_;
+	}
+	else {
+		list.back = pItem->idle_prev_;
+	}
+	pItem->idle_prev_ = nullptr;
+	pItem->idle_next_ = nullptr;
+	pItem->idle_listed_ = false;
+}
+
+std::vector<CFileItem*> CServerItem::TakeIdle(int queued, int priority)
+{
+	std::vector<CFileItem*> ret;
+
+	// Merge both directions back into the order the items were added in
+	idle_list& downloads = m_idleList[queued][priority][0];
+	idle_list& uploads = m_idleList[queued][priority][1];
+	CFileItem* download = downloads.front;
+	CFileItem* upload = uploads.front;
+	while (download || upload) {
+		if (download && (!upload || download->idle_seq_ < upload->idle_seq_)) {
+			ret.push_back(download);
+			download = download->idle_next_;
+		}
+		else {
+			ret.push_back(upload);
+			upload = upload->idle_next_;
+		}
+	}
+
+	for (auto * pItem : ret) {
+		pItem->idle_prev_ = nullptr;
+		pItem->idle_next_ = nullptr;
+		pItem->idle_listed_ = false;
+	}
+	downloads = idle_list();
+	uploads = idle_list();
+
+	return ret;
+}
+
 void CServerItem::AddFileItemToList(CFileItem* pItem)
 {
 	if (!pItem) {
 		return;
 	}
 
-	m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+	if (!pItem->IsActive()) {
+		LinkIdle(GetIdleList(pItem->queued(), pItem->GetPriority(), pItem->Download()), pItem, false);
+	}
+	else {
+		pItem->idle_listed_ = false;
+	}
 }
 
-void CServerItem::RemoveFileItemFromList(CFileItem* pItem, bool forward)
+void CServerItem::RemoveFileItemFromList(CFileItem* pItem, bool)
 {
-	std::deque<CFileItem*>& fileList = m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())];
-	if (forward) {
-		for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
-			if (*iter == pItem) {
-				fileList.erase(iter);
-				return;
-			}
-		}
+	if (pItem->idle_listed_) {
+		UnlinkIdle(GetIdleList(pItem->queued(), pItem->GetPriority(), pItem->Download()), pItem);
 	}
-	else {
-		for (auto iter = fileList.rbegin(); iter != fileList.rend(); ++iter) {
-			if (*iter == pItem) {
-				fileList.erase(iter.base() - 1);
-				return;
-			}
-		}
+}
+
+void CServerItem::SetChildActive(CFileItem* pItem, bool active)
+{
+	if (active) {
+		RemoveFileItemFromList(pItem, true);
+	}
+	else if (!pItem->idle_listed_) {
+		// Retry interrupted items first
+		LinkIdle(GetIdleList(pItem->queued(), pItem->GetPriority(), pItem->Download()), pItem, true);
 	}
-	wxFAIL_MSG(_T("File item not deleted from m_fileList"));
 }
 
 void CServerItem::SetDefaultFileExistsAction(CFileExistsNotification::OverwriteAction action, const TransferDirection direction)
@@ -544,118 +658,135 @@ void CServerItem::Sort(int col, bool reverse)
 
 	std::stable_sort(m_children.begin() + m_removed_at_front, m_children.end(), fn);
 
-	m_lookupCache.clear();
-	m_maxCachedIndex = -1;
+	for (auto it = m_children.cbegin() + m_removed_at_front; it != m_children.cend(); ++it) {
+		(*it)->m_childKey = ++m_nextChildKey;
+	}
+	RebuildExpanded();
 
-	// Rebuild m_fileList
-	for (size_t i = 0; i < static_cast<size_t>(QueuePriority::count); ++i) {
-		m_fileList[0][i].clear();
-		m_fileList[1][i].clear();
+	// Rebuild idle lists
+	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
+		TakeIdle(0, i);
+		TakeIdle(1, i);
 	}
 
 	for (auto it = m_children.cbegin() + m_removed_at_front; it != m_children.cend(); ++it) {
-		CFileItem *pItem = static_cast<CFileItem*>(*it);
-		m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+		AddFileItemToList(static_cast<CFileItem*>(*it));
 	}
 }
 
 CQueueItem* CServerItem::GetChild(unsigned int item, bool recursive)
 {
-	std::vector<CQueueItem*>::iterator iter;
 	if (!recursive) {
 		if (item + m_removed_at_front >= m_children.size()) {
 			return 0;
 		}
-		iter = m_children.begin();
-		iter += item + m_removed_at_front;
-		return *iter;
+		return m_children[item + m_removed_at_front];
 	}
 
-	if ((int)item <= m_maxCachedIndex) {
-		// Index is cached
-		iter = m_children.begin() + m_removed_at_front;
-		iter += m_lookupCache[item].child;
-		item -= m_lookupCache[item].index;
-		if (!item) {
-			return *iter;
+	// Only the few expanded children take up more than a single row,
+	// skip over them to get the index of the child.
+	unsigned int offset{};
+	for (auto * expanded : m_expanded) {
+		unsigned int const row = static_cast<unsigned int>(FindChild(expanded) - m_removed_at_front) + offset;
+		if (item < row) {
+			break;
 		}
-		else {
-			return (*iter)->GetChild(item - 1);
+
+		unsigned int const count = expanded->GetChildrenCount(true);
+		if (item <= row + count) {
+			return item == row ? expanded : expanded->GetChild(item - row - 1);
 		}
+		offset += count;
 	}
 
-	int index;
-	int child;
-	iter = m_children.begin() + m_removed_at_front;
-	if (m_maxCachedIndex == -1) {
-		child = 0;
-		index = 0;
+	item -= offset;
+	if (item + m_removed_at_front >= m_children.size()) {
+		return 0;
 	}
-	else {
-		// Start with loop with the last cached item index
-		iter += m_lookupCache[m_maxCachedIndex].child + 1;
-		item -= m_maxCachedIndex + 1;
-		index = m_maxCachedIndex + 1;
-		child = m_lookupCache[m_maxCachedIndex].child + 1;
+	return m_children[item + m_removed_at_front];
+}
+
+int CServerItem::FindChild(CQueueItem const* pItem) const
+{
+	auto const begin = m_children.cbegin() + m_removed_at_front;
+	auto const it = std::lower_bound(begin, m_children.cend(), pItem->m_childKey, [](CQueueItem const* child, int64_t key) {
+		return child->m_childKey < key;
+	});
+	if (it == m_children.cend() || *it != pItem) {
+		return -1;
 	}
 
-	for (; iter != m_children.end(); ++iter, ++child) {
-		if (!item) {
-			return *iter;
-		}
+	return static_cast<int>(it - m_children.cbegin());
+}
 
-		unsigned int count = (*iter)->GetChildrenCount(true);
-		if (item > count) {
-			if (m_maxCachedIndex == -1 && m_lookupCache.size() < (unsigned int)m_visibleOffspring)
-				m_lookupCache.resize(m_visibleOffspring);
-			for (unsigned int k = index; k <= index + count; ++k) {
-				m_lookupCache[k].child = child;
-				m_lookupCache[k].index = index;
-			}
-			m_maxCachedIndex = index + count;
-			item -= count + 1;
-			index += count + 1;
-			continue;
-		}
+int CServerItem::GetChildRow(CQueueItem const& item) const
+{
+	int row = FindChild(&item);
+	if (row < 0) {
+		return -1;
+	}
 
-		return (*iter)->GetChild(item - 1);
+	row -= m_removed_at_front;
+	for (auto const* expanded : m_expanded) {
+		if (expanded->m_childKey >= item.m_childKey) {
+			break;
+		}
+		row += expanded->GetChildrenCount(true);
 	}
-	return 0;
+
+	return row;
 }
 
-namespace {
-CFileItem* DoGetIdleChild(std::deque<CFileItem*> const* fileList, TransferDirection direction)
+void CServerItem::UpdateExpanded(CQueueItem* pChild)
 {
-	int i = 0;
-	for (i = static_cast<int>(QueuePriority::count) - 1; i >= 0; --i) {
-		for (auto const& item : fileList[i]) {
-			if (item->IsActive()) {
-				continue;
-			}
+	auto it = std::lower_bound(m_expanded.begin(), m_expanded.end(), pChild->m_childKey, [](CQueueItem const* child, int64_t key) {
+		return child->m_childKey < key;
+	});
+	bool const listed = it != m_expanded.end() && *it == pChild;
+	bool const expanded = pChild->GetChildrenCount(true) != 0;
+	if (expanded && !listed) {
+		if (FindChild(pChild) >= 0) {
+			m_expanded.insert(it, pChild);
+		}
+	}
+	else if (!expanded && listed) {
+		m_expanded.erase(it);
+	}
+}
 
-			if (direction == TransferDirection::both) {
-				return item;
-			}
+void CServerItem::RebuildExpanded()
+{
+	m_expanded.clear();
+	for (auto it = m_children.cbegin() + m_removed_at_front; it != m_children.cend(); ++it) {
+		if ((*it)->GetChildrenCount(true)) {
+			m_expanded.push_back(*it);
+		}
+	}
+}
 
-			if (direction == TransferDirection::download) {
-				if (item->Download()) {
-					return item;
-				}
-			}
-			else if (!item->Download()) {
-				return item;
-			}
+CFileItem* CServerItem::DoGetIdleChild(int queued, TransferDirection direction)
+{
+	for (int i = static_cast<int>(QueuePriority::count) - 1; i >= 0; --i) {
+		CFileItem* download = (direction != TransferDirection::upload) ? m_idleList[queued][i][0].front : nullptr;
+		CFileItem* upload = (direction != TransferDirection::download) ? m_idleList[queued][i][1].front : nullptr;
+		if (download && upload) {
+			return download->idle_seq_ < upload->idle_seq_ ? download : upload;
+		}
+		if (download) {
+			return download;
+		}
+		if (upload) {
+			return upload;
 		}
 	}
 	return 0;
 }
-}
 
 CFileItem* CServerItem::GetIdleChild(bool immediateOnly, TransferDirection direction)
 {
-	CFileItem* item = DoGetIdleChild(m_fileList[1], direction);
+	CFileItem* item = DoGetIdleChild(1, direction);
 	if ( !item && !immediateOnly ) {
-		item = DoGetIdleChild(m_fileList[0], direction);
+		item = DoGetIdleChild(0, direction);
 	}
 	return item;
 }
@@ -671,9 +802,39 @@ bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 		RemoveFileItemFromList(pFileItem, forward);
 	}
 
-	bool removed = CQueueItem::RemoveChild(pItem, destroy, forward);
-	if (removed) {
-		m_maxCachedIndex = -1;
+	bool removed;
+	int const index = FindChild(pItem);
+	if (index >= 0) {
+		m_visibleOffspring -= 1 + pItem->GetChildrenCount(true);
+
+		auto expanded = std::lower_bound(m_expanded.begin(), m_expanded.end(), pItem->m_childKey, [](CQueueItem const* child, int64_t key) {
+			return child->m_childKey < key;
+		});
+		if (expanded != m_expanded.end() && *expanded == pItem) {
+			m_expanded.erase(expanded);
+		}
+
+		if (destroy) {
+			delete pItem;
+		}
+
+		if (index - m_removed_at_front <= 10) {
+			++m_removed_at_front;
+			for (int i = index; i >= m_removed_at_front; --i) {
+				m_children[i] = m_children[i - 1];
+			}
+		}
+		else {
+			m_children.erase(m_children.begin() + index);
+		}
+		removed = true;
+	}
+	else {
+		// Not a direct child
+		removed = CQueueItem::RemoveChild(pItem, destroy, forward);
+		if (removed) {
+			RebuildExpanded();
+		}
 	}
 
 	wxASSERT(m_visibleOffspring >= static_cast<int>(m_children.size()) - m_removed_at_front);
@@ -684,21 +845,15 @@ bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 
 void CServerItem::QueueImmediateFiles()
 {
+	// Active items stay immediate, they are only in the lists while idle.
 	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
-		std::deque<CFileItem*> activeList;
-		std::deque<CFileItem*>& fileList = m_fileList[1][i];
-		for (auto iter = fileList.rbegin(); iter != fileList.rend(); ++iter) {
+		auto const items = TakeIdle(1, i);
+		for (auto iter = items.rbegin(); iter != items.rend(); ++iter) {
 			CFileItem* item = *iter;
 			wxASSERT(!item->queued());
-			if (item->IsActive()) {
-				activeList.push_front(item);
-			}
-			else {
-				item->set_queued(true);
-				m_fileList[0][i].push_front(item);
-			}
+			item->set_queued(true);
+			LinkIdle(GetIdleList(true, item->GetPriority(), item->Download()), item, true);
 		}
-		std::swap(fileList, activeList);
 	}
 }
 
@@ -708,18 +863,14 @@ void CServerItem::QueueImmediateFile(CFileItem* pItem)
 		return;
 	}
 
-	std::deque<CFileItem*>& fileList = m_fileList[1][static_cast<int>(pItem->GetPriority())];
-	for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
-		if (*iter != pItem) {
-			continue;
-		}
-
-		pItem->set_queued(true);
-		fileList.erase(iter);
-		m_fileList[0][static_cast<int>(pItem->GetPriority())].push_front(pItem);
-		return;
+	bool const listed = pItem->idle_listed_;
+	if (listed) {
+		UnlinkIdle(GetIdleList(false, pItem->GetPriority(), pItem->Download()), pItem);
+	}
+	pItem->set_queued(true);
+	if (listed) {
+		LinkIdle(GetIdleList(true, pItem->GetPriority(), pItem->Download()), pItem, true);
 	}
-	wxASSERT(false);
 }
 
 void CServerItem::SaveItem(pugi::xml_node& element) const
@@ -735,25 +886,20 @@ void CServerItem::SaveItem(pugi::xml_node& element) const
 int64_t CServerItem::GetTotalSize(int& filesWithUnknownSize, int& queuedFiles) const
 {
 	int64_t totalSize = 0;
-	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
-		for (int j = 0; j < 2; ++j) {
-			const std::deque<CFileItem*>& fileList = m_fileList[j][i];
-			for (auto const& item : fileList) {
-				int64_t size = item->GetSize();
-				if (size >= 0) {
-					totalSize += size;
-				}
-				else {
-					filesWithUnknownSize++;
-				}
-			}
-		}
-	}
-
 	for (std::vector<CQueueItem*>::const_iterator iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter) {
 		if ((*iter)->GetType() == QueueItemType::File ||
 			(*iter)->GetType() == QueueItemType::Folder)
+		{
 			queuedFiles++;
+
+			int64_t size = static_cast<CFileItem const*>(*iter)->GetSize();
+			if (size >= 0) {
+				totalSize += size;
+			}
+			else {
+				filesWithUnknownSize++;
+			}
+		}
 	}
 
 	return totalSize;
@@ -785,7 +931,7 @@ bool CServerItem::TryRemoveAll()
 	std::swap(m_children, keepChildren);
 	m_removed_at_front = 0;
 
-	m_maxCachedIndex = -1;
+	RebuildExpanded();
 
 	wxASSERT(oldVisibleOffspring >= m_visibleOffspring);
 	wxASSERT(m_visibleOffspring >= static_cast<int>(m_children.size()));
@@ -800,12 +946,15 @@ void CServerItem::DetachChildren()
 
 	m_children.clear();
 	m_visibleOffspring = 0;
-	m_maxCachedIndex = -1;
+	m_expanded.clear();
 	m_removed_at_front = 0;
 
+	// The children have been handed to a different server item already,
+	// their links now belong to its lists.
 	for (int i = 0; i < 2; ++i) {
 		for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
-			m_fileList[i][j].clear();
+			m_idleList[i][j][0] = idle_list();
+			m_idleList[i][j][1] = idle_list();
 		}
 	}
 }
@@ -822,30 +971,29 @@ void CServerItem::SetPriority(QueuePriority priority)
 		}
 	}
 
-	for (int i = 0; i < 2; ++i)
+	for (int i = 0; i < 2; ++i) {
+		auto items = TakeIdle(i, static_cast<int>(priority));
 		for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
 			if (j != static_cast<int>(priority)) {
-				std::move(m_fileList[i][j].begin(), m_fileList[i][j].end(), std::back_inserter(m_fileList[i][static_cast<int>(priority)]));
-				m_fileList[i][j].clear();
+				auto const other = TakeIdle(i, j);
+				items.insert(items.end(), other.begin(), other.end());
 			}
 		}
+		for (auto * item : items) {
+			LinkIdle(GetIdleList(i == 0, priority, item->Download()), item, false);
+		}
+	}
 }
 
 void CServerItem::SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority)
 {
-	int i = pItem->queued() ? 0 : 1;
-
-	for (auto iter = m_fileList[i][static_cast<int>(oldPriority)].begin(); iter != m_fileList[i][static_cast<int>(oldPriority)].end(); ++iter) {
-		if (*iter != pItem) {
-			continue;
-		}
-
-		m_fileList[i][static_cast<int>(oldPriority)].erase(iter);
-		m_fileList[i][static_cast<int>(newPriority)].push_back(pItem);
+	if (!pItem->idle_listed_) {
+		// Active, gets added to the list of its new priority once done
 		return;
 	}
 
-	wxFAIL;
+	UnlinkIdle(GetIdleList(pItem->queued(), oldPriority, pItem->Download()), pItem);
+	LinkIdle(GetIdleList(pItem->queued(), newPriority, pItem->Download()), pItem, false);
 }
 
 // --------------
@@ -1590,6 +1738,7 @@ void CQueueViewBase::OnExport(wxCommandEvent&)
 
 	auto exportRoot = xml.CreateEmpty();
 
+	LoadRemainingItems();
 	WriteToFile(exportRoot);
 
 	SaveWithErrorDialog(xml);
@@ -60,6 +60,10 @@ public:
 
 	int GetRemovedAtFront() const { return m_removed_at_front; }
 
+	// Row of the item in the queue database in journal mode, 0 if none
+	int64_t GetStorageId() const { return m_storageId; }
+	void SetStorageId(int64_t id) { m_storageId = id; }
+
 protected:
 	CQueueItem(CQueueItem* parent = 0);
 
@@ -76,6 +80,11 @@ private:
 	// Increased instead of calling slow m_children.erase(0),
 	// resetted on insert.
 	int m_removed_at_front{};
+
+	int64_t m_storageId{};
+
+	// Position among the children of a server item, increasing in list order
+	int64_t m_childKey{};
 };
 
 class CFileItem;
@@ -114,6 +123,9 @@ public:
 
 	void SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority);
 
+	// Called by children when they start or stop being transferred
+	void SetChildActive(CFileItem* pItem, bool active);
+
 	int m_activeCount;
 
 	const std::vector<CQueueItem*>& GetChildren() const { return m_children; }
@@ -126,22 +138,52 @@ protected:
 
 	Site site_;
 
-	// array of item lists, sorted by priority. Used by scheduler to find
-	// next file to transfer
-	// First index specifies whether the item is queued (0) or immediate (1)
-	std::deque<CFileItem*> m_fileList[2][static_cast<int>(QueuePriority::count)];
+	// Intrusive list of idle items, linked through the items themselves so
+	// that items can be taken out in constant time.
+	struct idle_list final
+	{
+		CFileItem* front{};
+		CFileItem* back{};
+	};
+
+	// Lists of idle items, used by the scheduler to find the next file to
+	// transfer. Items are taken out while being transferred.
+	// First index specifies whether the item is queued (0) or immediate (1),
+	// last index whether it is a download (0) or upload (1).
+	idle_list m_idleList[2][static_cast<int>(QueuePriority::count)][2];
+
+	// Ordering of items in lists of different directions
+	int64_t m_idleFrontSeq{};
+	int64_t m_idleBackSeq{};
+
+	idle_list& GetIdleList(bool queued, QueuePriority priority, bool download);
+	CFileItem* DoGetIdleChild(int queued, TransferDirection direction);
+	void LinkIdle(idle_list& list, CFileItem* pItem, bool front);
+	void UnlinkIdle(idle_list& list, CFileItem* pItem);
+
+	// Removes all items of the given lists, returning them in their order.
+	std::vector<CFileItem*> TakeIdle(int queued, int priority);
 
 	friend class CQueueItem;
 
 	int m_visibleOffspring{}; // Visible offspring over all sublevels
-	int m_maxCachedIndex{-1};
 
-	struct t_cacheItem
-	{
-		int index;
-		int child;
-	};
-	std::vector<t_cacheItem> m_lookupCache;
+	// Children are ordered by their keys, so a child can be found by binary
+	// search. Returns its index in m_children, or -1 if not a child.
+	int FindChild(CQueueItem const* pItem) const;
+
+	// Visible index of the child relative to the first child, -1 if not a child
+	int GetChildRow(CQueueItem const& item) const;
+
+	// Keeps track of children having visible offspring of their own
+	void UpdateExpanded(CQueueItem* pChild);
+	void RebuildExpanded();
+
+	int64_t m_nextChildKey{};
+
+	// Children with visible offspring, which are few: Only active transfers
+	// have status lines. Ordered by key.
+	std::vector<CQueueItem*> m_expanded;
 };
 
 struct t_EngineData;
@@ -254,6 +296,17 @@ public:
 	unsigned char m_errorCount{};
 	t_EngineData* m_pEngineData{};
 
+private:
+	friend class CServerItem;
+
+	// Maintained by the parent's idle lists
+	CFileItem* idle_prev_{};
+	CFileItem* idle_next_{};
+	int64_t idle_seq_{};
+	bool idle_listed_{};
+
+public:
+
 	inline bool made_progress() const { return flags_ & queue_flags::made_progess; }
 	inline void set_made_progress(bool made_progress)
 	{
@@ -333,6 +386,9 @@ public:
 
 	void WriteToFile(pugi::xml_node element) const;
 
+	// Items that have not been loaded yet, see CQueueView::LoadQueue
+	virtual void LoadRemainingItems() {}
+
 protected:
 
 	void CreateColumns(std::vector<ColumnId> const& extraColumns = std::vector<ColumnId>());
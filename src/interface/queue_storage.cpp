@@ -139,6 +139,7 @@ public:
 	sqlite3_stmt* PrepareInsertStatement(std::string const& name, _column const*, unsigned int count);
 
 	bool SaveServer(CServerItem const& item);
+	int64_t InsertServer(CServerItem const& item);
 	bool SaveFile(CFileItem const& item);
 	bool SaveDirectory(CFolderItem const& item);
 
@@ -164,13 +165,18 @@ public:
 	int GetColumnInt(sqlite3_stmt* statement, int index, int def = 0);
 
 	int64_t ParseServerFromRow(Site & site);
-	int64_t ParseFileFromRow(CFileItem** pItem);
+	int64_t ParseFileFromRow(sqlite3_stmt* statement, CFileItem** pItem);
 
 	bool MigrateSchema();
 
 	bool BeginTransaction();
 	bool EndTransaction(bool roolback);
 
+	bool Run(sqlite3_stmt* statement);
+
+	bool PrepareJournalStatements();
+	bool BeginJournalTransaction();
+
 	void Close();
 
 	sqlite3* db_{};
@@ -185,6 +191,21 @@ public:
 	sqlite3_stmt* selectLocalPathQuery_{};
 	sqlite3_stmt* selectRemotePathQuery_{};
 
+	// Journal mode
+	bool journal_{};
+
+	// Rows added after enabling the journal belong to items which are
+	// already loaded, paged loading must not return them.
+	int64_t journalMaxId_{};
+
+	sqlite3_stmt* selectFilesPageQuery_{};
+	sqlite3_stmt* deleteFileQuery_{};
+	sqlite3_stmt* deleteFilesQuery_{};
+	sqlite3_stmt* deleteServerQuery_{};
+	sqlite3_stmt* moveFilesQuery_{};
+	sqlite3_stmt* updatePriorityQuery_{};
+	sqlite3_stmt* updateServerPriorityQuery_{};
+
 	// Caches to speed up saving and loading
 	void ClearCaches();
 
@@ -210,6 +231,7 @@ void CQueueStorage::Impl::ReadLocalPaths()
 			std::wstring localPathRaw = GetColumnText(selectLocalPathQuery_, path_table_column_names::path);
 			CLocalPath localPath;
 			if (id > 0 && !localPathRaw.empty() && localPath.SetPath(localPathRaw)) {
+				localPaths_[localPath.GetPath()] = id;
 				reverseLocalPaths_[id] = localPath;
 			}
 		}
@@ -234,6 +256,7 @@ void CQueueStorage::Impl::ReadRemotePaths()
 			std::wstring remotePathRaw = GetColumnText(selectRemotePathQuery_, path_table_column_names::path);
 			CServerPath remotePath;
 			if (id > 0 && !remotePathRaw.empty() && remotePath.SetSafePath(remotePathRaw)) {
+				remotePaths_[remotePath.GetSafePath()] = id;
 				reverseRemotePaths_[id] = remotePath;
 			}
 		}
@@ -280,6 +303,19 @@ static int int_callback(void* p, int n, char** v, char**)
 }
 
 
+static int int64_callback(void* p, int n, char** v, char**)
+{
+	int64_t* i = static_cast<int64_t*>(p);
+	if (!i || !n || !v) {
+		return -1;
+	}
+
+	// Aggregates over empty tables are NULL
+	*i = *v ? strtoll(*v, 0, 10) : 0;
+	return 0;
+}
+
+
 bool CQueueStorage::Impl::MigrateSchema()
 {
 	if (!db_) {
@@ -638,6 +674,30 @@ bool CQueueStorage::Impl::BindNull(sqlite3_stmt* statement, int index)
 
 
 bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
+{
+	int64_t const serverId = InsertServer(item);
+	if (serverId <= 0) {
+		return false;
+	}
+
+	Bind(insertFileQuery_, file_table_column_names::server, serverId);
+
+	bool ret = true;
+	const std::vector<CQueueItem*>& children = item.GetChildren();
+	for (std::vector<CQueueItem*>::const_iterator it = children.begin() + item.GetRemovedAtFront(); it != children.end(); ++it) {
+		CQueueItem & childItem = **it;
+		if (childItem.GetType() == QueueItemType::File) {
+			ret &= SaveFile(static_cast<CFileItem&>(childItem));
+		}
+		else if (childItem.GetType() == QueueItemType::Folder) {
+			ret &= SaveDirectory(static_cast<CFolderItem&>(childItem));
+		}
+	}
+	return ret;
+}
+
+
+int64_t CQueueStorage::Impl::InsertServer(CServerItem const& item)
 {
 	bool kiosk_mode = COptions::Get()->get_int(OPTION_DEFAULT_KIOSKMODE) != 0;
 
@@ -788,23 +848,11 @@ bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
 
 	sqlite3_reset(insertServerQuery_);
 
-	bool ret = res == SQLITE_DONE;
-	if (ret) {
-		sqlite3_int64 serverId = sqlite3_last_insert_rowid(db_);
-		Bind(insertFileQuery_, file_table_column_names::server, static_cast<int64_t>(serverId));
-
-		const std::vector<CQueueItem*>& children = item.GetChildren();
-		for (std::vector<CQueueItem*>::const_iterator it = children.begin() + item.GetRemovedAtFront(); it != children.end(); ++it) {
-			CQueueItem & childItem = **it;
-			if (childItem.GetType() == QueueItemType::File) {
-				ret &= SaveFile(static_cast<CFileItem&>(childItem));
-			}
-			else if (childItem.GetType() == QueueItemType::Folder) {
-				ret &= SaveDirectory(static_cast<CFolderItem&>(childItem));
-			}
-		}
+	if (res != SQLITE_DONE) {
+		return -1;
 	}
-	return ret;
+
+	return static_cast<int64_t>(sqlite3_last_insert_rowid(db_));
 }
 
 
@@ -1102,18 +1150,18 @@ int64_t CQueueStorage::Impl::ParseServerFromRow(Site & site)
 }
 
 
-int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
+int64_t CQueueStorage::Impl::ParseFileFromRow(sqlite3_stmt* statement, CFileItem** pItem)
 {
-	std::wstring sourceFile = GetColumnText(selectFilesQuery_, file_table_column_names::source_file);
-	std::wstring targetFile = GetColumnText(selectFilesQuery_, file_table_column_names::target_file);
+	std::wstring sourceFile = GetColumnText(statement, file_table_column_names::source_file);
+	std::wstring targetFile = GetColumnText(statement, file_table_column_names::target_file);
 
-	int64_t localPathId = GetColumnInt64(selectFilesQuery_, file_table_column_names::local_path, false);
-	int64_t remotePathId = GetColumnInt64(selectFilesQuery_, file_table_column_names::remote_path, false);
+	int64_t localPathId = GetColumnInt64(statement, file_table_column_names::local_path, false);
+	int64_t remotePathId = GetColumnInt64(statement, file_table_column_names::remote_path, false);
 
 	CLocalPath const localPath(GetLocalPath(localPathId));
 	CServerPath const remotePath(GetRemotePath(remotePathId));
 
-	auto flags = static_cast<transfer_flags>(GetColumnInt(selectFilesQuery_, file_table_column_names::flags));
+	auto flags = static_cast<transfer_flags>(GetColumnInt(statement, file_table_column_names::flags));
 	bool const download = flags & transfer_flags::download;
 
 	if (localPathId == -1 || remotePathId == -1) {
@@ -1132,13 +1180,13 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 		}
 	}
 	else {
-		int64_t size = GetColumnInt64(selectFilesQuery_, file_table_column_names::size);
-		unsigned char errorCount = static_cast<unsigned char>(GetColumnInt(selectFilesQuery_, file_table_column_names::error_count));
-		int priority = GetColumnInt(selectFilesQuery_, file_table_column_names::priority, static_cast<int>(QueuePriority::normal));
+		int64_t size = GetColumnInt64(statement, file_table_column_names::size);
+		unsigned char errorCount = static_cast<unsigned char>(GetColumnInt(statement, file_table_column_names::error_count));
+		int priority = GetColumnInt(statement, file_table_column_names::priority, static_cast<int>(QueuePriority::normal));
 
-		std::wstring extraFlags = GetColumnText(selectFilesQuery_, file_table_column_names::extra_flags);
+		std::wstring extraFlags = GetColumnText(statement, file_table_column_names::extra_flags);
 
-		int overwrite_action = GetColumnInt(selectFilesQuery_, file_table_column_names::default_exists_action, CFileExistsNotification::unknown);
+		int overwrite_action = GetColumnInt(statement, file_table_column_names::default_exists_action, CFileExistsNotification::unknown);
 
 		if (sourceFile.empty() || localPath.empty() ||
 			remotePath.empty() ||
@@ -1158,7 +1206,7 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 		}
 	}
 
-	return GetColumnInt64(selectFilesQuery_, file_table_column_names::id);
+	return GetColumnInt64(statement, file_table_column_names::id);
 }
 
 bool CQueueStorage::Impl::BeginTransaction()
@@ -1176,6 +1224,60 @@ bool CQueueStorage::Impl::EndTransaction(bool rollback)
 	}
 }
 
+bool CQueueStorage::Impl::Run(sqlite3_stmt* statement)
+{
+	int res;
+	do {
+		res = sqlite3_step(statement);
+	} while (res == SQLITE_BUSY);
+
+	sqlite3_reset(statement);
+
+	return res == SQLITE_DONE;
+}
+
+bool CQueueStorage::Impl::PrepareJournalStatements()
+{
+	{
+		std::string query = "SELECT ";
+		for (unsigned int i = 0; i < (sizeof(file_table_columns) / sizeof(_column)); ++i) {
+			if (i > 0) {
+				query += ", ";
+			}
+			query += file_table_columns[i].name;
+		}
+
+		query += " FROM files WHERE server=:server AND id>:after AND id<=:max ORDER BY id ASC LIMIT :limit";
+
+		if (!(selectFilesPageQuery_ = PrepareStatement(query))) {
+			return false;
+		}
+	}
+
+	deleteFileQuery_ = PrepareStatement("DELETE FROM files WHERE id=:id");
+	deleteFilesQuery_ = PrepareStatement("DELETE FROM files WHERE server=:server AND id>:after");
+	deleteServerQuery_ = PrepareStatement("DELETE FROM servers WHERE id=:id");
+	moveFilesQuery_ = PrepareStatement("UPDATE files SET server=:to WHERE server=:from");
+	updatePriorityQuery_ = PrepareStatement("UPDATE files SET priority=:priority WHERE id=:id");
+	updateServerPriorityQuery_ = PrepareStatement("UPDATE files SET priority=:priority WHERE server=:server");
+
+	return deleteFileQuery_ && deleteFilesQuery_ && deleteServerQuery_ && moveFilesQuery_ && updatePriorityQuery_ && updateServerPriorityQuery_;
+}
+
+bool CQueueStorage::Impl::BeginJournalTransaction()
+{
+	if (!journal_) {
+		return false;
+	}
+
+	if (!sqlite3_get_autocommit(db_)) {
+		// Already inside a transaction
+		return true;
+	}
+
+	return BeginTransaction();
+}
+
 
 void CQueueStorage::Impl::Close()
 {
@@ -1187,6 +1289,13 @@ void CQueueStorage::Impl::Close()
 	sqlite3_finalize(selectFilesQuery_);
 	sqlite3_finalize(selectLocalPathQuery_);
 	sqlite3_finalize(selectRemotePathQuery_);
+	sqlite3_finalize(selectFilesPageQuery_);
+	sqlite3_finalize(deleteFileQuery_);
+	sqlite3_finalize(deleteFilesQuery_);
+	sqlite3_finalize(deleteServerQuery_);
+	sqlite3_finalize(moveFilesQuery_);
+	sqlite3_finalize(updatePriorityQuery_);
+	sqlite3_finalize(updateServerPriorityQuery_);
 	insertServerQuery_ = 0;
 	insertFileQuery_ = 0;
 	insertLocalPathQuery_ = 0;
@@ -1195,6 +1304,14 @@ void CQueueStorage::Impl::Close()
 	selectFilesQuery_ = 0;
 	selectLocalPathQuery_ = 0;
 	selectRemotePathQuery_ = 0;
+	selectFilesPageQuery_ = 0;
+	deleteFileQuery_ = 0;
+	deleteFilesQuery_ = 0;
+	deleteServerQuery_ = 0;
+	moveFilesQuery_ = 0;
+	updatePriorityQuery_ = 0;
+	updateServerPriorityQuery_ = 0;
+	journal_ = false;
 	sqlite3_close(db_);
 	db_ = 0;
 }
@@ -1216,6 +1333,7 @@ CQueueStorage::CQueueStorage()
 
 CQueueStorage::~CQueueStorage()
 {
+	Flush();
 	d_->Close();
 	delete d_;
 }
@@ -1305,7 +1423,7 @@ int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server)
 			while (res == SQLITE_BUSY);
 
 			if (res == SQLITE_ROW) {
-				ret = d_->ParseFileFromRow(pItem);
+				ret = d_->ParseFileFromRow(d_->selectFilesQuery_, pItem);
 				if (ret > 0) {
 					break;
 				}
@@ -1329,6 +1447,228 @@ int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server)
 	return ret;
 }
 
+int64_t CQueueStorage::GetFiles(std::vector<std::pair<int64_t, CFileItem*>> & items, int64_t server, int64_t after, size_t limit)
+{
+	sqlite3_stmt* const query = d_->selectFilesPageQuery_;
+	if (!query || server <= 0) {
+		return -1;
+	}
+
+	// Parameters are numbered in order of appearance
+	d_->Bind(query, 1, server);
+	d_->Bind(query, 2, after);
+	d_->Bind(query, 3, d_->journalMaxId_);
+	d_->Bind(query, 4, static_cast<int64_t>(limit));
+
+	int64_t last = after;
+	for (;;) {
+		int res;
+		do {
+			res = sqlite3_step(query);
+		}
+		while (res == SQLITE_BUSY);
+
+		if (res == SQLITE_ROW) {
+			// Skip over invalid rows, the next page starts after them.
+			last = d_->GetColumnInt64(query, file_table_column_names::id);
+
+			CFileItem* item{};
+			int64_t const id = d_->ParseFileFromRow(query, &item);
+			if (id > 0 && item) {
+				items.emplace_back(id, item);
+			}
+			else {
+				delete item;
+			}
+		}
+		else {
+			sqlite3_reset(query);
+			if (res != SQLITE_DONE) {
+				return -1;
+			}
+			break;
+		}
+	}
+
+	return last;
+}
+
+bool CQueueStorage::EnableJournal()
+{
+	if (!d_->db_) {
+		return false;
+	}
+	if (d_->journal_) {
+		return true;
+	}
+
+	// With a write-ahead log, committing the changes does not require
+	// rewriting the database pages, cheap enough to do it after every change
+	// to the queue.
+	if (sqlite3_exec(d_->db_, "PRAGMA journal_mode=WAL", 0, 0, 0) != SQLITE_OK) {
+		return false;
+	}
+	sqlite3_exec(d_->db_, "PRAGMA synchronous=NORMAL", 0, 0, 0);
+
+	if (!d_->PrepareJournalStatements()) {
+		return false;
+	}
+
+	if (sqlite3_exec(d_->db_, "SELECT MAX(id) FROM files", int64_callback, &d_->journalMaxId_, 0) != SQLITE_OK) {
+		return false;
+	}
+
+	d_->journal_ = true;
+	return true;
+}
+
+bool CQueueStorage::JournalEnabled() const
+{
+	return d_->journal_;
+}
+
+bool CQueueStorage::JournalAdd(CServerItem & server, CFileItem & item)
+{
+	if (item.m_edit != CEditHandler::none) {
+		// Never saved
+		return true;
+	}
+
+	if (!d_->BeginJournalTransaction()) {
+		return false;
+	}
+
+	if (!server.GetStorageId()) {
+		int64_t const id = d_->InsertServer(server);
+		if (id <= 0) {
+			return false;
+		}
+		server.SetStorageId(id);
+	}
+
+	d_->Bind(d_->insertFileQuery_, file_table_column_names::server, server.GetStorageId());
+
+	bool ret;
+	if (item.GetType() == QueueItemType::Folder) {
+		ret = d_->SaveDirectory(static_cast<CFolderItem&>(item));
+	}
+	else {
+		ret = d_->SaveFile(item);
+	}
+	if (ret) {
+		item.SetStorageId(static_cast<int64_t>(sqlite3_last_insert_rowid(d_->db_)));
+	}
+
+	return ret;
+}
+
+bool CQueueStorage::JournalRemoveFile(int64_t id)
+{
+	if (id <= 0 || !d_->BeginJournalTransaction()) {
+		return false;
+	}
+
+	d_->Bind(d_->deleteFileQuery_, 1, id);
+	return d_->Run(d_->deleteFileQuery_);
+}
+
+bool CQueueStorage::JournalRemoveFiles(int64_t server, int64_t after)
+{
+	if (server <= 0 || !d_->BeginJournalTransaction()) {
+		return false;
+	}
+
+	d_->Bind(d_->deleteFilesQuery_, 1, server);
+	d_->Bind(d_->deleteFilesQuery_, 2, after);
+	return d_->Run(d_->deleteFilesQuery_);
+}
+
+bool CQueueStorage::JournalRemoveServer(int64_t server)
+{
+	if (!JournalRemoveFiles(server)) {
+		return false;
+	}
+
+	d_->Bind(d_->deleteServerQuery_, 1, server);
+	return d_->Run(d_->deleteServerQuery_);
+}
+
+bool CQueueStorage::JournalMergeServer(int64_t from, int64_t to)
+{
+	if (from <= 0 || to <= 0 || !d_->BeginJournalTransaction()) {
+		return false;
+	}
+
+	d_->Bind(d_->moveFilesQuery_, 1, to);
+	d_->Bind(d_->moveFilesQuery_, 2, from);
+	if (!d_->Run(d_->moveFilesQuery_)) {
+		return false;
+	}
+
+	d_->Bind(d_->deleteServerQuery_, 1, from);
+	return d_->Run(d_->deleteServerQuery_);
+}
+
+bool CQueueStorage::JournalUpdateServer(CServerItem & item)
+{
+	if (item.GetStorageId() <= 0 || !d_->BeginJournalTransaction()) {
+		return false;
+	}
+
+	int64_t const id = d_->InsertServer(item);
+	if (id <= 0 || !JournalMergeServer(item.GetStorageId(), id)) {
+		return false;
+	}
+
+	item.SetStorageId(id);
+	return true;
+}
+
+bool CQueueStorage::JournalPriority(CFileItem const& item, QueuePriority priority)
+{
+	if (item.GetStorageId() <= 0 || !d_->BeginJournalTransaction()) {
+		return false;
+	}
+
+	d_->Bind(d_->updatePriorityQuery_, 1, static_cast<int>(priority));
+	d_->Bind(d_->updatePriorityQuery_, 2, item.GetStorageId());
+	return d_->Run(d_->updatePriorityQuery_);
+}
+
+bool CQueueStorage::JournalPriority(CServerItem const& item, QueuePriority priority)
+{
+	if (item.GetStorageId() <= 0 || !d_->BeginJournalTransaction()) {
+		return false;
+	}
+
+	d_->Bind(d_->updateServerPriorityQuery_, 1, static_cast<int>(priority));
+	d_->Bind(d_->updateServerPriorityQuery_, 2, item.GetStorageId());
+	return d_->Run(d_->updateServerPriorityQuery_);
+}
+
+bool CQueueStorage::Flush()
+{
+	if (!d_->journal_ || sqlite3_get_autocommit(d_->db_)) {
+		return true;
+	}
+
+	return d_->EndTransaction(false);
+}
+
+bool CQueueStorage::JournalPrunePaths()
+{
+	if (!d_->journal_ || !Flush()) {
+		return false;
+	}
+
+	bool ret = sqlite3_exec(d_->db_, "DELETE FROM local_paths WHERE id NOT IN (SELECT local_path FROM files WHERE local_path IS NOT NULL)", 0, 0, 0) == SQLITE_OK;
+	ret &= sqlite3_exec(d_->db_, "DELETE FROM remote_paths WHERE id NOT IN (SELECT remote_path FROM files WHERE remote_path IS NOT NULL)", 0, 0, 0) == SQLITE_OK;
+
+	d_->ClearCaches();
+
+	return ret;
+}
+
 bool CQueueStorage::Clear()
 {
 	if (!d_->db_) {
@@ -1,6 +1,7 @@
 #ifndef FILEZILLA_INTERFACE_QUEUE_STORAGE_HEADER
 #define FILEZILLA_INTERFACE_QUEUE_STORAGE_HEADER
 
+#include <utility>
 #include <vector>
 #include <stdint.h>
 #include <string>
@@ -8,6 +9,7 @@
 class CFileItem;
 class CServerItem;
 class Site;
+enum class QueuePriority : unsigned char;
 
 class CQueueStorage final
 {
@@ -39,6 +41,37 @@ public:
 
 	int64_t GetFile(CFileItem** pItem, int64_t server);
 
+	// Reads up to limit files of the server with an id larger than after.
+	// Returns the id of the last row read, after itself if there are no
+	// further rows, < 0 on failure.
+	int64_t GetFiles(std::vector<std::pair<int64_t, CFileItem*>> & items, int64_t server, int64_t after, size_t limit);
+
+	// Journal mode: Rather than saving the whole queue on exit, changes to
+	// the queue get recorded as they happen. Rows stay in place after being
+	// loaded, the items remember their row through their storage id.
+	// Changes are collected in a transaction until Flush gets called.
+	bool EnableJournal();
+	bool JournalEnabled() const;
+
+	// Also adds the server if it has not been stored yet. Assigns storage ids.
+	bool JournalAdd(CServerItem & server, CFileItem & item);
+	bool JournalRemoveFile(int64_t id);
+	bool JournalRemoveFiles(int64_t server, int64_t after = 0);
+	bool JournalRemoveServer(int64_t server);
+	bool JournalMergeServer(int64_t from, int64_t to);
+
+	// Stores the server anew, e.g. after its credentials have been re-protected
+	bool JournalUpdateServer(CServerItem & item);
+
+	// For server items the priority of all its files, stored or not, is changed.
+	bool JournalPriority(CFileItem const& item, QueuePriority priority);
+	bool JournalPriority(CServerItem const& item, QueuePriority priority);
+
+	bool Flush();
+
+	// Deletes stored paths no longer referenced by any file
+	bool JournalPrunePaths();
+
 	static std::wstring GetDatabaseFilename();
 
 private:
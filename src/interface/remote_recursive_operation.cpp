@@ -61,12 +61,56 @@ void CRemoteRecursiveOperation::do_start_recursive_operation(OperationMode mode,
 		m_actionAfterBlocker = m_pQueue->GetActionAfterBlocker();
 	}
 
+	StartParallelLister();
+
 	m_state.NotifyHandlers(STATECHANGE_REMOTE_IDLE);
 	m_state.NotifyHandlers(STATECHANGE_REMOTE_RECURSION_STATUS);
 
 	remote_recursive_operation::do_start_recursive_operation(mode, filters);
 }
 
+void CRemoteRecursiveOperation::StartParallelLister()
+{
+	Site const& site = m_state.GetSite();
+
+	// Servers limiting the connections per user refuse further logins, or
+	// even ban the client. Leave room for the connections of the queue.
+	size_t connections = static_cast<size_t>(COptions::Get()->get_int(OPTION_RECURSIVE_LIST_CONNECTIONS));
+	size_t const queueConnections = m_pQueue ? m_pQueue->GetConnectionCount(site) : 0;
+	int const maxConnections = site.server.MaximumMultipleConnections();
+	if (maxConnections > 0) {
+		// One connection is taken by the primary engine already
+		size_t const available = static_cast<size_t>(maxConnections - 1);
+		connections = std::min(connections, available - std::min(available, queueConnections));
+	}
+	else {
+		connections -= std::min(connections, queueConnections);
+	}
+	if (!connections) {
+		return;
+	}
+
+	auto lister = std::make_unique<parallel_lister>(m_state.GetEngineContext());
+
+	std::vector<uint8_t> certificate;
+	std::wstring hostkey;
+	CCertificateNotification* pCertificate{};
+	CSftpEncryptionNotification* pSftpEncryptionInfo{};
+	if (m_state.GetSecurityInfo(pCertificate)) {
+		auto const& certs = pCertificate->info_.get_certificates();
+		if (!certs.empty()) {
+			certificate = certs.front().get_raw_data();
+		}
+	}
+	else if (m_state.GetSecurityInfo(pSftpEncryptionInfo)) {
+		hostkey = pSftpEncryptionInfo->hostKeyFingerprint;
+	}
+	lister->set_trusted(certificate, hostkey);
+
+	if (lister->start(site, connections)) {
+		SetParallelLister(std::move(lister));
+	}
+}
 
 void CRemoteRecursiveOperation::process_command(std::unique_ptr<CCommand> pCommand) {
 	m_state.m_pCommandQueue->ProcessCommand(pCommand.release(), CCommandQueue::recursiveOperation);
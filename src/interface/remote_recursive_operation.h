@@ -33,6 +33,8 @@ protected:
 
 	void OnStateChange(t_statechange_notifications notification, std::wstring const&, const void* data) override;
 
+	void StartParallelLister();
+
 	bool m_immediate{true};
 	bool added_to_queue_{};
 	CState& m_state;
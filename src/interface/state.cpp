@@ -1432,3 +1432,8 @@ void CState::ChangeServer(CServer const& newServer)
 		m_site.server = newServer;
 	}
 }
+
+CFileZillaEngineContext& CState::GetEngineContext()
+{
+	return m_mainFrame.GetEngineContext();
+}
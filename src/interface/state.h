@@ -15,6 +15,10 @@ enum t_statechange_notifications
 
 	STATECHANGE_REMOTE_DIR,
 	STATECHANGE_REMOTE_DIR_OTHER,
+
+	// Incomplete listing while it is being received, data2 points to a
+	// std::shared_ptr<CDirectoryListing>. Always followed by STATECHANGE_REMOTE_DIR.
+	STATECHANGE_REMOTE_DIR_PARTIAL,
 	STATECHANGE_REMOTE_RECV,
 	STATECHANGE_REMOTE_SEND,
 	STATECHANGE_REMOTE_LINKNOTDIR,
@@ -79,6 +83,7 @@ private:
 };
 
 class CState;
+class CFileZillaEngineContext;
 class CContextManager final
 {
 	friend class CState;
@@ -217,6 +222,8 @@ public:
 
 	void ChangeServer(CServer const& newServer);
 
+	CFileZillaEngineContext& GetEngineContext();
+
 	fz::thread_pool & pool_;
 
 protected:
@@ -179,6 +179,11 @@ void CStatusLineCtrl::OnPaint(wxPaintEvent&)
 		else {
 			bytes_and_rate.Printf(_("%s (? B/s)"), bytestr);
 		}
+		if (status_.window > 0) {
+			const wxString windowstr = CSizeFormat::Format(status_.window, true, CSizeFormat::iec,
+														   COptions::Get()->get_int(OPTION_SIZE_USETHOUSANDSEP) != 0, 0);
+			bytes_and_rate += wxString::Format(_(", window %s"), windowstr);
+		}
 
 		if (m_last_bytes_and_rate != bytes_and_rate) {
 			refresh |= 8;
@@ -307,7 +312,7 @@ void CStatusLineCtrl::OnTimer(wxTimerEvent&)
 	}
 
 	bool changed;
-	CTransferStatus status = m_pEngineData->pEngine->GetTransferStatus(changed);
+	CTransferStatus status = m_pEngineData->GetTransferStatus(changed);
 
 	if (status.empty()) {
 		ClearTransferStatus();
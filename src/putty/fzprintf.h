@@ -1,4 +1,4 @@
-#define FZSFTP_PROTOCOL_VERSION 11
+#define FZSFTP_PROTOCOL_VERSION 15
 
 typedef enum
 {
@@ -33,6 +33,7 @@ typedef enum
     sftp_io_open,
     sftp_io_nextbuf,
     sftp_io_finalize,
+    sftpTransferWindow, /* read-ahead window of a download in bytes */
 } sftpEventTypes;
 
 extern bool pending_reply;
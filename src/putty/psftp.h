@@ -101,7 +101,7 @@ int read_from_file(RFile *f, void *buffer, int length);
 void close_rfile(RFile *f);
 WFile *open_new_file(const char *name, long perms);
 /* Returns <0 on error, 0 on eof, or number of bytes written, as usual */
-int write_to_file(WFile *f, void *buffer, int length);
+int write_to_file(WFile *f, const void *buffer, int length);
 int finalize_wfile(WFile *);
 void set_file_times(WFile *f, unsigned long mtime, unsigned long atime);
 /* Closes and frees the WFile */
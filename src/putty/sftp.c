@@ -12,13 +12,20 @@
 #include "tree234.h"
 #include "sftp.h"
 
-#include "fzprintf.h"
-#include "fzsftp.h"
+#include "putty.h"
 
 static const char *fxp_error_message;
 static int fxp_errtype;
 
+/*
+ * Limits advertised by the server through the limits@openssh.com
+ * extension. Zero means the server did not tell us.
+ */
+static uint64_t fxp_max_read_length;
+static uint64_t fxp_max_write_length;
+
 static void fxp_internal_error(const char *msg);
+static void fxp_query_limits(void);
 
 /* ----------------------------------------------------------------------
  * Client-specific parts of the send- and receive-packet system.
@@ -42,8 +49,8 @@ struct sftp_packet *sftp_recv(void)
         return NULL;
 
     /* Impose _some_ upper bound on packet size. We never expect to
-     * receive more than 32K of data in response to an FXP_READ,
-     * because we decide how much data to ask for. FXP_READDIR and
+     * receive more than XFER_REQSIZE_MAX of data in response to an
+     * FXP_READ, because we decide how much data to ask for. FXP_READDIR and
      * pathname-returning things like FXP_REALPATH don't have an
      * explicit bound, so I suppose we just have to trust the server
      * to be sensible. */
@@ -309,16 +316,83 @@ bool fxp_init(void)
         return false;
     }
     /*
-     * In principle, this packet might also contain extension-
-     * string pairs. We should work through them and look for any
-     * we recognise. In practice we don't currently do so because
-     * we know we don't recognise _any_.
+     * The packet might also contain extension-string pairs. The only
+     * one we care about is limits@openssh.com, which lets us size our
+     * read requests beyond the conservative 32K default.
      */
+    bool has_limits = false;
+    while (get_avail(pktin) > 0) {
+        ptrlen name = get_string(pktin);
+        ptrlen data = get_string(pktin);
+        if (get_err(pktin))
+            break;
+        if (ptrlen_eq_string(name, "limits@openssh.com") &&
+            ptrlen_eq_string(data, "1"))
+            has_limits = true;
+    }
     sftp_pkt_free(pktin);
 
+    if (has_limits)
+        fxp_query_limits();
+
     return true;
 }
 
+/*
+ * Ask the server for its packet and read/write size limits. Failure
+ * is not fatal, we merely keep using the defaults.
+ */
+static void fxp_query_limits(void)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout, *pktin;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "limits@openssh.com");
+    sftp_send(pktout);
+    sftp_register(req);
+
+    /* Nothing else can be outstanding during init, so the reply
+     * has to be ours. */
+    pktin = sftp_recv();
+    if (!sftp_find_request(pktin)) {
+        /* Still registered, take it out of the tree before freeing it */
+        del234(sftp_requests, req);
+        sfree(req);
+        if (pktin)
+            sftp_pkt_free(pktin);
+        return;
+    }
+    sfree(req);
+
+    if (pktin->type == SSH_FXP_EXTENDED_REPLY) {
+        uint64_t max_packet, max_read, max_write;
+        max_packet = get_uint64(pktin);
+        max_read = get_uint64(pktin);
+        max_write = get_uint64(pktin);
+        if (!get_err(pktin)) {
+            fxp_max_read_length = max_read;
+            fxp_max_write_length = max_write;
+            fzprintf(sftpVerbose, "Server limits: packet %"PRIu64", read %"PRIu64", write %"PRIu64,
+                     max_packet, max_read, max_write);
+        }
+    } else {
+        fxp_got_status(pktin);
+    }
+    sftp_pkt_free(pktin);
+}
+
+uint64_t fxp_get_max_read_length(void)
+{
+    return fxp_max_read_length;
+}
+
+uint64_t fxp_get_max_write_length(void)
+{
+    return fxp_max_write_length;
+}
+
 /*
  * Canonify a pathname.
  */
@@ -736,6 +810,41 @@ int fxp_read_recv(struct sftp_packet *pktin, struct sftp_request *req,
     }
 }
 
+/*
+ * Like fxp_read_recv, but leaves the data where it is instead of
+ * copying it out. On success, ownership of pktin passes to the caller
+ * through *pkt and *data points at the payload inside it.
+ */
+int fxp_read_recv_inplace(struct sftp_packet *pktin, struct sftp_request *req,
+                          struct sftp_packet **pkt, const char **data, int len)
+{
+    sfree(req);
+    if (pktin->type == SSH_FXP_DATA) {
+        ptrlen payload;
+
+        payload = get_string(pktin);
+        if (get_err(pktin)) {
+            fxp_internal_error("READ returned malformed SSH_FXP_DATA packet");
+            sftp_pkt_free(pktin);
+            return -1;
+        }
+
+        if (payload.len > len) {
+            fxp_internal_error("READ returned more bytes than requested");
+            sftp_pkt_free(pktin);
+            return -1;
+        }
+
+        *pkt = pktin;
+        *data = payload.ptr;
+        return payload.len;
+    } else {
+        fxp_got_status(pktin);
+        sftp_pkt_free(pktin);
+        return -1;
+    }
+}
+
 /*
  * Read from a directory.
  */
@@ -900,40 +1009,186 @@ void fxp_set_userdata(struct sftp_request *req, void *data)
  */
 
 struct req {
-    char *buffer;
+    struct sftp_packet *pkt;       /* reply of a completed read */
+    const char *data;              /* payload, pointing into pkt */
     int len, retlen, complete;
     uint64_t offset;
+    unsigned long sent;            /* GETTICKCOUNT() when the request went out */
     struct req *next, *prev;
 };
 
+/*
+ * Downloads keep a window of read requests outstanding. The window
+ * starts out at the size we used to hard-code and is then adapted at
+ * runtime to the bandwidth-delay product measured for this transfer.
+ * If the server tells us its read limit, the size of the individual
+ * requests grows along with the window so that the number of
+ * outstanding requests stays reasonable.
+ */
+#define XFER_WINDOW_INITIAL   (4 * 1048576)
+#define XFER_WINDOW_MIN       (256 * 1024)
+#define XFER_WINDOW_MAX       (64 * 1048576)
+#define XFER_REQSIZE_DEFAULT  32768
+#define XFER_REQSIZE_MAX      (256 * 1024)
+
 struct fxp_xfer {
-    uint64_t offset, furthestdata, filesize;
-    int req_totalsize, req_maxsize;
+    uint64_t offset, furthestdata, filesize, end;
+    int req_totalsize, req_maxsize, req_size, req_size_limit;
     bool eof, err;
     struct fxp_handle *fh;
     struct req *head, *tail;
+    struct req *consumed;          /* handed out by xfer_download_data */
     _fztimer send_timer;
     int sent_interval;
+
+    /* Round-trip and delivery rate measurements, in ticks and bytes */
+    unsigned long srtt, min_rtt;
+    unsigned long sample_start;
+    uint64_t sample_bytes;
+    uint64_t rate;
+    int reported_window, reported_size;
 };
 
+/*
+ * Request descriptors are recycled through a free list. The number of
+ * descriptors alive at any time is bounded by the read-ahead window.
+ */
+static struct req *req_freelist;
+
+static struct req *req_alloc(void)
+{
+    struct req *rr = req_freelist;
+    if (rr)
+        req_freelist = rr->next;
+    else
+        rr = snew(struct req);
+    rr->pkt = NULL;
+    rr->data = NULL;
+    return rr;
+}
+
+static void req_free(struct req *rr)
+{
+    if (rr->pkt)
+        sftp_pkt_free(rr->pkt);
+    rr->next = req_freelist;
+    req_freelist = rr;
+}
+
 static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64_t offset)
 {
     struct fxp_xfer *xfer = snew(struct fxp_xfer);
+    uint64_t max_read = fxp_get_max_read_length();
 
     xfer->fh = fh;
     xfer->offset = offset;
     xfer->head = xfer->tail = NULL;
+    xfer->consumed = NULL;
     xfer->req_totalsize = 0;
-    xfer->req_maxsize = 1048576*4;
+    xfer->req_maxsize = XFER_WINDOW_INITIAL;
+    xfer->req_size = XFER_REQSIZE_DEFAULT;
+    xfer->req_size_limit = XFER_REQSIZE_DEFAULT;
+    if (max_read > XFER_REQSIZE_MAX)
+        xfer->req_size_limit = XFER_REQSIZE_MAX;
+    else if (max_read > XFER_REQSIZE_DEFAULT)
+        xfer->req_size_limit = (int)max_read;
     xfer->err = false;
     xfer->filesize = UINT64_MAX;
+    xfer->end = UINT64_MAX;
     xfer->furthestdata = 0;
     fz_timer_init(&xfer->send_timer);
     xfer->sent_interval = 0;
+    xfer->srtt = 0;
+    xfer->min_rtt = 0;
+    xfer->sample_start = GETTICKCOUNT();
+    xfer->sample_bytes = 0;
+    xfer->rate = 0;
+    xfer->reported_window = xfer->req_maxsize;
+    xfer->reported_size = xfer->req_size;
 
     return xfer;
 }
 
+static void xfer_report_window(struct fxp_xfer *xfer)
+{
+    fzprintf(sftpVerbose, "Read-ahead window: %d KiB in requests of %d bytes, rtt %lu ms, min rtt %lu ms, rate %"PRIu64" KiB/s",
+             xfer->req_maxsize / 1024, xfer->req_size,
+             xfer->srtt * 1000 / TICKSPERSEC, xfer->min_rtt * 1000 / TICKSPERSEC,
+             xfer->rate / 1024);
+    xfer->reported_window = xfer->req_maxsize;
+    xfer->reported_size = xfer->req_size;
+}
+
+/*
+ * Called for every completed read request. Roughly once per round
+ * trip the window is re-evaluated:
+ *
+ * - If the smoothed RTT is close to the minimum RTT, nothing is
+ *   queueing up along the path and the window is what limits us, so
+ *   it is doubled.
+ * - Otherwise the pipe is full and the window is brought down towards
+ *   twice the bandwidth-delay product derived from the delivery rate
+ *   and the minimum RTT.
+ */
+static void xfer_adapt_window(struct fxp_xfer *xfer, struct req *rr)
+{
+    unsigned long now = GETTICKCOUNT();
+    unsigned long rtt = now - rr->sent;
+    unsigned long elapsed;
+    int window = xfer->req_maxsize;
+
+    if (rtt < 1)
+        rtt = 1;
+    if (!xfer->min_rtt || rtt < xfer->min_rtt)
+        xfer->min_rtt = rtt;
+    xfer->srtt = xfer->srtt ? (xfer->srtt * 7 + rtt) / 8 : rtt;
+
+    xfer->sample_bytes += rr->retlen;
+    elapsed = now - xfer->sample_start;
+    if (elapsed < xfer->srtt || elapsed < TICKSPERSEC / 10)
+        return;
+
+    xfer->rate = xfer->sample_bytes * TICKSPERSEC / elapsed;
+    xfer->sample_start = now;
+    xfer->sample_bytes = 0;
+
+    if (xfer->srtt * 4 < xfer->min_rtt * 5) {
+        if (window <= XFER_WINDOW_MAX / 2)
+            window *= 2;
+        else
+            window = XFER_WINDOW_MAX;
+    } else {
+        uint64_t target = 2 * xfer->rate * xfer->min_rtt / TICKSPERSEC;
+        if (target < (uint64_t)window) {
+            /* Back off gradually, a single slow sample is no reason to
+             * throw away most of the window. */
+            if (target < (uint64_t)window / 2)
+                target = window / 2;
+            window = (int)target;
+        }
+    }
+    if (window < XFER_WINDOW_MIN)
+        window = XFER_WINDOW_MIN;
+    if (window != xfer->req_maxsize)
+        fzprintf(sftpTransferWindow, "%d", window);
+    xfer->req_maxsize = window;
+
+    /* Aim for 64 to 128 requests in flight */
+    while (xfer->req_size * 2 <= xfer->req_size_limit &&
+           window / xfer->req_size > 128)
+        xfer->req_size *= 2;
+    while (xfer->req_size > XFER_REQSIZE_DEFAULT &&
+           window / xfer->req_size < 64)
+        xfer->req_size /= 2;
+    if (xfer->req_size > xfer->req_size_limit)
+        xfer->req_size = xfer->req_size_limit;
+
+    if (xfer->req_size != xfer->reported_size ||
+        window >= xfer->reported_window * 2 ||
+        window * 2 <= xfer->reported_window)
+        xfer_report_window(xfer);
+}
+
 bool xfer_done(struct fxp_xfer *xfer)
 {
     /*
@@ -953,7 +1208,7 @@ void xfer_download_queue(struct fxp_xfer *xfer)
         struct req *rr;
         struct sftp_request *req;
 
-        rr = snew(struct req);
+        rr = req_alloc();
         rr->offset = xfer->offset;
         rr->complete = 0;
         if (xfer->tail) {
@@ -966,14 +1221,21 @@ void xfer_download_queue(struct fxp_xfer *xfer)
         xfer->tail = rr;
         rr->next = NULL;
 
-        rr->len = 32768;
-        rr->buffer = snewn(rr->len, char);
+        rr->len = xfer->req_size;
+        if (xfer->end - xfer->offset < (uint64_t)rr->len)
+            rr->len = (int)(xfer->end - xfer->offset);
+        rr->sent = GETTICKCOUNT();
         sftp_register(req = fxp_read_send(xfer->fh, rr->offset, rr->len));
         fxp_set_userdata(req, rr);
 
         xfer->offset += rr->len;
         xfer->req_totalsize += rr->len;
 
+        /* The requested range has been queued completely, we are
+         * done once the outstanding requests return. */
+        if (xfer->offset >= xfer->end)
+            xfer->eof = true;
+
 #ifdef DEBUG_DOWNLOAD
         printf("queueing read request %p at %"PRIu64"\n", rr, rr->offset);
 #endif
@@ -981,10 +1243,18 @@ void xfer_download_queue(struct fxp_xfer *xfer)
 }
 
 struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset)
+{
+    return xfer_download_init_range(fh, offset, UINT64_MAX);
+}
+
+struct fxp_xfer *xfer_download_init_range(struct fxp_handle *fh,
+                                          uint64_t offset, uint64_t end)
 {
     struct fxp_xfer *xfer = xfer_init(fh, offset);
 
-    xfer->eof = false;
+    xfer->end = end;
+    xfer->eof = offset >= end;
+    fzprintf(sftpTransferWindow, "%d", xfer->req_maxsize);
     xfer_download_queue(xfer);
 
     return xfer;
@@ -1007,7 +1277,8 @@ int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
         fxp_internal_error("request ID is not part of the current download");
         return INT_MIN;                /* this packet isn't ours */
     }
-    rr->retlen = fxp_read_recv(pktin, rreq, rr->buffer, rr->len);
+    rr->retlen = fxp_read_recv_inplace(pktin, rreq, &rr->pkt, &rr->data,
+                                       rr->len);
 #ifdef DEBUG_DOWNLOAD
     printf("read request %p has returned [%d]\n", rr, rr->retlen);
 #endif
@@ -1028,6 +1299,9 @@ int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 
     rr->complete = 1;
 
+    if (rr->retlen > 0)
+        xfer_adapt_window(xfer, rr);
+
     /*
      * Special case: if we have received fewer bytes than we
      * actually read, we should do something. For the moment I'll
@@ -1076,11 +1350,16 @@ void xfer_set_error(struct fxp_xfer *xfer)
     xfer->err = true;
 }
 
-bool xfer_download_data(struct fxp_xfer *xfer, void **buf, int *len)
+bool xfer_download_data(struct fxp_xfer *xfer, const void **buf, int *len)
 {
-    void *retbuf = NULL;
+    const void *retbuf = NULL;
     int retlen = 0;
 
+    if (xfer->consumed) {
+        req_free(xfer->consumed);
+        xfer->consumed = NULL;
+    }
+
     /*
      * Discard anything at the head of the rr queue with complete <
      * 0; return the first thing with complete > 0.
@@ -1089,7 +1368,7 @@ bool xfer_download_data(struct fxp_xfer *xfer, void **buf, int *len)
         struct req *rr = xfer->head;
 
         if (rr->complete > 0) {
-            retbuf = rr->buffer;
+            retbuf = rr->data;
             retlen = rr->retlen;
 #ifdef DEBUG_DOWNLOAD
             printf("handing back data from read request %p\n", rr);
@@ -1106,7 +1385,10 @@ bool xfer_download_data(struct fxp_xfer *xfer, void **buf, int *len)
         else
             xfer->tail = NULL;
         xfer->req_totalsize -= rr->len;
-        sfree(rr);
+        if (retbuf)
+            xfer->consumed = rr;
+        else
+            req_free(rr);
     }
 
     if (retbuf) {
@@ -1144,7 +1426,7 @@ void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
     struct req *rr;
     struct sftp_request *req;
 
-    rr = snew(struct req);
+    rr = req_alloc();
     rr->offset = xfer->offset;
     rr->complete = 0;
     if (xfer->tail) {
@@ -1158,7 +1440,6 @@ void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
     rr->next = NULL;
 
     rr->len = len;
-    rr->buffer = NULL;
     sftp_register(req = fxp_write_send(xfer->fh, buffer, rr->offset, len));
     fxp_set_userdata(req, rr);
 
@@ -1214,7 +1495,7 @@ int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
         fzprintf(sftpTransfer, "%d", xfer->sent_interval);
         xfer->sent_interval = 0;
     }
-    sfree(rr);
+    req_free(rr);
 
     if (!ret)
         return -1;
@@ -1227,13 +1508,17 @@ void xfer_cleanup(struct fxp_xfer *xfer)
     if (xfer->sent_interval > 0) {
         fzprintf(sftpTransfer, "%d", xfer->sent_interval);
     }
+    if (xfer->srtt && (xfer->reported_window != xfer->req_maxsize ||
+                       xfer->reported_size != xfer->req_size))
+        xfer_report_window(xfer);
 
     struct req *rr;
+    if (xfer->consumed)
+        req_free(xfer->consumed);
     while (xfer->head) {
         rr = xfer->head;
         xfer->head = xfer->head->next;
-        sfree(rr->buffer);
-        sfree(rr);
+        req_free(rr);
     }
     sfree(xfer);
 }
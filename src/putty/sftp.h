@@ -168,6 +168,13 @@ int fxp_error_type(void);
  */
 bool fxp_init(void);
 
+/*
+ * Maximum read and write lengths announced by the server through the
+ * limits@openssh.com extension, or 0 if unknown.
+ */
+uint64_t fxp_get_max_read_length(void);
+uint64_t fxp_get_max_write_length(void);
+
 /*
  * Canonify a pathname. Concatenate the two given path elements
  * with a separating slash, unless the second is NULL.
@@ -250,6 +257,8 @@ struct sftp_request *fxp_read_send(struct fxp_handle *handle,
                                    uint64_t offset, int len);
 int fxp_read_recv(struct sftp_packet *pktin, struct sftp_request *req,
                   char *buffer, int len);
+int fxp_read_recv_inplace(struct sftp_packet *pktin, struct sftp_request *req,
+                          struct sftp_packet **pkt, const char **data, int len);
 
 /*
  * Write to a file.
@@ -299,9 +308,14 @@ struct sftp_packet *sftp_recv(void);
 struct fxp_xfer;
 
 struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset);
+/* Only downloads the bytes in [offset, end) */
+struct fxp_xfer *xfer_download_init_range(struct fxp_handle *fh,
+                                          uint64_t offset, uint64_t end);
 void xfer_download_queue(struct fxp_xfer *xfer);
 int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin);
-bool xfer_download_data(struct fxp_xfer *xfer, void **buf, int *len);
+/* The returned buffer stays valid until the next call to
+ * xfer_download_data or xfer_cleanup; it must not be freed. */
+bool xfer_download_data(struct fxp_xfer *xfer, const void **buf, int *len);
 
 struct fxp_xfer *xfer_upload_init(struct fxp_handle *fh, uint64_t offset);
 bool xfer_upload_ready(struct fxp_xfer *xfer);
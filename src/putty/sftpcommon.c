@@ -23,14 +23,37 @@ static void sftp_pkt_BinarySink_write(
     pkt->length += length;
 }
 
-struct sftp_packet *sftp_pkt_init(int type)
+/*
+ * Packets, together with their data buffers, are recycled through a
+ * small free list instead of going back to the heap each time. A fast
+ * transfer creates and destroys a couple of packets per read or write
+ * request, which adds up to tens of thousands of malloc/free pairs per
+ * second otherwise.
+ */
+#define SFTP_PKT_POOL_SIZE 256
+#define SFTP_PKT_POOL_MAXLEN (256 * 1024 + 256)
+
+static struct sftp_packet *sftp_pkt_pool[SFTP_PKT_POOL_SIZE];
+static int sftp_pkt_pool_count;
+
+static struct sftp_packet *sftp_pkt_alloc(void)
 {
     struct sftp_packet *pkt;
+    if (sftp_pkt_pool_count)
+        return sftp_pkt_pool[--sftp_pkt_pool_count];
+
     pkt = snew(struct sftp_packet);
     pkt->data = NULL;
+    pkt->maxlen = 0;
+    return pkt;
+}
+
+struct sftp_packet *sftp_pkt_init(int type)
+{
+    struct sftp_packet *pkt;
+    pkt = sftp_pkt_alloc();
     pkt->savedpos = -1;
     pkt->length = 0;
-    pkt->maxlen = 0;
     pkt->type = type;
     BinarySink_INIT(pkt, sftp_pkt_BinarySink_write);
     put_uint32(pkt, 0); /* length field will be filled in later */
@@ -104,6 +127,12 @@ bool BinarySource_get_fxp_attrs(BinarySource *src, struct fxp_attrs *attrs)
 
 void sftp_pkt_free(struct sftp_packet *pkt)
 {
+    if (sftp_pkt_pool_count < SFTP_PKT_POOL_SIZE &&
+        pkt->maxlen <= SFTP_PKT_POOL_MAXLEN) {
+        sftp_pkt_pool[sftp_pkt_pool_count++] = pkt;
+        return;
+    }
+
     if (pkt->data)
         sfree(pkt->data);
     sfree(pkt);
@@ -123,10 +152,14 @@ struct sftp_packet *sftp_recv_prepare(unsigned length)
 {
     struct sftp_packet *pkt;
 
-    pkt = snew(struct sftp_packet);
+    pkt = sftp_pkt_alloc();
     pkt->savedpos = 0;
-    pkt->length = pkt->maxlen = length;
-    pkt->data = snewn(pkt->length, char);
+    pkt->length = length;
+    if (pkt->maxlen < length) {
+        sfree(pkt->data);
+        pkt->data = snewn(length, char);
+        pkt->maxlen = length;
+    }
 
     return pkt;
 }
@@ -388,7 +388,7 @@ WFile *open_existing_wfile(const char *name, uint64_t *size)
 #endif
 }
 
-int write_to_file(WFile *f, void *buffer, int length)
+int write_to_file(WFile *f, const void *buffer, int length)
 {
 #if 1
     if (f->state == ok && !f->remaining_) {
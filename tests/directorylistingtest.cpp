@@ -0,0 +1,87 @@
+#include "../src/include/directorylisting.h"
+
+#include <libfilezilla/format.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts that files can be found in directory listings,
+ * including files appended after a search.
+ */
+
+class CDirectoryListingTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDirectoryListingTest);
+	CPPUNIT_TEST(testFind);
+	CPPUNIT_TEST(testAppendAfterFind);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testFind();
+	void testAppendAfterFind();
+
+protected:
+	static void append(CDirectoryListing & listing, std::wstring const& name);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDirectoryListingTest);
+
+void CDirectoryListingTest::append(CDirectoryListing & listing, std::wstring const& name)
+{
+	CDirentry entry;
+	entry.name = name;
+	entry.size = 42;
+	listing.Append(std::move(entry));
+}
+
+void CDirectoryListingTest::testFind()
+{
+	CDirectoryListing listing;
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpCase(L"foo"));
+
+	append(listing, L"foo");
+	append(listing, L"Bar");
+	append(listing, L"bar");
+
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpCase(L"foo"));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listing.FindFile_CmpCase(L"Bar"));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), listing.FindFile_CmpCase(L"bar"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpCase(L"FOO"));
+
+	// First match wins if names only differ in case
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpNoCase(L"FOO"));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listing.FindFile_CmpNoCase(L"BAR"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpNoCase(L"baz"));
+}
+
+void CDirectoryListingTest::testAppendAfterFind()
+{
+	CDirectoryListing listing;
+	append(listing, L"first");
+
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpCase(L"first"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpNoCase(L"FIRST"));
+
+	// Enough entries to outgrow the search maps built so far
+	size_t const count = 100;
+	for (size_t i = 0; i < count; ++i) {
+		append(listing, fz::sprintf(L"File%d", i));
+
+		std::wstring const name = fz::sprintf(L"File%d", i);
+		CPPUNIT_ASSERT_EQUAL(i + 1, listing.FindFile_CmpCase(name));
+		CPPUNIT_ASSERT_EQUAL(i + 1, listing.FindFile_CmpNoCase(fz::sprintf(L"file%d", i)));
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		CPPUNIT_ASSERT_EQUAL(i + 1, listing.FindFile_CmpCase(fz::sprintf(L"File%d", i)));
+	}
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpCase(L"first"));
+
+	// Duplicate names keep resolving to the earlier entry
+	append(listing, L"first");
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpCase(L"first"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpNoCase(L"First"));
+}
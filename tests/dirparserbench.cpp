@@ -0,0 +1,282 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/directorylistingparser.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <locale.h>
+#include <string.h>
+
+#ifdef FZ_WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Throughput benchmark for the directory listing parser.
+ *
+ * Generates synthetic listings in several formats and sizes, feeds them to
+ * the parser in chunks like the transfer socket does and prints one line of
+ * JSON per run, suitable for tracking regressions.
+ *
+ * Usage: dirparserbench [--sizes 1000,100000] [--formats unix,mlsd] [--chunk 65536] [--repeat 3]
+ */
+
+namespace {
+struct format
+{
+	char const* name;
+	void (*generate)(std::string & out, size_t i);
+};
+
+char const* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+char const* const vms_months[] = {"JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"};
+
+std::string two_digits(size_t v)
+{
+	v %= 100;
+	std::string ret(2, '0');
+	ret[0] = static_cast<char>('0' + v / 10);
+	ret[1] = static_cast<char>('0' + v % 10);
+	return ret;
+}
+
+void generate_unix(std::string & out, size_t i)
+{
+	bool const dir = i % 10 == 0;
+	out += dir ? "drwxr-xr-x   2 " : "-rw-r--r--   1 ";
+	out += "user     group    ";
+	out += std::to_string(dir ? 4096 : i * 37 + 1);
+	out += ' ';
+	out += months[i % 12];
+	out += ' ';
+	out += std::to_string(i % 28 + 1);
+	out += (i % 3) ? " 12:" + two_digits(i) : "  2019";
+	out += dir ? " directory_" : " file_";
+	out += std::to_string(i);
+	out += dir ? "\r\n" : ".txt\r\n";
+}
+
+void generate_dos(std::string & out, size_t i)
+{
+	bool const dir = i % 10 == 0;
+	out += two_digits(i % 12 + 1) + "-" + two_digits(i % 28 + 1) + "-19  ";
+	out += two_digits(i % 12 + 1) + ":" + two_digits(i) + ((i % 2) ? "PM" : "AM");
+	out += dir ? "       <DIR>          directory_" : "       ";
+	if (!dir) {
+		out += std::to_string(i * 37 + 1);
+		out += " file_";
+	}
+	out += std::to_string(i);
+	out += dir ? "\r\n" : ".txt\r\n";
+}
+
+void generate_mlsd(std::string & out, size_t i)
+{
+	bool const dir = i % 10 == 0;
+	out += dir ? "type=dir;" : "type=file;size=";
+	if (!dir) {
+		out += std::to_string(i * 37 + 1);
+		out += ';';
+	}
+	out += "modify=2019" + two_digits(i % 12 + 1) + two_digits(i % 28 + 1) + "12" + two_digits(i % 60) + "00;";
+	out += "perm=adfrw;UNIX.mode=0644;UNIX.owner=1000;UNIX.group=1000;";
+	out += dir ? " directory_" : " file_";
+	out += std::to_string(i);
+	out += dir ? "\r\n" : ".txt\r\n";
+}
+
+void generate_vms(std::string & out, size_t i)
+{
+	bool const dir = i % 10 == 0;
+	out += dir ? "DIRECTORY_" : "FILE_";
+	out += std::to_string(i);
+	out += dir ? ".DIR;1  1 " : ".TXT;1  155 ";
+	out += std::to_string(i % 28 + 1);
+	out += '-';
+	out += vms_months[i % 12];
+	out += "-2019 12:" + two_digits(i) + " [USER,GROUP] (RWED,RWED,RE,RE)\r\n";
+}
+
+void generate_mvs(std::string & out, size_t i)
+{
+	out += "WYOSPT 3420   2019/";
+	out += two_digits(i % 12 + 1) + "/" + two_digits(i % 28 + 1);
+	out += "  1  200  FB      80  8053  PS  USER.DATA.D";
+	out += std::to_string(i);
+	out += "\r\n";
+}
+
+format const formats[] = {
+	{"unix", &generate_unix},
+	{"dos", &generate_dos},
+	{"mlsd", &generate_mlsd},
+	{"vms", &generate_vms},
+	{"mvs", &generate_mvs}
+};
+
+// Memory usage of the process in KiB. Each run gets its own child process,
+// so the peak resident set size is that of the run alone. Windows has no
+// fork, there the current working set is used instead and has to be sampled
+// while the listing is still alive.
+uint64_t memory_usage()
+{
+#ifdef FZ_WINDOWS
+	PROCESS_MEMORY_COUNTERS pmc{};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return pmc.WorkingSetSize / 1024;
+	}
+	return 0;
+#else
+	rusage usage{};
+	if (getrusage(RUSAGE_SELF, &usage)) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return static_cast<uint64_t>(usage.ru_maxrss) / 1024;
+#else
+	return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+bool run_once(format const& f, std::string const& data, size_t size, size_t chunk, int run)
+{
+	CServer server;
+
+	uint64_t const baseline = memory_usage();
+	uint64_t used{};
+
+	auto const start = fz::monotonic_clock::now();
+
+	size_t parsed{};
+	{
+		CDirectoryListingParser parser(nullptr, server);
+		for (size_t offset = 0; offset < data.size(); offset += chunk) {
+			parser.AddData(data.c_str() + offset, std::min(chunk, data.size() - offset));
+		}
+		CDirectoryListing listing = parser.Parse(CServerPath(L"/"));
+		parsed = listing.size();
+
+		uint64_t const usage = memory_usage();
+		used = usage > baseline ? usage - baseline : 0;
+	}
+
+	double const seconds = (fz::monotonic_clock::now() - start).get_microseconds() / 1000000.0;
+	double const entries_per_second = seconds > 0 ? size / seconds : 0;
+	double const mb_per_second = seconds > 0 ? data.size() / seconds / (1024 * 1024) : 0;
+
+	std::cout << fz::sprintf("{\"format\":\"%s\",\"entries\":%u,\"parsed\":%u,\"bytes\":%u,\"run\":%d,\"seconds\":%s,\"entries_per_second\":%s,\"mb_per_second\":%s,\"memory_kib\":%u}",
+		f.name, size, parsed, data.size(), run, std::to_string(seconds), std::to_string(entries_per_second), std::to_string(mb_per_second), used) << std::endl;
+
+	if (parsed != size) {
+		std::cerr << fz::sprintf("%s: parsed %u of %u entries", f.name, parsed, size) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+std::vector<std::string> split(std::string const& s)
+{
+	std::vector<std::string> ret;
+	size_t start = 0;
+	while (start <= s.size()) {
+		size_t pos = s.find(',', start);
+		if (pos == std::string::npos) {
+			pos = s.size();
+		}
+		if (pos > start) {
+			ret.push_back(s.substr(start, pos - start));
+		}
+		start = pos + 1;
+	}
+	return ret;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+
+	std::vector<size_t> sizes{1000, 100000, 5000000};
+	std::vector<std::string> selected;
+	size_t chunk = 64 * 1024;
+	int repeat = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string const arg = argv[i];
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << std::endl;
+			return 1;
+		}
+		std::string const value = argv[++i];
+		if (arg == "--sizes") {
+			sizes.clear();
+			for (auto const& size : split(value)) {
+				sizes.push_back(static_cast<size_t>(std::stoull(size)));
+			}
+		}
+		else if (arg == "--formats") {
+			selected = split(value);
+		}
+		else if (arg == "--chunk") {
+			chunk = static_cast<size_t>(std::stoull(value));
+		}
+		else if (arg == "--repeat") {
+			repeat = std::stoi(value);
+		}
+		else {
+			std::cerr << "Unknown argument " << arg << std::endl;
+			return 1;
+		}
+	}
+	if (!chunk || repeat < 1) {
+		std::cerr << "Invalid arguments" << std::endl;
+		return 1;
+	}
+
+	bool ok = true;
+	for (auto const& f : formats) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), f.name) == selected.end()) {
+			continue;
+		}
+
+		for (auto const size : sizes) {
+			std::string data;
+			data.reserve(size * 100);
+			for (size_t i = 0; i < size; ++i) {
+				f.generate(data, i);
+			}
+
+			for (int run = 0; run < repeat; ++run) {
+#ifdef FZ_WINDOWS
+				if (!run_once(f, data, size, chunk, run)) {
+					ok = false;
+				}
+#else
+				std::cout.flush();
+				pid_t const pid = fork();
+				if (!pid) {
+					_exit(run_once(f, data, size, chunk, run) ? 0 : 1);
+				}
+
+				int status{};
+				if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+					ok = false;
+				}
+#endif
+			}
+		}
+	}
+
+	return ok ? 0 : 1;
+}
@@ -1471,10 +1471,7 @@ void CDirectoryListingParserTest::testIndividual()
 
 	CDirectoryListingParser parser(0, server);
 
-	size_t const len = entry.data.size();
-	char* data = new char[len];
-	memcpy(data, entry.data.c_str(), len);
-	parser.AddData(data, len);
+	parser.AddData(entry.data.c_str(), entry.data.size());
 
 	CDirectoryListing listing = parser.Parse(CServerPath());
 
@@ -1495,10 +1492,7 @@ void CDirectoryListingParserTest::testAll()
 	for (auto const& entry : m_entries) {
 		server.SetType(entry.serverType);
 		parser.SetServer(server);
-		size_t const len = entry.data.size();
-		char* data = new char[len];
-		memcpy(data, entry.data.c_str(), len);
-		parser.AddData(data, len);
+		parser.AddData(entry.data.c_str(), entry.data.size());
 	}
 	CDirectoryListing listing = parser.Parse(CServerPath());
 
@@ -1538,9 +1532,7 @@ void CDirectoryListingParserTest::testSpecial()
 
 			CDirectoryListingParser parser(0, server);
 
-			char* data = new char[line.size()];
-			memcpy(data, line.c_str(), line.size());
-			parser.AddData(data, line.size());
+			parser.AddData(line.c_str(), line.size());
 			parser.Parse(CServerPath());
 		}
 	}
@@ -0,0 +1,184 @@
+#include "../src/commonui/filter.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <locale.h>
+
+/*
+ * Throughput benchmark for filter evaluation.
+ *
+ * Evaluates several typical filter sets against synthetic names, once
+ * condition by condition through filter_manager::FilenameFilteredByFilter
+ * and once through the compiled filters, and prints one line of JSON per
+ * run. Both have to agree on every entry.
+ *
+ * Usage: filterbench [--entries 1000000] [--sets literals,regex] [--repeat 3]
+ */
+
+namespace {
+struct condition
+{
+	t_filterType type;
+	int condition;
+	wchar_t const* value;
+};
+
+struct filter_set
+{
+	char const* name;
+	CFilter::t_matchType matchType;
+	bool matchCase;
+	std::vector<condition> conditions;
+};
+
+std::vector<filter_set> const sets = {
+	// Like the default filters for temporary and version control files
+	{"literals", CFilter::any, false, {
+		{filter_name, 3, L"~"}, {filter_name, 3, L".bak"}, {filter_name, 0, L"#"}, {filter_name, 1, L"thumbs.db"},
+		{filter_name, 1, L"desktop.ini"}, {filter_name, 1, L".ds_store"}, {filter_name, 0, L".swp"}, {filter_name, 0, L"~$"}
+	}},
+	{"regex", CFilter::any, true, {
+		{filter_name, 4, L"^(CVS|\\.svn|\\.git|\\.hg)$"}, {filter_name, 4, L"\\.(o|obj|pyc)$"}, {filter_name, 4, L"^\\.#"}
+	}},
+	{"literal_regex", CFilter::any, false, {
+		{filter_name, 4, L"^CVS$"}, {filter_name, 4, L"^\\.git"}, {filter_name, 4, L"\\.o$"}, {filter_name, 4, L"tmp"}
+	}},
+	{"mixed", CFilter::all, false, {
+		{filter_path, 0, L"/backup"}, {filter_name, 4, L"[0-9]{4}-[0-9]{2}"}, {filter_size, 0, L"100000"}, {filter_date, 0, L"2015-01-01"}
+	}}
+};
+
+std::wstring const extensions[] = {L".txt", L".jpg", L".o", L".bak", L".tar.gz", L".pyc", L".swp", L""};
+std::wstring const specials[] = {L"CVS", L".git", L"Thumbs.db", L"desktop.ini", L".DS_Store", L".#lock", L"build~"};
+
+std::wstring generate_name(size_t i)
+{
+	if (i % 97 == 0) {
+		return specials[(i / 97) % 7];
+	}
+	std::wstring name = (i % 3) ? L"Document_" : L"IMG-2019-0";
+	name += std::to_wstring(i);
+	name += extensions[i % 8];
+	return name;
+}
+
+std::vector<std::string> split(std::string const& s)
+{
+	std::vector<std::string> ret;
+	size_t start = 0;
+	while (start <= s.size()) {
+		size_t pos = s.find(',', start);
+		if (pos == std::string::npos) {
+			pos = s.size();
+		}
+		if (pos > start) {
+			ret.push_back(s.substr(start, pos - start));
+		}
+		start = pos + 1;
+	}
+	return ret;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+
+	size_t entries = 1000000;
+	std::vector<std::string> selected;
+	int repeat = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string const arg = argv[i];
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << std::endl;
+			return 1;
+		}
+		std::string const value = argv[++i];
+		if (arg == "--entries") {
+			entries = static_cast<size_t>(std::stoull(value));
+		}
+		else if (arg == "--sets") {
+			selected = split(value);
+		}
+		else if (arg == "--repeat") {
+			repeat = std::stoi(value);
+		}
+		else {
+			std::cerr << "Unknown argument " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	if (!entries || repeat < 1) {
+		std::cerr << "Invalid arguments" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::wstring> names;
+	names.reserve(entries);
+	for (size_t i = 0; i < entries; ++i) {
+		names.push_back(generate_name(i));
+	}
+	std::wstring const paths[] = {L"/home/user/backup/2019", L"/srv/www/htdocs/images", L"/tmp"};
+	fz::datetime const date(fz::datetime::utc, 2014, 6, 1);
+
+	bool ok = true;
+	for (auto const& set : sets) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), set.name) == selected.end()) {
+			continue;
+		}
+
+		CFilter filter;
+		filter.matchType = set.matchType;
+		filter.matchCase = set.matchCase;
+		for (auto const& c : set.conditions) {
+			CFilterCondition condition;
+			if (!condition.set(c.type, c.value, c.condition, set.matchCase)) {
+				std::cerr << fz::sprintf("%s: invalid condition %s", set.name, c.value) << std::endl;
+				return 1;
+			}
+			filter.filters.push_back(condition);
+		}
+
+		for (int run = 0; run < repeat; ++run) {
+			std::vector<char> results(entries);
+
+			auto start = fz::monotonic_clock::now();
+			size_t filtered{};
+			for (size_t i = 0; i < entries; ++i) {
+				results[i] = filter_manager::FilenameFilteredByFilter(filter, names[i], paths[i % 3], false, static_cast<int64_t>(i * 13), 0644, date);
+				filtered += results[i];
+			}
+			double const direct = (fz::monotonic_clock::now() - start).get_microseconds() / 1000000.0;
+
+			start = fz::monotonic_clock::now();
+			compiled_filter const compiled(filter);
+			size_t mismatches{};
+			for (size_t i = 0; i < entries; ++i) {
+				bool const res = compiled.filtered(names[i], paths[i % 3], false, static_cast<int64_t>(i * 13), 0644, date);
+				if (res != static_cast<bool>(results[i])) {
+					++mismatches;
+				}
+			}
+			double const compiledSeconds = (fz::monotonic_clock::now() - start).get_microseconds() / 1000000.0;
+
+			std::cout << fz::sprintf("{\"set\":\"%s\",\"entries\":%u,\"filtered\":%u,\"run\":%d,\"direct_seconds\":%s,\"compiled_seconds\":%s,\"speedup\":%s}",
+				set.name, entries, filtered, run, std::to_string(direct), std::to_string(compiledSeconds),
+				std::to_string(compiledSeconds > 0 ? direct / compiledSeconds : 0)) << std::endl;
+
+			if (mismatches) {
+				std::cerr << fz::sprintf("%s: %u mismatches between direct and compiled evaluation", set.name, mismatches) << std::endl;
+				ok = false;
+			}
+		}
+	}
+
+	return ok ? 0 : 1;
+}
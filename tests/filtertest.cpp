@@ -0,0 +1,157 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/commonui/filter.h"
+
+/*
+ * This testsuite asserts that compiled filters give the same results as
+ * evaluating the filter conditions directly.
+ */
+
+class CFilterTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CFilterTest);
+	CPPUNIT_TEST(testLiterals);
+	CPPUNIT_TEST(testMatchCase);
+	CPPUNIT_TEST(testRegex);
+	CPPUNIT_TEST(testMatchTypes);
+	CPPUNIT_TEST(testValues);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testLiterals();
+	void testMatchCase();
+	void testRegex();
+	void testMatchTypes();
+	void testValues();
+
+protected:
+	static CFilter makeFilter(CFilter::t_matchType matchType, bool matchCase, std::vector<std::pair<int, std::wstring>> const& nameConditions);
+
+	// Checks both ways of evaluating the filter and returns the result
+	static bool filtered(CFilter const& filter, std::wstring const& name, std::wstring const& path = L"/", int64_t size = -1, int attributes = -1, fz::datetime const& date = fz::datetime());
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CFilterTest);
+
+CFilter CFilterTest::makeFilter(CFilter::t_matchType matchType, bool matchCase, std::vector<std::pair<int, std::wstring>> const& nameConditions)
+{
+	CFilter filter;
+	filter.matchType = matchType;
+	filter.matchCase = matchCase;
+	for (auto const& c : nameConditions) {
+		CFilterCondition condition;
+		CPPUNIT_ASSERT(condition.set(filter_name, c.second, c.first, matchCase));
+		filter.filters.push_back(condition);
+	}
+	return filter;
+}
+
+bool CFilterTest::filtered(CFilter const& filter, std::wstring const& name, std::wstring const& path, int64_t size, int attributes, fz::datetime const& date)
+{
+	bool const expected = filter_manager::FilenameFilteredByFilter(filter, name, path, false, size, attributes, date);
+	CPPUNIT_ASSERT_EQUAL(expected, compiled_filter(filter).filtered(name, path, false, size, attributes, date));
+	return expected;
+}
+
+void CFilterTest::testLiterals()
+{
+	// Several substrings share one matcher
+	CFilter filter = makeFilter(CFilter::any, true, {{0, L"~"}, {0, L".bak"}, {0, L"#"}, {3, L".tmp"}});
+	CPPUNIT_ASSERT(filtered(filter, L"foo~"));
+	CPPUNIT_ASSERT(filtered(filter, L"foo.bak.txt"));
+	CPPUNIT_ASSERT(filtered(filter, L"#foo#"));
+	CPPUNIT_ASSERT(filtered(filter, L"foo.tmp"));
+	CPPUNIT_ASSERT(!filtered(filter, L"foo.tmp.txt"));
+	CPPUNIT_ASSERT(!filtered(filter, L"foo.ba"));
+	CPPUNIT_ASSERT(!filtered(filter, L""));
+
+	// Overlapping patterns
+	filter = makeFilter(CFilter::all, true, {{0, L"abcd"}, {0, L"bc"}, {0, L"cde"}, {5, L"f"}});
+	CPPUNIT_ASSERT(!filtered(filter, L"xabcdx"));
+	CPPUNIT_ASSERT(filtered(filter, L"abcde"));
+	CPPUNIT_ASSERT(!filtered(filter, L"abcdef"));
+
+	filter = makeFilter(CFilter::all, true, {{1, L"foo"}, {2, L"f"}});
+	CPPUNIT_ASSERT(filtered(filter, L"foo"));
+	CPPUNIT_ASSERT(!filtered(filter, L"foobar"));
+}
+
+void CFilterTest::testMatchCase()
+{
+	CFilter filter = makeFilter(CFilter::any, false, {{0, L"Thumbs"}, {0, L"DESKTOP"}, {2, L"._"}});
+	CPPUNIT_ASSERT(filtered(filter, L"thumbs.db"));
+	CPPUNIT_ASSERT(filtered(filter, L"Desktop.ini"));
+	CPPUNIT_ASSERT(filtered(filter, L"._foo"));
+	CPPUNIT_ASSERT(!filtered(filter, L"foo"));
+
+	filter = makeFilter(CFilter::any, true, {{0, L"Thumbs"}, {0, L"DESKTOP"}});
+	CPPUNIT_ASSERT(!filtered(filter, L"thumbs.db"));
+	CPPUNIT_ASSERT(filtered(filter, L"Thumbs.db"));
+}
+
+void CFilterTest::testRegex()
+{
+	// Literal regular expressions become string comparisons
+	CFilter filter = makeFilter(CFilter::any, false, {{4, L"^CVS$"}});
+	CPPUNIT_ASSERT(filtered(filter, L"cvs"));
+	CPPUNIT_ASSERT(!filtered(filter, L"cvsignore"));
+
+	filter = makeFilter(CFilter::any, true, {{4, L"^\\.git"}, {4, L"\\.o$"}, {4, L"bak"}});
+	CPPUNIT_ASSERT(filtered(filter, L".gitignore"));
+	CPPUNIT_ASSERT(filtered(filter, L"main.o"));
+	CPPUNIT_ASSERT(filtered(filter, L"file.bak"));
+	CPPUNIT_ASSERT(!filtered(filter, L"main.obj"));
+	CPPUNIT_ASSERT(!filtered(filter, L"xgit"));
+
+	filter = makeFilter(CFilter::any, true, {{4, L"^a.c$"}});
+	CPPUNIT_ASSERT(filtered(filter, L"abc"));
+	CPPUNIT_ASSERT(!filtered(filter, L"a.cd"));
+}
+
+void CFilterTest::testMatchTypes()
+{
+	std::vector<std::pair<int, std::wstring>> const conditions{{0, L"a"}, {0, L"b"}};
+	std::wstring const names[] = {L"", L"a", L"b", L"ab"};
+
+	bool const expected[4][4] = {
+		// all, any, none, not_all
+		{false, false, true, true},
+		{false, true, false, true},
+		{false, true, false, true},
+		{true, true, false, false}
+	};
+
+	for (int type = 0; type < 4; ++type) {
+		CFilter const filter = makeFilter(static_cast<CFilter::t_matchType>(type), true, conditions);
+		for (int i = 0; i < 4; ++i) {
+			CPPUNIT_ASSERT_EQUAL(expected[i][type], filtered(filter, names[i]));
+		}
+	}
+
+	// Without conditions, all entries are filtered unless the match type is "not all"
+	CPPUNIT_ASSERT(filtered(makeFilter(CFilter::all, true, {}), L"foo"));
+	CPPUNIT_ASSERT(filtered(makeFilter(CFilter::any, true, {}), L"foo"));
+	CPPUNIT_ASSERT(filtered(makeFilter(CFilter::none, true, {}), L"foo"));
+	CPPUNIT_ASSERT(!filtered(makeFilter(CFilter::not_all, true, {}), L"foo"));
+}
+
+void CFilterTest::testValues()
+{
+	CFilter filter = makeFilter(CFilter::all, true, {{3, L".iso"}});
+	CFilterCondition size;
+	CPPUNIT_ASSERT(size.set(filter_size, L"1000", 0, true));
+	filter.filters.push_back(size);
+	CFilterCondition path;
+	CPPUNIT_ASSERT(path.set(filter_path, L"/tmp", 2, true));
+	filter.filters.push_back(path);
+
+	CPPUNIT_ASSERT(filtered(filter, L"foo.iso", L"/tmp/foo", 5000));
+	CPPUNIT_ASSERT(!filtered(filter, L"foo.iso", L"/tmp/foo", 500));
+	CPPUNIT_ASSERT(!filtered(filter, L"foo.iso", L"/home", 5000));
+
+	// Unknown sizes skip the size condition
+	CPPUNIT_ASSERT(filtered(filter, L"foo.iso", L"/tmp/foo", -1));
+}
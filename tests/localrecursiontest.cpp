@@ -0,0 +1,162 @@
+#include "../src/commonui/local_recursive_operation.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/util.hpp>
+
+#include <wx/filename.h>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <map>
+#include <set>
+
+/*
+ * This testsuite enumerates a local directory tree on multiple threads and
+ * asserts that each directory is listed after its parent and exactly once.
+ */
+
+namespace {
+class test_recursion final : public local_recursive_operation
+{
+public:
+	test_recursion(fz::thread_pool& pool)
+		: local_recursive_operation(pool)
+	{}
+
+	void wait() { thread_.join(); }
+
+	std::deque<listing> const& listed() const { return m_listedDirectories; }
+
+protected:
+	virtual void on_listed_directory() override {}
+};
+}
+
+class CLocalRecursionTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CLocalRecursionTest);
+	CPPUNIT_TEST(testSingleThreaded);
+	CPPUNIT_TEST(testParallel);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testSingleThreaded() { check(1); }
+	void testParallel() { check(4); }
+
+protected:
+	void createFile(CLocalPath const& dir, std::wstring const& name);
+	void check(size_t threads);
+
+	CLocalPath root_;
+
+	size_t const dirs_{8};
+	size_t const subdirs_{4};
+	size_t const files_{3};
+	size_t const bigFiles_{6000};
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CLocalRecursionTest);
+
+void CLocalRecursionTest::createFile(CLocalPath const& dir, std::wstring const& name)
+{
+	fz::file f(fz::to_native(dir.GetPath() + name), fz::file::writing, fz::file::empty);
+	CPPUNIT_ASSERT(f.opened());
+}
+
+void CLocalRecursionTest::setUp()
+{
+	root_ = CLocalPath(wxFileName::GetTempDir().ToStdWstring());
+	root_.AddSegment(fz::sprintf(L"fzrecursiontest%d", fz::random_number(0, 1000000000)));
+	CPPUNIT_ASSERT(fz::mkdir(fz::to_native(root_.GetPath()), false));
+
+	for (size_t i = 0; i < dirs_; ++i) {
+		CLocalPath dir = root_;
+		dir.AddSegment(fz::sprintf(L"dir%d", i));
+		for (size_t j = 0; j < subdirs_; ++j) {
+			CLocalPath subdir = dir;
+			subdir.AddSegment(fz::sprintf(L"sub%d", j));
+			CPPUNIT_ASSERT(fz::mkdir(fz::to_native(subdir.GetPath()), true));
+			for (size_t k = 0; k < files_; ++k) {
+				createFile(subdir, fz::sprintf(L"file%d", k));
+			}
+		}
+	}
+
+	// Gets passed on in several chunks
+	CLocalPath big = root_;
+	big.AddSegment(L"big");
+	CPPUNIT_ASSERT(fz::mkdir(fz::to_native(big.GetPath()), false));
+	for (size_t i = 0; i < bigFiles_; ++i) {
+		createFile(big, fz::sprintf(L"file%d", i));
+	}
+}
+
+void CLocalRecursionTest::tearDown()
+{
+	if (!root_.empty()) {
+		wxFileName::Rmdir(root_.GetPath(), wxPATH_RMDIR_RECURSIVE);
+	}
+}
+
+void CLocalRecursionTest::check(size_t threads)
+{
+	fz::thread_pool pool;
+	test_recursion op(pool);
+	op.set_thread_count(threads);
+
+	local_recursion_root root;
+	root.add_dir_to_visit(root_);
+	op.AddRecursionRoot(std::move(root));
+
+	CPPUNIT_ASSERT(op.start_recursive_operation(recursive_operation::recursive_list, ActiveFilters()));
+	op.wait();
+
+	auto const& listed = op.listed();
+	CPPUNIT_ASSERT(!listed.empty());
+
+	// Directories announced by the listing of their parent
+	std::set<std::wstring> announced;
+	announced.insert(root_.GetPath());
+
+	std::map<std::wstring, size_t> chunks;
+	std::set<std::wstring> names;
+	size_t files{};
+	for (size_t i = 0; i < listed.size(); ++i) {
+		auto const& d = listed[i];
+		if (d.localPath.empty()) {
+			// End marker
+			CPPUNIT_ASSERT_EQUAL(listed.size() - 1, i);
+			continue;
+		}
+
+		std::wstring const path = d.localPath.GetPath();
+		CPPUNIT_ASSERT(announced.count(path));
+		++chunks[path];
+
+		for (auto const& dir : d.dirs) {
+			CLocalPath child = d.localPath;
+			child.AddSegment(dir.name);
+			CPPUNIT_ASSERT(announced.insert(child.GetPath()).second);
+		}
+		for (auto const& file : d.files) {
+			CPPUNIT_ASSERT(names.insert(path + file.name).second);
+		}
+		files += d.files.size();
+	}
+
+	CPPUNIT_ASSERT(listed.back().localPath.empty());
+	CPPUNIT_ASSERT_EQUAL(dirs_ * subdirs_ * files_ + bigFiles_, files);
+	CPPUNIT_ASSERT_EQUAL(2 + dirs_ + dirs_ * subdirs_, announced.size());
+	CPPUNIT_ASSERT_EQUAL(announced.size(), chunks.size());
+
+	CLocalPath big = root_;
+	big.AddSegment(L"big");
+	CPPUNIT_ASSERT_EQUAL(size_t(2), chunks[big.GetPath()]);
+
+	op.StopRecursiveOperation();
+}
@@ -0,0 +1,160 @@
+#include "../src/commonui/segmented_transfer.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <wx/filename.h>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <string>
+
+/*
+ * This testsuite asserts that files get split into segments and that
+ * segments written out of order reassemble to the original file.
+ */
+
+class CSegmentedTransferTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CSegmentedTransferTest);
+	CPPUNIT_TEST(testSplit);
+	CPPUNIT_TEST(testContiguous);
+	CPPUNIT_TEST(testReassembly);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testSplit();
+	void testContiguous();
+	void testReassembly();
+
+protected:
+	void checkCoverage(std::vector<transfer_segment> const& segments, uint64_t size);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CSegmentedTransferTest);
+
+void CSegmentedTransferTest::checkCoverage(std::vector<transfer_segment> const& segments, uint64_t size)
+{
+	uint64_t offset{};
+	for (auto const& segment : segments) {
+		CPPUNIT_ASSERT(segment);
+		CPPUNIT_ASSERT_EQUAL(offset, segment.offset);
+		CPPUNIT_ASSERT_EQUAL(uint64_t(0), segment.done);
+		offset += segment.length;
+	}
+	CPPUNIT_ASSERT_EQUAL(size, offset);
+}
+
+void CSegmentedTransferTest::testSplit()
+{
+	uint64_t const mb = 1024 * 1024;
+
+	CPPUNIT_ASSERT(segmented_transfer::split(0, 4).empty());
+
+	auto segments = segmented_transfer::split(100 * mb, 4);
+	CPPUNIT_ASSERT_EQUAL(size_t(4), segments.size());
+	checkCoverage(segments, 100 * mb);
+	for (auto const& segment : segments) {
+		CPPUNIT_ASSERT_EQUAL(25 * mb, segment.length);
+	}
+
+	// Never smaller than the minimum segment size
+	segments = segmented_transfer::split(40 * mb, 4);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), segments.size());
+	checkCoverage(segments, 40 * mb);
+
+	segments = segmented_transfer::split(20 * mb, 4);
+	CPPUNIT_ASSERT_EQUAL(size_t(1), segments.size());
+	checkCoverage(segments, 20 * mb);
+
+	// The last segment takes the remainder
+	segments = segmented_transfer::split(100, 3, 0);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), segments.size());
+	checkCoverage(segments, 100);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(33), segments[0].length);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(34), segments[2].length);
+
+	segments = segmented_transfer::split(100, 0, 0);
+	CPPUNIT_ASSERT_EQUAL(size_t(1), segments.size());
+	checkCoverage(segments, 100);
+}
+
+void CSegmentedTransferTest::testContiguous()
+{
+	auto segments = segmented_transfer::split(300, 3, 0);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(0), segmented_transfer::contiguous(segments));
+
+	// Gaps end the contiguous part
+	segments[0].done = 50;
+	segments[1].done = 100;
+	CPPUNIT_ASSERT_EQUAL(uint64_t(50), segmented_transfer::contiguous(segments));
+
+	segments[0].done = 100;
+	CPPUNIT_ASSERT_EQUAL(uint64_t(200), segmented_transfer::contiguous(segments));
+
+	// Order of the segments does not matter
+	std::swap(segments[0], segments[2]);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(200), segmented_transfer::contiguous(segments));
+
+	for (auto & segment : segments) {
+		segment.done = segment.length;
+	}
+	CPPUNIT_ASSERT_EQUAL(uint64_t(300), segmented_transfer::contiguous(segments));
+}
+
+void CSegmentedTransferTest::testReassembly()
+{
+	std::wstring const file = wxFileName::CreateTempFileName(L"fzsegtest").ToStdWstring();
+	CPPUNIT_ASSERT(!file.empty());
+
+	std::string data;
+	for (size_t i = 0; i < 100000; ++i) {
+		data += static_cast<char>('a' + (i * 7) % 26);
+	}
+
+	auto segments = segmented_transfer::split(data.size(), 4, 0);
+	CPPUNIT_ASSERT_EQUAL(size_t(4), segments.size());
+
+	// A fresh file gets allocated to its final size
+	CPPUNIT_ASSERT(segmented_transfer::prepare_local_file(file, data.size(), true));
+	CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(data.size()), fz::local_filesys::get_size(fz::to_native(file)));
+
+	auto write = [&](transfer_segment const& segment, uint64_t from, uint64_t to) {
+		fz::file f(fz::to_native(file), fz::file::writing, fz::file::existing);
+		CPPUNIT_ASSERT(f.opened());
+		int64_t const offset = static_cast<int64_t>(segment.offset + from);
+		CPPUNIT_ASSERT_EQUAL(offset, f.seek(offset, fz::file::begin));
+		int64_t const len = static_cast<int64_t>(to - from);
+		CPPUNIT_ASSERT_EQUAL(len, f.write(data.c_str() + offset, len));
+	};
+
+	// Write the segments out of order, the first half of each one
+	for (size_t i = segments.size(); i-- > 0;) {
+		write(segments[i], 0, segments[i].length / 2);
+		segments[i].done = segments[i].length / 2;
+	}
+	CPPUNIT_ASSERT_EQUAL(segments[0].length / 2, segmented_transfer::contiguous(segments));
+
+	// Resuming leaves the file as it is
+	CPPUNIT_ASSERT(segmented_transfer::prepare_local_file(file, data.size(), false));
+	CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(data.size()), fz::local_filesys::get_size(fz::to_native(file)));
+
+	for (auto & segment : segments) {
+		write(segment, segment.done, segment.length);
+		segment.done = segment.length;
+	}
+	CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(data.size()), segmented_transfer::contiguous(segments));
+
+	std::string read(data.size(), '\0');
+	{
+		fz::file f(fz::to_native(file), fz::file::reading, fz::file::existing);
+		CPPUNIT_ASSERT(f.opened());
+		CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(read.size()), f.read(&read[0], static_cast<int64_t>(read.size())));
+	}
+	CPPUNIT_ASSERT(read == data);
+
+	fz::remove_file(fz::to_native(file));
+}